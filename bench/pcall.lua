@@ -0,0 +1,53 @@
+-- Cost of protected calls: every pcall, error and yield goes through
+-- luaD_rawrunprotected, so these loops show what LUAI_TRY/LUAI_THROW
+-- cost in a build.  Compare builds that jump differently, e.g.:
+--   make posix && cp src/lua lua-posix && make clean
+--   make generic && cp src/lua lua-generic
+--   lua-posix bench/pcall.lua; lua-generic bench/pcall.lua
+-- ('posix' uses _setjmp/_longjmp; 'generic' uses setjmp/longjmp.)
+-- Each line gives the best of 'rounds' runs, in seconds of CPU time.
+-- Arguments select benchmarks by name (default: all of them).
+
+local rounds = 5
+
+local function id (x) return x end
+local function fail (x) error(x) end
+
+local benchs = {
+  -- the non-error path: one protected call per iteration
+  {"pcall", function ()
+    local pcall = pcall
+    for i = 1, 3000000 do pcall(id, i) end
+  end},
+
+  -- every call raises an error and unwinds to its pcall
+  {"error", function ()
+    local pcall = pcall
+    for i = 1, 200000 do pcall(fail, i) end
+  end},
+
+  -- each resume is a protected call; each yield unwinds it
+  {"yield", function ()
+    local co = coroutine.wrap(function ()
+      while true do coroutine.yield() end
+    end)
+    for i = 1, 500000 do co() end
+  end},
+}
+
+local selected = {}
+for i = 1, #arg do selected[arg[i]] = true end
+
+for _, b in ipairs(benchs) do
+  local name, f = b[1], b[2]
+  if #arg == 0 or selected[name] then
+    local best = math.huge
+    for r = 1, rounds do
+      local t0 = os.clock()
+      f()
+      local t = os.clock() - t0
+      if t < best then best = t end
+    end
+    print(string.format("%-8s %.3f", name, best))
+  end
+end
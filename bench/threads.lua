@@ -0,0 +1,80 @@
+-- Throughput of one OS thread running a state built with LUA_USE_THREADS.
+-- The lock must cost next to nothing while no other thread uses the
+-- state; compare against a build without it:
+--   make posix && cp src/lua lua-plain && make clean
+--   make linux-threads && cp src/lua lua-threads
+--   lua-plain bench/threads.lua; lua-threads bench/threads.lua
+-- Each line gives the best of 'rounds' runs, in seconds of CPU time.
+-- Arguments select benchmarks by name (default: all of them).
+
+local rounds = 5
+local N = 200000
+
+local src = {}
+math.randomseed(42)
+for i = 1, N do src[i] = math.random(1, 1000000) end
+
+local benchs = {
+  -- comparator in Lua: one call back into Lua per comparison
+  {"sort-lt", function ()
+    local a = table.move(src, 1, N, 1, {})
+    table.sort(a, function (x, y) return x < y end)
+  end},
+
+  -- default comparator: API calls only
+  {"sort", function ()
+    local a = table.move(src, 1, N, 1, {})
+    table.sort(a)
+  end},
+
+  -- many calls to small C functions
+  {"api", function ()
+    local s, byte, floor = "abcdef", string.byte, math.floor
+    local t = {}
+    for i = 1, 2000000 do
+      local b = byte(s, (i % 6) + 1)
+      t[#t + 1] = floor(b / 2)
+      if #t > 1000 then t = {} end
+    end
+  end},
+
+  -- table library loops
+  {"tablib", function ()
+    for i = 1, 20 do
+      local a = table.move(src, 1, 20000, 1, {})
+      table.insert(a, 1, 0)
+      table.remove(a, 1)
+      local s = table.concat(a, ",")
+      local n = select("#", table.unpack(a, 1, 5000))
+    end
+  end},
+
+  -- a Lua function called from C for each match
+  {"gsub", function ()
+    local s = ("abc "):rep(50000)
+    for i = 1, 5 do s:gsub("%w+", function (w) return w end) end
+  end},
+
+  -- the VM alone (yield points only)
+  {"loop", function ()
+    local x = 0
+    for i = 1, 20000000 do x = x + i % 7 end
+  end},
+}
+
+local selected = {}
+for i = 1, #arg do selected[arg[i]] = true end
+
+for _, b in ipairs(benchs) do
+  local name, f = b[1], b[2]
+  if #arg == 0 or selected[name] then
+    local best = math.huge
+    for r = 1, rounds do
+      local t0 = os.clock()
+      f()
+      local t = os.clock() - t0
+      if t < best then best = t end
+    end
+    print(string.format("%-8s %.3f", name, best))
+  end
+end
@@ -56,23 +56,23 @@ const char lua_ident[] =
 #define api_checkstackindex(l, i, o)  \
 	api_check(l, isstackindex(i, o), "index not in the stack")
 
-//  State  indexԪط
-static TValue *index2addr (lua_State *L, int idx) {
-  // ǰĵϢ CallInfo
+// 将 State 中 index的元素返回
+l_sinline TValue *index2addr (lua_State *L, int idx) {
+  // 当前的调用信息 CallInfo
   CallInfo *ci = L->ci;
-  if (idx > 0) { // 
+  if (idx > 0) { // 正数索引
     TValue *o = ci->func + idx;
-	// top - (func + 1) == ջԪ
+	// top - (func + 1) == 栈中元素数量
     api_check(L, idx <= ci->top - (ci->func + 1), "unacceptable index");
     if (o >= L->top) return NONVALIDVALUE;
     else return o;
   }
   else if (!ispseudo(idx)) {  /* negative index */
-	// 
+	// 负数索引
     api_check(L, idx != 0 && -idx <= L->top - (ci->func + 1), "invalid index");
     return L->top + idx;
   }
-  else if (idx == LUA_REGISTRYINDEX) //  id ڻȡȫֵǼǱ
+  else if (idx == LUA_REGISTRYINDEX) // 假 id， 用于获取全局登记表
     return &G(L)->l_registry;
   else {  /* upvalues */
     idx = LUA_REGISTRYINDEX - idx;
@@ -171,8 +171,8 @@ LUA_API int lua_gettop (lua_State *L) {
   return cast_int(L->top - (L->ci->func + 1));
 }
 
-// ջΪֵָ idx Ϊ 0 ൱ջ
-// idx Ϊ൱ɾջ ɸԪ
+// 设置栈顶为指定的值，若 idx 为 0 ，则相当于清空栈，
+// 若idx 为负数，则相当于删除栈顶的 若干个元素
 LUA_API void lua_settop (lua_State *L, int idx) {
   StkId func = L->ci->func;
   lua_lock(L);
@@ -241,10 +241,10 @@ LUA_API void lua_copy (lua_State *L, int fromidx, int toidx) {
 LUA_API void lua_pushvalue (lua_State *L, int idx) {
   lua_lock(L);
 
-  // L->top = L idxԪ
+  // L->top = L idx的元素
   setobj2s(L, L->top, index2addr(L, idx));
 
-  // ջ
+  // 增加栈顶
   api_incr_top(L);
   lua_unlock(L);
 }
@@ -536,25 +536,25 @@ LUA_API const char *lua_pushfstring (lua_State *L, const char *fmt, ...) {
   return ret;
 }
 
-//  n == 0 ѹͨ
-// ѹհ
+// 若 n == 0 则压入普通函数
+// 否则压入闭包
 LUA_API void lua_pushcclosure (lua_State *L, lua_CFunction fn, int n) {
   lua_lock(L);
-  if (n == 0) { // ѹ뺯
+  if (n == 0) { // 压入函数
     setfvalue(L->top, fn);
   }
-  else { // ѹ Closure  Ǳհ
+  else { // 压入 Closure  估计是闭包
     CClosure *cl;
     api_checknelems(L, n);
     api_check(L, n <= MAXUPVAL, "upvalue index too large");
     luaC_checkGC(L);
-	// հ
+	// 创建闭包
     cl = luaF_newCclosure(L, n);
-	// հ
+	// 闭包函数
     cl->f = fn;
-	// ջɾ upvalues
+	// 从栈中删除 upvalues
     L->top -= n;
-	// upvalues
+	// 将upvalues，
     while (n--) {
       setobj2n(L, &cl->upvalue[n], L->top + n);
       /* does not need barrier because closure is white */
@@ -666,7 +666,7 @@ LUA_API int lua_rawget (lua_State *L, int idx) {
   return ttnov(L->top - 1);
 }
 
-// ջ±Ϊ idx tableУȡ±Ϊ n Ԫأѹջ
+// 从栈中下标为 idx 的table中，取出下标为 n 的元素，并压入栈顶
 LUA_API int lua_rawgeti (lua_State *L, int idx, lua_Integer n) {
   StkId t;
   lua_lock(L);
@@ -698,13 +698,13 @@ LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
   lua_lock(L);
   luaC_checkGC(L);
 
-  // һ table
+  // 创建一个空 table
   t = luaH_new(L);
-  // Ѹմtable ջ
+  // 把刚创建的table 放入栈顶
   sethvalue(L, L->top, t);
   api_incr_top(L);
   if (narray > 0 || nrec > 0)
-    luaH_resize(L, t, narray, nrec); // дСҪе
+    luaH_resize(L, t, narray, nrec); // 如果有大小的要求，则进行调整
   lua_unlock(L);
 }
 
@@ -959,10 +959,10 @@ static void f_call (lua_State *L, void *ud) {
 }
 
 
-// ú
-// nargs ,
-// nresults ֵ
-// Ҫջ
+// 调用函数
+// nargs 参数数量,
+// nresults 返回值数量
+// 函数要先入栈
 LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
                         lua_KContext ctx, lua_KFunction k) {
   struct CallS c;
@@ -981,7 +981,7 @@ LUA_API int lua_pcallk (lua_State *L, int nargs, int nresults, int errfunc,
     api_checkstackindex(L, errfunc, o);
     func = savestack(L, o);
   }
-  // úַ
+  // 获得函数地址
   c.func = L->top - (nargs+1);  /* function to be called */
   if (k == NULL || L->nny > 0) {  /* no continuation or no yieldable? */
     c.nresults = nresults;  /* do a 'conventional' protected call */
@@ -1014,7 +1014,7 @@ LUA_API int lua_load (lua_State *L, lua_Reader reader, void *data,
   int status;
   lua_lock(L);
   if (!chunkname) chunkname = "?";
-  // ʼ ZIO
+  // 初始化 ZIO
   luaZ_init(L, &z, reader, data);
   status = luaD_protectedparser(L, &z, chunkname, mode);
   if (status == LUA_OK) {  /* no errors? */
@@ -1118,6 +1118,21 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       res = g->gcrunning;
       break;
     }
+    case LUA_GCFINALIZE: {
+      res = luaC_runfinalizers(L, data);
+      break;
+    }
+    case LUA_GCSETFINMAX: {
+      res = cast_int(g->gcfinmax);
+      if (data < 0) data = 0;  /* 0 leaves all finalizers to the host */
+      g->gcfinmax = cast(unsigned int, data);
+      break;
+    }
+    case LUA_GCBULKFREE: {  /* only for allocators that free in bulk */
+      res = g->gcbulkfree;
+      g->gcbulkfree = (data != 0);
+      break;
+    }
     default: res = -1;  /* invalid option */
   }
   lua_unlock(L);
@@ -1157,6 +1172,28 @@ LUA_API int lua_next (lua_State *L, int idx) {
 }
 
 
+/*
+** Mark field 'k' of the table at 'idx' as a frozen global: functions
+** of chunks loaded with mode 'F', with that table as environment, read
+** it through the entry of the table bound to them, which assignments
+** to the field keep up to date.
+*/
+LUA_API void lua_freeze (lua_State *L, int idx, const char *k) {
+  StkId t;
+  TString *key;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  key = luaS_new(L, k);
+  setsvalue2s(L, L->top, key);  /* anchor it */
+  api_incr_top(L);
+  if (key->tt == LUA_TSHRSTR)  /* (global names in code are short) */
+    luaH_freeze(L, hvalue(t), key);
+  L->top--;
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_concat (lua_State *L, int n) {
   lua_lock(L);
   api_checknelems(L, n);
@@ -1173,6 +1210,15 @@ LUA_API void lua_concat (lua_State *L, int n) {
 }
 
 
+LUA_API int lua_sharestrings (lua_State *L) {
+  int n;
+  lua_lock(L);
+  n = luaS_share(L);
+  lua_unlock(L);
+  return n;
+}
+
+
 LUA_API void lua_len (lua_State *L, int idx) {
   StkId t;
   lua_lock(L);
@@ -1228,7 +1274,8 @@ static const char *aux_upvalue (StkId fi, int n, TValue **val,
       LClosure *f = clLvalue(fi);
       TString *name;
       Proto *p = f->p;
-      if (!(1 <= n && n <= p->sizeupvalues)) return NULL;
+      if (!(1 <= n && n <= p->sizeupvalues - p->nbound))
+        return NULL;  /* (cells of frozen globals are not visible) */
       *val = f->upvals[n-1]->v;
       if (uv) *uv = f->upvals[n - 1];
       name = p->upvalues[n-1].name;
@@ -1239,6 +1286,17 @@ static const char *aux_upvalue (StkId fi, int n, TValue **val,
 }
 
 
+/*
+** A new environment (upvalue 'n') for a function of a chunk whose
+** frozen globals are bound to the cells of its old one. All functions
+** of the chunk share that environment, so the whole chunk is unbound.
+*/
+static void unbindenv (lua_State *L, LClosure *f, int n) {
+  if (f->p->root != NULL && n - 1 == f->p->envup)
+    luaF_unbindglobals(L, f->p->root);
+}
+
+
 LUA_API const char *lua_getupvalue (lua_State *L, int funcindex, int n) {
   const char *name;
   TValue *val = NULL;  /* to avoid warnings */
@@ -1267,7 +1325,10 @@ LUA_API const char *lua_setupvalue (lua_State *L, int funcindex, int n) {
     L->top--;
     setobj(L, val, L->top);
     if (owner) { luaC_barrier(L, owner, L->top); }
-    else if (uv) { luaC_upvalbarrier(L, uv); }
+    else if (uv) {
+      luaC_upvalbarrier(L, uv);
+      unbindenv(L, clLvalue(fi), n);
+    }
   }
   lua_unlock(L);
   return name;
@@ -1279,7 +1340,8 @@ static UpVal **getupvalref (lua_State *L, int fidx, int n, LClosure **pf) {
   StkId fi = index2addr(L, fidx);
   api_check(L, ttisLclosure(fi), "Lua function expected");
   f = clLvalue(fi);
-  api_check(L, (1 <= n && n <= f->p->sizeupvalues), "invalid upvalue index");
+  api_check(L, (1 <= n && n <= f->p->sizeupvalues - f->p->nbound),
+               "invalid upvalue index");
   if (pf) *pf = f;
   return &f->upvals[n - 1];  /* get its upvalue pointer */
 }
@@ -1309,6 +1371,7 @@ LUA_API void lua_upvaluejoin (lua_State *L, int fidx1, int n1,
   LClosure *f1;
   UpVal **up1 = getupvalref(L, fidx1, n1, &f1);
   UpVal **up2 = getupvalref(L, fidx2, n2, NULL);
+  unbindenv(L, f1, n1);
   luaC_upvdeccount(L, *up1);
   *up1 = *up2;
   (*up1)->refcount++;
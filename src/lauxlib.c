@@ -728,7 +728,7 @@ typedef struct LoadS {
 } LoadS;
 
 
-// ȡ ud,LoadS еַ
+// 读取 ud,LoadS 中的字符串
 static const char *getS (lua_State *L, void *ud, size_t *size) {
   LoadS *ls = (LoadS *)ud;
   (void)L;  /* not used */
@@ -741,7 +741,7 @@ static const char *getS (lua_State *L, void *ud, size_t *size) {
 
 LUALIB_API int luaL_loadbufferx (lua_State *L, const char *buff, size_t size,
                                  const char *name, const char *mode) {
-  // װַΪ LoadS ṹ
+  // 包装字符串为 LoadS 结构
   LoadS ls;
   ls.s = buff;
   ls.size = size;
@@ -916,7 +916,7 @@ LUALIB_API void luaL_setfuncs (lua_State *L, const luaL_Reg *l, int nup) {
     int i;
     for (i = 0; i < nup; i++)  /* copy upvalues to the top */
       lua_pushvalue(L, -nup);
-	//  luaopen_base nup==0ѹͨ
+	// 在 luaopen_base 中nup==0，所以压入普通函数
     lua_pushcclosure(L, l->func, nup);  /* closure with those upvalues */
     lua_setfield(L, -(nup + 2), l->name);
   }
@@ -929,8 +929,8 @@ LUALIB_API void luaL_setfuncs (lua_State *L, const luaL_Reg *l, int nup) {
 ** into the stack
 */
 LUALIB_API int luaL_getsubtable (lua_State *L, int idx, const char *fname) {
-  // ջУidxtableУѰһ fname table
-  // ҵΪtable
+  // 在栈中，idx的table中，寻找一个叫 fname 的子table
+  // 找到，并且类型为table
   if (lua_getfield(L, idx, fname) == LUA_TTABLE)
     return 1;  /* table already there */
   else {
@@ -952,18 +952,18 @@ LUALIB_API int luaL_getsubtable (lua_State *L, int idx, const char *fname) {
 */
 LUALIB_API void luaL_requiref (lua_State *L, const char *modname,
                                lua_CFunction openf, int glb) {
-  //  registry УѰΪ _LOADED  tableûо½һ
+  // 在 registry 中，寻找名为 _LOADED 的 table，没有就新建一个
   luaL_getsubtable(L, LUA_REGISTRYINDEX, "_LOADED");
   lua_getfield(L, -1, modname);  /* _LOADED[modname] */
-  //  _LOADED Ѱ modname,
+  // 在 _LOADED 中寻找 modname,
   if (!lua_toboolean(L, -1)) {  /* package not already loaded? */
-	// û lib
+	// 还没加载这个 lib
     lua_pop(L, 1);  /* remove field */
-	//  ջ
+	// 函数 入栈
     lua_pushcfunction(L, openf);
-	// modname 
+	// modname 参数
     lua_pushstring(L, modname);  /* argument to open function */
-	// ú
+	// 调用函数
     lua_call(L, 1, 1);  /* call 'openf' to open module */
 	// top
 	//  table _LOADED
@@ -990,6 +990,24 @@ LUALIB_API void luaL_requiref (lua_State *L, const char *modname,
 }
 
 
+/*
+** Freezes (see 'lua_freeze') each global whose value is a table or a
+** function, such as the libraries and the functions of the base one.
+*/
+LUALIB_API void luaL_freezeglobals (lua_State *L) {
+  lua_pushglobaltable(L);
+  lua_pushnil(L);
+  while (lua_next(L, -2)) {
+    int t = lua_type(L, -1);
+    if (lua_type(L, -2) == LUA_TSTRING &&
+        (t == LUA_TTABLE || t == LUA_TFUNCTION))
+      lua_freeze(L, -3, lua_tostring(L, -2));
+    lua_pop(L, 1);  /* remove value */
+  }
+  lua_pop(L, 1);  /* remove global table */
+}
+
+
 LUALIB_API const char *luaL_gsub (lua_State *L, const char *s, const char *p,
                                                                const char *r) {
   const char *wild;
@@ -1032,6 +1050,1053 @@ LUALIB_API lua_State *luaL_newstate (void) {
 }
 
 
+/*
+** {======================================================
+** Arena allocator
+** States created by 'luaL_newarenastate' carve small blocks out of
+** large chunks. Freed small blocks go to per-size free lists and are
+** reused by later allocations; large blocks come from 'malloc' and are
+** kept in a list. All chunks and large blocks are released at once
+** when the state itself is freed, so 'lua_close' calls finalizers but
+** does not free objects one by one.
+** =======================================================
+*/
+
+#if !defined(LUAL_ARENACHUNK)
+#define LUAL_ARENACHUNK		(64 * 1024)	/* size of each chunk */
+#endif
+
+#if !defined(LUAL_ARENAMAXSMALL)
+#define LUAL_ARENAMAXSMALL	512	/* largest block served from chunks */
+#endif
+
+/* blocks are rounded up to multiples of this granularity */
+#define ARENA_GRAIN	16
+
+#define arenaclass(sz)	(((sz) + ARENA_GRAIN - 1) / ARENA_GRAIN)
+
+#define ARENA_NCLASSES	(arenaclass(LUAL_ARENAMAXSMALL) + 1)
+
+
+typedef union ArenaChunk {
+  union ArenaChunk *next;  /* chain of all chunks */
+  char pad_[ARENA_GRAIN];  /* keep chunk data aligned */
+} ArenaChunk;
+
+
+/* header of a large block */
+typedef union ArenaLarge {
+  struct {
+    union ArenaLarge *next;
+    union ArenaLarge *previous;
+  } l;
+  char pad_[ARENA_GRAIN];  /* keep block data aligned */
+} ArenaLarge;
+
+
+typedef struct ArenaFree {
+  struct ArenaFree *next;
+} ArenaFree;
+
+
+typedef struct Arena {
+  char *ptr;  /* free area in current chunk */
+  char *limit;  /* end of current chunk */
+  ArenaChunk *chunks;  /* list of all chunks */
+  ArenaLarge *large;  /* list of all large blocks */
+  const void *mainblock;  /* block holding the state itself */
+  ArenaFree *blocks[ARENA_NCLASSES];  /* free small blocks, per class */
+} Arena;
+
+
+static void freearena (Arena *a) {
+  ArenaChunk *c = a->chunks;
+  ArenaLarge *b = a->large;
+  while (c != NULL) {
+    ArenaChunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  while (b != NULL) {
+    ArenaLarge *next = b->l.next;
+    free(b);
+    b = next;
+  }
+  free(a);
+}
+
+
+/*
+** get a block of class 'k' from its free list or from the current
+** chunk, starting a new chunk when the current one is exhausted
+*/
+static void *arenanew (Arena *a, size_t k) {
+  size_t sz = k * ARENA_GRAIN;
+  ArenaFree *b = a->blocks[k];
+  if (b != NULL) {
+    a->blocks[k] = b->next;
+    return b;
+  }
+  if (sz > (size_t)(a->limit - a->ptr)) {  /* not enough room? */
+    ArenaChunk *c = (ArenaChunk *)malloc(sizeof(ArenaChunk) +
+                                         LUAL_ARENACHUNK);
+    if (c == NULL) return NULL;
+    c->next = a->chunks;
+    a->chunks = c;
+    a->ptr = (char *)(c + 1);
+    a->limit = a->ptr + LUAL_ARENACHUNK;
+  }
+  b = (ArenaFree *)a->ptr;
+  a->ptr += sz;
+  return b;
+}
+
+
+/* allocates or resizes ('ptr' not NULL) a large block */
+static void *largenew (Arena *a, void *ptr, size_t nsize) {
+  ArenaLarge *o = (ptr != NULL) ? (ArenaLarge *)ptr - 1 : NULL;
+  ArenaLarge *b;
+  if (nsize > (size_t)~0 - sizeof(ArenaLarge))
+    return NULL;
+  b = (ArenaLarge *)realloc(o, sizeof(ArenaLarge) + nsize);
+  if (b == NULL) return NULL;
+  if (o == NULL) {  /* new block? */
+    b->l.previous = NULL;
+    b->l.next = a->large;
+    if (a->large) a->large->l.previous = b;
+    a->large = b;
+  }
+  else if (b != o) {  /* block moved? */
+    if (b->l.previous) b->l.previous->l.next = b;
+    else a->large = b;
+    if (b->l.next) b->l.next->l.previous = b;
+  }
+  return b + 1;
+}
+
+
+static void largefree (Arena *a, void *ptr) {
+  ArenaLarge *b = (ArenaLarge *)ptr - 1;
+  if (b->l.previous) b->l.previous->l.next = b->l.next;
+  else a->large = b->l.next;
+  if (b->l.next) b->l.next->l.previous = b->l.previous;
+  free(b);
+}
+
+
+/*
+** A block that shrinks keeps its place when there is no memory for a
+** smaller one. A large block that Lua then takes for a small one ends
+** up in a free list, but stays in the list of large blocks, which
+** frees it with the arena.
+*/
+static void *arena_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Arena *a = (Arena *)ud;
+  void *nb;
+  if (ptr == NULL)
+    osize = 0;  /* 'osize' only codes the kind of object being created */
+  else if (ptr == a->mainblock && nsize == 0) {  /* freeing the state? */
+    freearena(a);  /* everything else goes with it */
+    return NULL;
+  }
+  if (nsize == 0) {
+    if (ptr == NULL)
+      return NULL;
+    else if (osize <= LUAL_ARENAMAXSMALL) {  /* return block to its free list */
+      ArenaFree **fl = &a->blocks[arenaclass(osize)];
+      ((ArenaFree *)ptr)->next = *fl;
+      *fl = (ArenaFree *)ptr;
+    }
+    else
+      largefree(a, ptr);
+    return NULL;
+  }
+  if (nsize > LUAL_ARENAMAXSMALL) {
+    if (osize > LUAL_ARENAMAXSMALL) {  /* large to large? */
+      nb = largenew(a, ptr, nsize);
+      return (nb == NULL && nsize <= osize) ? ptr : nb;
+    }
+    nb = largenew(a, NULL, nsize);
+  }
+  else if (ptr != NULL && arenaclass(osize) == arenaclass(nsize))
+    return ptr;  /* block already has the right size */
+  else
+    nb = arenanew(a, arenaclass(nsize));
+  if (nb == NULL) {
+    if (ptr != NULL && nsize <= osize)  /* shrinking? */
+      return ptr;  /* keep the old block */
+    if (a->mainblock == NULL)  /* could not even create the state? */
+      freearena(a);
+    return NULL;
+  }
+  if (a->mainblock == NULL)  /* first block is always the state */
+    a->mainblock = nb;
+  if (ptr != NULL) {  /* move contents to the new block */
+    memcpy(nb, ptr, (osize < nsize) ? osize : nsize);
+    arena_alloc(ud, ptr, osize, 0);
+  }
+  return nb;
+}
+
+
+/*
+** Creates a state whose memory comes from an arena. The arena goes
+** away with the state, so it is meant for short-lived states, such
+** as one state per request.
+*/
+LUALIB_API lua_State *luaL_newarenastate (void) {
+  lua_State *L;
+  Arena *a = (Arena *)malloc(sizeof(Arena));
+  if (a == NULL) return NULL;
+  memset(a, 0, sizeof(Arena));
+  /* on failure the allocator has already released the arena */
+  L = lua_newstate(arena_alloc, a);
+  if (L) {
+    lua_atpanic(L, &panic);
+    lua_gc(L, LUA_GCBULKFREE, 1);  /* the arena frees all objects */
+  }
+  return L;
+}
+
+/* }====================================================== */
+
+
+/*
+** {======================================================
+** State snapshots
+** A snapshot holds the global table and the loaded modules of a state,
+** with everything reachable from them. Restoring it merges those values
+** into another state, which must have opened the same C libraries:
+** tables, C functions and userdata reachable (through string or integer
+** keys) from the global table or from 'package.loaded' are identified
+** by names such as "string.format" or "io.stdout" and bound to the
+** objects with the same names in the new state. Lua functions travel as
+** binary chunks, together with their upvalues.
+** Objects are numbered in the order they are reached from the roots.
+** A snapshot first lists how to create each object and then gives
+** their contents, where other objects appear as ids; so neither side
+** recurses and there is no limit on nesting.
+** =======================================================
+*/
+
+#define SNAP_SIGNATURE	"\x1bLuaS"
+#define SNAP_VERSION	((LUA_VERSION_NUM / 100) * 16 + LUA_VERSION_NUM % 100)
+
+/* how many levels of tables get names */
+#define SNAP_NAMELEVEL	3
+
+/* tags of values and objects in a snapshot */
+#define SNAP_END	0	/* end of a list */
+#define SNAP_NIL	1
+#define SNAP_FALSE	2
+#define SNAP_TRUE	3
+#define SNAP_INT	4
+#define SNAP_FLT	5
+#define SNAP_STR	6
+#define SNAP_REF	7	/* object, given by its id */
+#define SNAP_TABLE	8	/* new table */
+#define SNAP_NAMEDTABLE	9	/* existing table plus its entries */
+#define SNAP_NAMED	10	/* C function or userdata given by name */
+#define SNAP_LFUNC	11	/* Lua function */
+#define SNAP_CFUNC	12	/* C function given by address */
+#define SNAP_UPREF	13	/* upvalue shared with a previous function */
+#define SNAP_LIGHTUD	14	/* light userdata */
+
+
+/*
+** Pushes the name of entry 'k' of the table named by the string at
+** 'parent'. Children of the "" table ('package.loaded') are named by
+** their keys alone. Returns 0 (pushing nothing) for keys that do not
+** give names.
+*/
+static int snap_childname (lua_State *L, int parent, int k) {
+  const char *pname = lua_tostring(L, parent);
+  if (lua_type(L, k) == LUA_TSTRING) {
+    if (*pname == '\0') lua_pushvalue(L, k);
+    else lua_pushfstring(L, "%s.%s", pname, lua_tostring(L, k));
+    return 1;
+  }
+  else if (lua_isinteger(L, k) && *pname != '\0') {
+    lua_pushfstring(L, "%s[%I]", pname, lua_tointeger(L, k));
+    return 1;
+  }
+  return 0;
+}
+
+
+/*
+** Pushes a table with the names of the objects reachable from the
+** global table and from 'package.loaded', mapping objects to their
+** first names ('byname' false) or every name to its object ('byname'
+** true). Tables are visited in breadth-first order, so each object
+** gets its shortest name.
+*/
+static void snap_names (lua_State *L, int byname) {
+  int names, visited, queue;
+  lua_Integer head = 0, tail = 0;
+  luaL_checkstack(L, 10, "too many nested names");
+  lua_newtable(L);
+  names = lua_gettop(L);
+  lua_newtable(L);  /* tables already queued */
+  visited = names + 1;
+  lua_newtable(L);  /* queue of triples (table, name, level) */
+  queue = names + 2;
+  lua_pushglobaltable(L);
+  lua_pushboolean(L, 1);
+  lua_rawset(L, visited);
+  lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+  lua_pushboolean(L, 1);
+  lua_rawset(L, visited);
+  lua_pushglobaltable(L);
+  lua_pushliteral(L, "_G");
+  lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+  lua_pushliteral(L, "");
+  while (lua_gettop(L) > queue || head < tail) {
+    int level;
+    if (lua_gettop(L) == queue) {  /* no roots left? take from the queue */
+      lua_rawgeti(L, queue, ++head);
+      lua_rawgeti(L, queue, ++head);
+      level = (int)(lua_rawgeti(L, queue, ++head), lua_tointeger(L, -1));
+      lua_pop(L, 1);
+    }
+    else level = 0;
+    /* stack: table name */
+    if (level == 0) {  /* roots are named too */
+      lua_pushvalue(L, -2 + byname);
+      lua_pushvalue(L, -2 - byname);
+      lua_rawset(L, names);
+    }
+    if (level < SNAP_NAMELEVEL) {
+      int t = lua_gettop(L) - 1;
+      lua_pushnil(L);
+      while (lua_next(L, t)) {  /* stack: table name key value */
+        int v = lua_gettop(L);
+        int tt = lua_type(L, v);
+        if ((tt == LUA_TTABLE || tt == LUA_TUSERDATA || lua_iscfunction(L, v))
+            && snap_childname(L, t + 1, v - 1)) {
+          if (byname) {
+            lua_pushvalue(L, v);
+            lua_rawset(L, names);
+          }
+          else {
+            lua_pushvalue(L, v);
+            if (lua_rawget(L, names) == LUA_TNIL) {
+              lua_pushvalue(L, v);
+              lua_pushvalue(L, -3);
+              lua_rawset(L, names);
+            }
+            lua_pop(L, 2);
+          }
+          if (tt == LUA_TTABLE) {
+            lua_pushvalue(L, v);
+            if (lua_rawget(L, visited) == LUA_TNIL) {  /* not queued yet? */
+              lua_pushvalue(L, v);
+              lua_pushboolean(L, 1);
+              lua_rawset(L, visited);
+              lua_pushvalue(L, v);
+              lua_rawseti(L, queue, ++tail);
+              snap_childname(L, t + 1, v - 1);
+              lua_rawseti(L, queue, ++tail);
+              lua_pushinteger(L, level + 1);
+              lua_rawseti(L, queue, ++tail);
+            }
+            lua_pop(L, 1);
+          }
+        }
+        lua_pop(L, 1);  /* pop value */
+      }
+    }
+    lua_pop(L, 2);  /* pop table and name */
+  }
+  lua_pop(L, 2);  /* pop 'visited' and queue */
+}
+
+
+/*
+** {------------------------------------------------------
+** Writing snapshots
+** -------------------------------------------------------
+*/
+
+typedef struct SnapW {
+  lua_State *L;
+  lua_Writer writer;
+  void *data;
+  int inprocess;  /* may write addresses? */
+  int numbering;  /* only giving ids to objects (writing nothing)? */
+  int names;  /* index of the table from objects to names */
+  int ids;  /* index of the table from objects to ids */
+  int objs;  /* index of the table from ids to objects */
+  int upvals;  /* index of the table from upvalue ids to their owners */
+  lua_Integer nextid;
+} SnapW;
+
+
+static void snap_write (SnapW *S, const void *b, size_t size) {
+  if (size > 0 && !S->numbering && S->writer(S->L, b, size, S->data) != 0)
+    luaL_error(S->L, "cannot write snapshot");
+}
+
+#define snap_writevar(S,x)	snap_write(S, &(x), sizeof(x))
+
+
+static void snap_writebyte (SnapW *S, int c) {
+  unsigned char b = (unsigned char)c;
+  snap_write(S, &b, 1);
+}
+
+
+static void snap_writestring (SnapW *S, int idx) {
+  size_t l;
+  const char *s = lua_tolstring(S->L, idx, &l);
+  snap_writevar(S, l);
+  snap_write(S, s, l);
+}
+
+
+static int hasupvalues (lua_State *L, int idx) {
+  if (lua_getupvalue(L, idx, 1) == NULL) return 0;
+  lua_pop(L, 1);
+  return 1;
+}
+
+
+/*
+** Returns the tag that describes the object at 'idx' and pushes its
+** name (or nil). Raises an error for objects that cannot be written.
+*/
+static int snap_kind (SnapW *S, int idx) {
+  lua_State *L = S->L;
+  lua_pushvalue(L, idx);
+  lua_rawget(L, S->names);
+  switch (lua_type(L, idx)) {
+    case LUA_TTABLE:
+      return lua_isnil(L, -1) ? SNAP_TABLE : SNAP_NAMEDTABLE;
+    case LUA_TFUNCTION: case LUA_TUSERDATA:
+      if (S->inprocess && lua_iscfunction(L, idx) && !hasupvalues(L, idx))
+        return SNAP_CFUNC;  /* address is enough, even with a name */
+      else if (!lua_isnil(L, -1))
+        return SNAP_NAMED;
+      else if (lua_iscfunction(L, idx)) {
+        if (!S->inprocess)
+          luaL_error(L, "cannot snapshot a C function without a name");
+        return SNAP_CFUNC;
+      }
+      else if (lua_isfunction(L, idx))
+        return SNAP_LFUNC;
+      return luaL_error(L, "cannot snapshot a userdata without a name");
+    default:
+      return luaL_error(L, "cannot snapshot a %s", luaL_typename(L, idx));
+  }
+}
+
+
+/* writes a reference to an object, giving it an id the first time */
+static void snap_object (SnapW *S, int idx) {
+  lua_State *L = S->L;
+  lua_Integer id;
+  lua_pushvalue(L, idx);
+  if (lua_rawget(L, S->ids) == LUA_TNIL) {  /* new object? */
+    snap_kind(S, idx);  /* check that it can be written */
+    lua_pop(L, 2);  /* pop name and nil */
+    id = ++S->nextid;
+    lua_pushvalue(L, idx);
+    lua_pushinteger(L, id);
+    lua_rawset(L, S->ids);
+    lua_pushvalue(L, idx);
+    lua_rawseti(L, S->objs, id);
+  }
+  else {
+    id = lua_tointeger(L, -1);
+    lua_pop(L, 1);
+  }
+  snap_writebyte(S, SNAP_REF);
+  snap_writevar(S, id);
+}
+
+
+static void snap_value (SnapW *S, int idx) {
+  lua_State *L = S->L;
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+      snap_writebyte(S, SNAP_NIL);
+      break;
+    case LUA_TBOOLEAN:
+      snap_writebyte(S, lua_toboolean(L, idx) ? SNAP_TRUE : SNAP_FALSE);
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, idx)) {
+        lua_Integer i = lua_tointeger(L, idx);
+        snap_writebyte(S, SNAP_INT);
+        snap_writevar(S, i);
+      }
+      else {
+        lua_Number n = lua_tonumber(L, idx);
+        snap_writebyte(S, SNAP_FLT);
+        snap_writevar(S, n);
+      }
+      break;
+    case LUA_TSTRING:
+      snap_writebyte(S, SNAP_STR);
+      snap_writestring(S, idx);
+      break;
+    case LUA_TLIGHTUSERDATA: {
+      void *p = lua_touserdata(L, idx);
+      if (!S->inprocess)
+        luaL_error(L, "cannot snapshot a light userdata");
+      snap_writebyte(S, SNAP_LIGHTUD);
+      snap_writevar(S, p);
+      break;
+    }
+    default:
+      snap_object(S, idx);
+  }
+}
+
+
+static int snap_dumpwriter (lua_State *L, const void *b, size_t size,
+                            void *B) {
+  (void)L;
+  luaL_addlstring((luaL_Buffer *)B, (const char *)b, size);
+  return 0;
+}
+
+
+/* writes what the reader needs to create the object at 'idx' */
+static void snap_create (SnapW *S, int idx) {
+  lua_State *L = S->L;
+  int tag = snap_kind(S, idx);
+  snap_writebyte(S, tag);
+  switch (tag) {
+    case SNAP_NAMEDTABLE: case SNAP_NAMED:
+      snap_writestring(S, -1);
+      break;
+    case SNAP_LFUNC: {
+      luaL_Buffer b;
+      lua_pushvalue(L, idx);
+      luaL_buffinit(L, &b);
+      lua_dump(L, snap_dumpwriter, &b, 0);
+      luaL_pushresult(&b);
+      snap_writestring(S, -1);
+      lua_pop(L, 2);  /* pop code and function */
+      break;
+    }
+    case SNAP_CFUNC: {
+      lua_CFunction f = lua_tocfunction(L, idx);
+      int n;
+      for (n = 0; lua_getupvalue(L, idx, n + 1) != NULL; n++)
+        lua_pop(L, 1);
+      snap_writevar(S, f);
+      snap_writebyte(S, n);  /* upvalues are filled in later */
+      break;
+    }
+  }
+  lua_pop(L, 1);  /* pop name */
+}
+
+
+static void snap_table (SnapW *S, int idx) {
+  lua_State *L = S->L;
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    int k = lua_gettop(L) - 1;
+    snap_value(S, k);
+    snap_value(S, k + 1);
+    lua_pop(L, 1);  /* pop value */
+  }
+  snap_writebyte(S, SNAP_END);
+  if (lua_getmetatable(L, idx)) {
+    snap_value(S, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+  else snap_writebyte(S, SNAP_NIL);
+}
+
+
+/* upvalues of Lua function 'id'; the first function to write one owns it */
+static void snap_lfunction (SnapW *S, int idx, lua_Integer id) {
+  lua_State *L = S->L;
+  int n;
+  for (n = 1; lua_getupvalue(L, idx, n) != NULL; n++) {
+    lua_pushlightuserdata(L, lua_upvalueid(L, idx, n));
+    if (lua_rawget(L, S->upvals) != LUA_TNIL) {  /* written before? */
+      lua_Integer owner = lua_tointeger(L, -1);
+      snap_writebyte(S, SNAP_UPREF);
+      snap_writevar(S, owner);
+    }
+    else {
+      if (!S->numbering) {
+        lua_pushlightuserdata(L, lua_upvalueid(L, idx, n));
+        lua_pushinteger(L, id * 256 + n);  /* functions have < 256 upvalues */
+        lua_rawset(L, S->upvals);
+      }
+      snap_value(S, lua_gettop(L) - 1);
+    }
+    lua_pop(L, 2);  /* pop owner and upvalue */
+  }
+  snap_writebyte(S, SNAP_END);
+}
+
+
+/*
+** Writes the contents of object 'id', at 'idx': entries and metatable
+** of tables, upvalues of functions. Other named objects keep their own.
+*/
+static void snap_contents (SnapW *S, int idx, lua_Integer id) {
+  lua_State *L = S->L;
+  int tag = snap_kind(S, idx);
+  lua_pop(L, 1);  /* pop name */
+  switch (tag) {
+    case SNAP_TABLE: case SNAP_NAMEDTABLE:
+      snap_table(S, idx);
+      break;
+    case SNAP_LFUNC:
+      snap_lfunction(S, idx, id);
+      break;
+    case SNAP_CFUNC: {
+      int n;
+      for (n = 1; lua_getupvalue(L, idx, n) != NULL; n++) {
+        snap_value(S, lua_gettop(L));
+        lua_pop(L, 1);
+      }
+      snap_writebyte(S, SNAP_END);
+      break;
+    }
+    default:
+      snap_writebyte(S, SNAP_END);
+  }
+}
+
+
+static void snap_header (SnapW *S) {
+  unsigned char h[4];
+  h[0] = (unsigned char)SNAP_VERSION;
+  h[1] = (unsigned char)sizeof(lua_Integer);
+  h[2] = (unsigned char)sizeof(lua_Number);
+  h[3] = (unsigned char)S->inprocess;
+  snap_write(S, SNAP_SIGNATURE, sizeof(SNAP_SIGNATURE) - 1);
+  snap_write(S, h, sizeof(h));
+}
+
+
+static void snapshot (lua_State *L, lua_Writer writer, void *data,
+                      int inprocess) {
+  SnapW S;
+  lua_Integer id;
+  S.L = L;
+  S.writer = writer;
+  S.data = data;
+  S.inprocess = inprocess;
+  S.numbering = 1;
+  S.nextid = 0;
+  snap_names(L, 0);
+  S.names = lua_gettop(L);
+  lua_newtable(L);
+  S.ids = S.names + 1;
+  lua_newtable(L);
+  S.objs = S.names + 2;
+  lua_newtable(L);
+  S.upvals = S.names + 3;
+  lua_pushglobaltable(L);
+  snap_value(&S, lua_gettop(L));
+  lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+  snap_value(&S, lua_gettop(L));
+  lua_pop(L, 2);
+  for (id = 1; id <= S.nextid; id++) {  /* give ids to all objects */
+    lua_rawgeti(L, S.objs, id);
+    snap_contents(&S, lua_gettop(L), id);
+    lua_pop(L, 1);
+  }
+  S.numbering = 0;
+  snap_header(&S);
+  for (id = 1; id <= S.nextid; id++) {
+    lua_rawgeti(L, S.objs, id);
+    snap_create(&S, lua_gettop(L));
+    lua_pop(L, 1);
+  }
+  snap_writebyte(&S, SNAP_END);
+  for (id = 1; id <= S.nextid; id++) {
+    lua_rawgeti(L, S.objs, id);
+    snap_contents(&S, lua_gettop(L), id);
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 4);
+}
+
+/* }------------------------------------------------------ */
+
+
+/*
+** {------------------------------------------------------
+** Reading snapshots
+** -------------------------------------------------------
+*/
+
+typedef struct SnapR {
+  lua_State *L;
+  lua_Reader reader;
+  void *data;
+  const char *p;  /* next byte in the current block */
+  size_t n;  /* bytes still unread in the current block */
+  int inprocess;  /* may read addresses? */
+  int names;  /* index of the table from names to objects */
+  int objs;  /* index of the table from ids to objects */
+  lua_Integer nextid;
+} SnapR;
+
+
+static void snap_read (SnapR *R, void *b, size_t size) {
+  char *d = (char *)b;
+  while (size > 0) {
+    size_t m;
+    if (R->n == 0) {  /* current block exhausted? */
+      R->p = R->reader(R->L, R->data, &R->n);
+      if (R->p == NULL || R->n == 0)
+        luaL_error(R->L, "truncated snapshot");
+    }
+    m = (size < R->n) ? size : R->n;
+    memcpy(d, R->p, m);
+    R->p += m; R->n -= m;
+    d += m; size -= m;
+  }
+}
+
+#define snap_readvar(R,x)	snap_read(R, &(x), sizeof(x))
+
+
+static int snap_readbyte (SnapR *R) {
+  unsigned char b;
+  snap_read(R, &b, 1);
+  return b;
+}
+
+
+static void snap_readstring (SnapR *R) {
+  luaL_Buffer b;
+  size_t l;
+  snap_readvar(R, l);
+  snap_read(R, luaL_buffinitsize(R->L, &b, l), l);
+  luaL_pushresultsize(&b, l);
+}
+
+
+static void snap_readvalue (SnapR *R, int tag) {
+  lua_State *L = R->L;
+  switch (tag) {
+    case SNAP_NIL: lua_pushnil(L); break;
+    case SNAP_FALSE: lua_pushboolean(L, 0); break;
+    case SNAP_TRUE: lua_pushboolean(L, 1); break;
+    case SNAP_INT: {
+      lua_Integer i;
+      snap_readvar(R, i);
+      lua_pushinteger(L, i);
+      break;
+    }
+    case SNAP_FLT: {
+      lua_Number n;
+      snap_readvar(R, n);
+      lua_pushnumber(L, n);
+      break;
+    }
+    case SNAP_STR: snap_readstring(R); break;
+    case SNAP_REF: {
+      lua_Integer id;
+      snap_readvar(R, id);
+      if (id <= 0 || id > R->nextid)
+        luaL_error(L, "bad snapshot (bad reference)");
+      lua_rawgeti(L, R->objs, id);
+      break;
+    }
+    case SNAP_LIGHTUD: {
+      void *p;
+      if (!R->inprocess)
+        luaL_error(R->L, "bad snapshot (unexpected address)");
+      snap_readvar(R, p);
+      lua_pushlightuserdata(L, p);
+      break;
+    }
+    default:
+      luaL_error(L, "bad snapshot (unknown tag %d)", tag);
+  }
+}
+
+
+static void snap_readnamed (SnapR *R) {
+  lua_State *L = R->L;
+  snap_readstring(R);
+  lua_pushvalue(L, -1);
+  if (lua_rawget(L, R->names) == LUA_TNIL)
+    luaL_error(L, "'%s' not found", lua_tostring(L, -2));
+  lua_remove(L, -2);  /* remove name */
+}
+
+
+/* creates an object, still empty, and gives it the next id */
+static void snap_readobject (SnapR *R, int tag) {
+  lua_State *L = R->L;
+  switch (tag) {
+    case SNAP_TABLE: lua_newtable(L); break;
+    case SNAP_NAMEDTABLE: {
+      snap_readstring(R);
+      lua_pushvalue(L, -1);
+      if (lua_rawget(L, R->names) != LUA_TTABLE) {  /* no such table? */
+        lua_pop(L, 1);
+        lua_newtable(L);  /* create it */
+      }
+      lua_remove(L, -2);  /* remove name */
+      break;
+    }
+    case SNAP_NAMED: snap_readnamed(R); break;
+    case SNAP_LFUNC: {
+      size_t l;
+      const char *code;
+      snap_readstring(R);
+      code = lua_tolstring(L, -1, &l);
+      if (luaL_loadbufferx(L, code, l, "=(snapshot)", "b") != LUA_OK)
+        lua_error(L);
+      lua_remove(L, -2);  /* remove code */
+      break;
+    }
+    case SNAP_CFUNC: {
+      lua_CFunction f;
+      int n, i;
+      if (!R->inprocess)
+        luaL_error(L, "bad snapshot (unexpected address)");
+      snap_readvar(R, f);
+      n = snap_readbyte(R);
+      luaL_checkstack(L, n, "too many upvalues");
+      for (i = 0; i < n; i++)
+        lua_pushnil(L);  /* upvalues come with the contents */
+      lua_pushcclosure(L, f, n);
+      break;
+    }
+    default:
+      luaL_error(L, "bad snapshot (unknown tag %d)", tag);
+  }
+  lua_rawseti(L, R->objs, ++R->nextid);
+}
+
+
+static void snap_readentries (SnapR *R) {
+  lua_State *L = R->L;
+  int t = lua_gettop(L);
+  int tag;
+  while ((tag = snap_readbyte(R)) != SNAP_END) {
+    snap_readvalue(R, tag);
+    if (lua_isnil(L, -1)) luaL_error(L, "bad snapshot (nil key)");
+    snap_readvalue(R, snap_readbyte(R));
+    lua_rawset(L, t);
+  }
+}
+
+
+/* tables that already have a metatable keep it */
+static void snap_readmetatable (SnapR *R) {
+  lua_State *L = R->L;
+  snap_readvalue(R, snap_readbyte(R));
+  if (lua_istable(L, -1) && !lua_getmetatable(L, -2))
+    lua_setmetatable(L, -2);
+  else
+    lua_pop(L, lua_istable(L, -1) ? 2 : 1);
+}
+
+
+static int islfunction (lua_State *L, int idx) {
+  return lua_isfunction(L, idx) && !lua_iscfunction(L, idx);
+}
+
+
+static void snap_readupvalues (SnapR *R) {
+  lua_State *L = R->L;
+  int f = lua_gettop(L);
+  int n, tag;
+  for (n = 1; (tag = snap_readbyte(R)) != SNAP_END; n++) {
+    if (tag == SNAP_UPREF) {
+      lua_Integer owner;
+      snap_readvar(R, owner);
+      lua_rawgeti(L, R->objs, owner / 256);
+      if (!islfunction(L, f) || !islfunction(L, -1))
+        luaL_error(L, "bad snapshot (bad upvalue)");
+      lua_upvaluejoin(L, f, n, -1, (int)(owner % 256));
+      lua_pop(L, 1);
+    }
+    else {
+      snap_readvalue(R, tag);
+      if (lua_setupvalue(L, f, n) == NULL)
+        luaL_error(L, "bad snapshot (bad upvalue)");
+    }
+  }
+}
+
+
+/* fills the object on the top of the stack */
+static void snap_readcontents (SnapR *R) {
+  if (lua_istable(R->L, -1)) {
+    snap_readentries(R);
+    snap_readmetatable(R);
+  }
+  else snap_readupvalues(R);
+}
+
+
+static void snap_checkheader (SnapR *R, int allowaddr) {
+  char s[sizeof(SNAP_SIGNATURE) - 1];
+  unsigned char h[4];
+  snap_read(R, s, sizeof(s));
+  if (memcmp(s, SNAP_SIGNATURE, sizeof(s)) != 0)
+    luaL_error(R->L, "not a snapshot");
+  snap_read(R, h, sizeof(h));
+  if (h[0] != SNAP_VERSION || h[1] != sizeof(lua_Integer) ||
+      h[2] != sizeof(lua_Number))
+    luaL_error(R->L, "snapshot made by an incompatible Lua");
+  R->inprocess = h[3];
+  if (R->inprocess && !allowaddr)
+    luaL_error(R->L, "snapshot valid only inside its own process");
+}
+
+
+typedef struct SnapArgs {
+  lua_Reader reader;
+  lua_Writer writer;
+  void *data;
+  int inprocess;
+} SnapArgs;
+
+
+static int restoreaux (lua_State *L) {
+  SnapArgs *a = (SnapArgs *)lua_touserdata(L, 1);
+  SnapR R;
+  lua_Integer id;
+  int tag;
+  R.L = L;
+  R.reader = a->reader;
+  R.data = a->data;
+  R.n = 0;
+  R.nextid = 0;
+  snap_names(L, 1);
+  R.names = lua_gettop(L);
+  lua_newtable(L);
+  R.objs = R.names + 1;
+  snap_checkheader(&R, a->inprocess);
+  while ((tag = snap_readbyte(&R)) != SNAP_END)
+    snap_readobject(&R, tag);
+  for (id = 1; id <= R.nextid; id++) {
+    lua_rawgeti(L, R.objs, id);
+    snap_readcontents(&R);
+    lua_pop(L, 1);
+  }
+  return 0;
+}
+
+static int snapshotaux (lua_State *L) {
+  SnapArgs *a = (SnapArgs *)lua_touserdata(L, 1);
+  snapshot(L, a->writer, a->data, a->inprocess);
+  return 0;
+}
+
+/* }------------------------------------------------------ */
+
+
+/*
+** Writes a snapshot of the global table and of the loaded modules of
+** 'L'. Returns a status code like 'lua_pcall'; on errors (such as values
+** that cannot leave the state, like coroutines or C functions and
+** userdata without names), pushes an error message.
+*/
+LUALIB_API int luaL_snapshot (lua_State *L, lua_Writer writer, void *data) {
+  SnapArgs a;
+  a.writer = writer;
+  a.data = data;
+  a.inprocess = 0;
+  lua_pushcfunction(L, snapshotaux);
+  lua_pushlightuserdata(L, &a);
+  return lua_pcall(L, 1, 0, 0);
+}
+
+
+/*
+** Merges a snapshot into the global table and the loaded modules of
+** 'L'. Returns a status code like 'lua_load'; on errors, pushes an
+** error message.
+*/
+LUALIB_API int luaL_restore (lua_State *L, lua_Reader reader, void *data) {
+  SnapArgs a;
+  a.reader = reader;
+  a.data = data;
+  a.inprocess = 0;
+  lua_pushcfunction(L, restoreaux);
+  lua_pushlightuserdata(L, &a);
+  return lua_pcall(L, 1, 0, 0);
+}
+
+
+typedef struct SnapBuffer {
+  char *b;
+  size_t n;
+  size_t size;
+} SnapBuffer;
+
+
+static int snap_bufwriter (lua_State *L, const void *p, size_t sz,
+                           void *ud) {
+  SnapBuffer *B = (SnapBuffer *)ud;
+  (void)L;
+  if (sz > B->size - B->n) {  /* buffer too small? */
+    size_t newsize = B->size * 2;
+    char *newb;
+    if (newsize - B->n < sz) newsize = B->n + sz;
+    if (newsize < LUAL_BUFFERSIZE) newsize = LUAL_BUFFERSIZE;
+    newb = (char *)realloc(B->b, newsize);
+    if (newb == NULL) return 1;
+    B->b = newb;
+    B->size = newsize;
+  }
+  memcpy(B->b + B->n, p, sz);
+  B->n += sz;
+  return 0;
+}
+
+
+/*
+** Copies the global table and the loaded modules of 'from' into 'L',
+** which must have opened the same libraries, so that a fresh state
+** starts as a clone of a warmed-up template instead of loading and
+** running all its scripts again. Both states must live in the same
+** process; C functions without upvalues are copied by address. Returns
+** a status code and, on errors, pushes a message onto 'L'.
+*/
+LUALIB_API int luaL_clonestate (lua_State *L, lua_State *from) {
+  SnapBuffer B;
+  SnapArgs a;
+  int status;
+  B.b = NULL; B.n = B.size = 0;
+  a.writer = snap_bufwriter;
+  a.data = &B;
+  a.inprocess = 1;
+  lua_pushcfunction(from, snapshotaux);
+  lua_pushlightuserdata(from, &a);
+  status = lua_pcall(from, 1, 0, 0);
+  if (status != LUA_OK) {  /* move error message to 'L' */
+    lua_pushstring(L, lua_tostring(from, -1));
+    lua_pop(from, 1);
+  }
+  else {
+    LoadS ls;
+    ls.s = B.b;
+    ls.size = B.n;
+    a.reader = getS;
+    a.data = &ls;
+    lua_pushcfunction(L, restoreaux);
+    lua_pushlightuserdata(L, &a);
+    status = lua_pcall(L, 1, 0, 0);
+  }
+  free(B.b);
+  return status;
+}
+
+/* }====================================================== */
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
   const lua_Number *v = lua_version(L);
   if (sz != LUAL_NUMSIZES)  /* check numeric types */
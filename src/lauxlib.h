@@ -82,6 +82,11 @@ LUALIB_API int (luaL_loadbufferx) (lua_State *L, const char *buff, size_t sz,
 LUALIB_API int (luaL_loadstring) (lua_State *L, const char *s);
 
 LUALIB_API lua_State *(luaL_newstate) (void);
+LUALIB_API lua_State *(luaL_newarenastate) (void);
+
+LUALIB_API int (luaL_snapshot) (lua_State *L, lua_Writer writer, void *data);
+LUALIB_API int (luaL_restore) (lua_State *L, lua_Reader reader, void *data);
+LUALIB_API int (luaL_clonestate) (lua_State *L, lua_State *from);
 
 LUALIB_API lua_Integer (luaL_len) (lua_State *L, int idx);
 
@@ -98,6 +103,8 @@ LUALIB_API void (luaL_traceback) (lua_State *L, lua_State *L1,
 LUALIB_API void (luaL_requiref) (lua_State *L, const char *modname,
                                  lua_CFunction openf, int glb);
 
+LUALIB_API void (luaL_freezeglobals) (lua_State *L);
+
 /*
 ** ===============================================================
 ** some useful macros
@@ -190,6 +197,29 @@ typedef struct luaL_Stream {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Module archives ('package.apath'; written by 'luac -a')
+** An archive starts with a header (signature, version, and number of
+** modules) followed by an index with one entry per module, sorted by
+** module name: offset and size of the name, offset and size of the
+** contents, and compression method. All numbers are 4-byte
+** little-endian integers; all offsets count from the start of the
+** archive.
+** =======================================================
+*/
+
+#define LUA_ARSIGNATURE		"\x1bLAr"
+#define LUA_ARVERSION		1
+#define LUA_ARHEADERSIZE	12
+#define LUA_ARENTRYSIZE		20
+
+/* compression methods */
+#define LUA_ARSTORED		0	/* not compressed */
+
+/* }====================================================== */
+
+
 
 /* compatibility with old module system */
 #if defined(LUA_COMPAT_MODULE)
@@ -173,10 +173,10 @@ static int luaB_rawset (lua_State *L) {
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "isrunning", NULL};
+    "isrunning", "finalize", "setfinmax", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCISRUNNING};
+    LUA_GCISRUNNING, LUA_GCFINALIZE, LUA_GCSETFINMAX};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
   int ex = (int)luaL_optinteger(L, 2, 0);
   int res = lua_gc(L, o, ex);
@@ -486,9 +486,10 @@ static const luaL_Reg base_funcs[] = {
 // for _G
 LUAMOD_API int luaopen_base (lua_State *L) {
   /* open lib into global table */
-  // ȫֱջΪҪѿŵȫֱ
+  // 将全局表入栈，因为要把库放到全局表里面
   lua_pushglobaltable(L);
   luaL_setfuncs(L, base_funcs, 0);
+  luaE_setnextf(L, luaB_next);  /* let the VM run 'pairs' loops inline */
   /* set global _G */
   // lua stack
   //  top
@@ -498,7 +499,7 @@ LUAMOD_API int luaopen_base (lua_State *L) {
   // lua stack
   //  top
   //  table _G
-  lua_setfield(L, -2, "_G"); // setfield   stack[idx][_G] = stack_top, ջ
+  lua_setfield(L, -2, "_G"); // setfield   stack[idx][_G] = stack_top, 弹出栈顶
   /* set global _VERSION */
   // lua stack
   //  top
@@ -18,6 +18,7 @@
 #include "lcode.h"
 #include "ldebug.h"
 #include "ldo.h"
+#include "lfunc.h"
 #include "lgc.h"
 #include "llex.h"
 #include "lmem.h"
@@ -51,6 +52,22 @@ static int tonumeral(expdesc *e, TValue *v) {
 }
 
 
+/*
+** If expression is a constant (without jumps), store its value in 'v'
+*/
+static int tokonst (FuncState *fs, expdesc *e, TValue *v) {
+  if (hasjumps(e))
+    return 0;
+  switch (e->k) {
+    case VNIL: setnilvalue(v); return 1;
+    case VTRUE: setbvalue(v, 1); return 1;
+    case VFALSE: setbvalue(v, 0); return 1;
+    case VK: setobj(fs->ls->L, v, &fs->f->k[e->u.info]); return 1;
+    default: return tonumeral(e, v);
+  }
+}
+
+
 void luaK_nil (FuncState *fs, int from, int n) {
   Instruction *previous;
   int l = from + n - 1;  /* last register to set nil */
@@ -225,12 +242,12 @@ void luaK_concat (FuncState *fs, int *l1, int l2) {
   }
 }
 
-// ֽ
+// 生成字节码
 static int luaK_code (FuncState *fs, Instruction i) {
   Proto *f = fs->f;
   dischargejpc(fs);  /* 'pc' will change */
   /* put new instruction in code array */
-  //  code
+  // 加入 code
   luaM_growvector(fs->ls->L, f->code, fs->pc, f->sizecode, Instruction,
                   MAX_INT, "opcodes");
   f->code[fs->pc] = i;
@@ -444,6 +461,37 @@ static int code_label (FuncState *fs, int A, int b, int jump) {
 }
 
 
+/*
+** Whether a local variable becomes active at the current position
+*/
+static int newlocalhere (FuncState *fs) {
+  if (fs->nactvar == 0)
+    return 0;
+  else {
+    int idx = fs->ls->dyd->actvar.arr[fs->firstlocal + fs->nactvar - 1].idx;
+    return (fs->f->locvars[idx].startpc == fs->pc);
+  }
+}
+
+
+/*
+** Code 'R(to) := R(from)', fused with a previous move into 'to - 1' in
+** the same line (when no jump reaches the current position, and no
+** local starts there: the debug information would not see it written)
+*/
+static void codemove (FuncState *fs, int to, int from) {
+  if (fs->pc > fs->lasttarget && fs->pc > 0 &&
+      fs->f->lineinfo[fs->pc - 1] == fs->ls->lastline && !newlocalhere(fs)) {
+    Instruction *previous = &fs->f->code[fs->pc - 1];
+    if (GET_OPCODE(*previous) == OP_MOVE && GETARG_A(*previous) == to - 1) {
+      *previous = CREATE_ABC(OP_MOVE2, to - 1, GETARG_B(*previous), from);
+      return;
+    }
+  }
+  luaK_codeABC(fs, OP_MOVE, to, from, 0);
+}
+
+
 static void discharge2reg (FuncState *fs, expdesc *e, int reg) {
   luaK_dischargevars(fs, e);
   switch (e->k) {
@@ -474,7 +522,7 @@ static void discharge2reg (FuncState *fs, expdesc *e, int reg) {
     }
     case VNONRELOC: {
       if (reg != e->u.info)
-        luaK_codeABC(fs, OP_MOVE, reg, e->u.info, 0);
+        codemove(fs, reg, e->u.info);
       break;
     }
     default: {
@@ -487,7 +535,7 @@ static void discharge2reg (FuncState *fs, expdesc *e, int reg) {
 }
 
 
-// ʽ eŽ reg
+// 将表达式 e，放进 reg
 static void discharge2anyreg (FuncState *fs, expdesc *e) {
   if (e->k != VNONRELOC) {
     luaK_reserveregs(fs, 1);
@@ -668,6 +716,10 @@ void luaK_goiftrue (FuncState *fs, expdesc *e) {
       pc = NO_JUMP;  /* always true; do nothing */
       break;
     }
+    case VFALSE: {
+      pc = luaK_jump(fs);  /* always jump */
+      break;
+    }
     default: {
       pc = jumponcond(fs, e, 0);
       break;
@@ -691,6 +743,10 @@ void luaK_goiffalse (FuncState *fs, expdesc *e) {
       pc = NO_JUMP;  /* always false; do nothing */
       break;
     }
+    case VTRUE: {
+      pc = luaK_jump(fs);  /* always jump */
+      break;
+    }
     default: {
       pc = jumponcond(fs, e, 1);
       break;
@@ -702,13 +758,13 @@ void luaK_goiffalse (FuncState *fs, expdesc *e) {
 }
 
 
-// ִ not 
+// 执行 not 运算
 static void codenot (FuncState *fs, expdesc *e) {
   luaK_dischargevars(fs, e);
   switch (e->k) {
 	// not nil, not false ==> true
-	//  e  VNIL VFALSE VK VFLT VKINT VTRUE
-	// Щֱӽת
+	// 若 e 是 VNIL VFALSE VK VFLT VKINT VTRUE
+	// 这些量，则直接进行转换
     case VNIL: case VFALSE: {
       e->k = VTRUE;
       break;
@@ -717,17 +773,17 @@ static void codenot (FuncState *fs, expdesc *e) {
       e->k = VFALSE;
       break;
     }
-    // ת
+    // 跳转
     case VJMP: {
       invertjump(fs, e);
       break;
     }
-	// Ҫֽ
+	// 变量，需要生成字节码
     case VRELOCABLE:
     case VNONRELOC: {
       discharge2anyreg(fs, e);
       freeexp(fs, e);
-	  // info ָȡʽ ֽĵַ
+	  // info 指向获取这个表达式 字节码的地址
       e->u.info = luaK_codeABC(fs, OP_NOT, 0, e->u.info, 0);
       e->k = VRELOCABLE;
       break;
@@ -759,13 +815,13 @@ void luaK_indexed (FuncState *fs, expdesc *t, expdesc *k) {
 */
 static int validop (int op, TValue *v1, TValue *v2) {
   switch (op) {
-	// and or ^ << >> ~  expr תΪ int
+	// and or ^ << >> ~ ， 左右expr 都必须可以转换为 int
     case LUA_OPBAND: case LUA_OPBOR: case LUA_OPBXOR:
     case LUA_OPSHL: case LUA_OPSHR: case LUA_OPBNOT: {  /* conversion errors */
       lua_Integer i;
       return (tointeger(v1, &i) && tointeger(v2, &i));
     }
-	// 0 ܵ
+	// 0 不能当除数
     case LUA_OPDIV: case LUA_OPIDIV: case LUA_OPMOD:  /* division by 0 */
       return (nvalue(v2) != 0);
     default: return 1;  /* everything else is valid */
@@ -778,13 +834,13 @@ static int validop (int op, TValue *v1, TValue *v2) {
 */
 static int constfolding (FuncState *fs, int op, expdesc *e1, expdesc *e2) {
   TValue v1, v2, res;
-  // 1.߲תΪ int or float
-  // 2.һЩ߱תΪ int0
+  // 1.两边参数都必须可以转换为 int or float
+  // 2.针对一些操作符，两边必须可以转换为 int，且0不能作除数
   if (!tonumeral(e1, &v1) || !tonumeral(e2, &v2) || !validop(op, &v1, &v2))
     return 0;  /* non-numeric operands or not safe to fold */
-  // ִ op
+  // 执行 op
   luaO_arith(fs->ls->L, op, &v1, &v2, &res);  /* does operation */
-  // ±ʽ
+  // 更新表达式类型
   if (ttisinteger(&res)) {
     e1->k = VKINT;
     e1->u.ival = ivalue(&res);
@@ -810,9 +866,9 @@ static int constfolding (FuncState *fs, int op, expdesc *e1, expdesc *e2) {
 static void codeexpval (FuncState *fs, OpCode op,
                         expdesc *e1, expdesc *e2, int line) {
   lua_assert(op >= OP_ADD);
-  // Ŀ
+  // 单目运算符
   if (op <= OP_BNOT && constfolding(fs, (op - OP_ADD) + LUA_OPADD, e1, e2))
-    return;  /* result has been folded */ // Ҫ
+    return;  /* result has been folded */ // 结果并不重要
   else {
 	// other ops
     int o1, o2;
@@ -840,10 +896,39 @@ static void codeexpval (FuncState *fs, OpCode op,
 }
 
 
+/*
+** Try to fold a comparison between constants; return 1 iff successful.
+** Order is folded only for numbers, as the order of strings depends
+** on the locale when the code runs.
+*/
+static int compfolding (FuncState *fs, OpCode op, int cond, expdesc *e1,
+                                                            expdesc *e2) {
+  TValue v1, v2;
+  int res;
+  if (!tokonst(fs, e1, &v1) || !tokonst(fs, e2, &v2))
+    return 0;
+  if (op == OP_EQ)
+    res = (luaV_rawequalobj(&v1, &v2) == cond);
+  else if (ttisnumber(&v1) && ttisnumber(&v2)) {
+    const TValue *l = cond ? &v1 : &v2;  /* 'a > b' is 'b < a' */
+    const TValue *r = cond ? &v2 : &v1;
+    res = (op == OP_LT) ? luaV_lessthan(fs->ls->L, l, r)
+                        : luaV_lessequal(fs->ls->L, l, r);
+  }
+  else
+    return 0;  /* may raise an error or call a metamethod */
+  e1->k = res ? VTRUE : VFALSE;
+  return 1;
+}
+
+
 static void codecomp (FuncState *fs, OpCode op, int cond, expdesc *e1,
                                                           expdesc *e2) {
-  int o1 = luaK_exp2RK(fs, e1);
-  int o2 = luaK_exp2RK(fs, e2);
+  int o1, o2;
+  if (compfolding(fs, op, cond, e1, e2))
+    return;
+  o1 = luaK_exp2RK(fs, e1);
+  o2 = luaK_exp2RK(fs, e2);
   freeexp(fs, e2);
   freeexp(fs, e1);
   if (cond == 0 && op != OP_EQ) {
@@ -856,6 +941,37 @@ static void codecomp (FuncState *fs, OpCode op, int cond, expdesc *e1,
 }
 
 
+/*
+** Try to fold the concatenation of two literal strings: 'e1' was just
+** loaded into a register by the last instruction (a 'LOADK' that no
+** jump reaches), which is removed. Return 1 iff successful.
+*/
+static int concatfolding (FuncState *fs, expdesc *e1, expdesc *e2) {
+  lua_State *L = fs->ls->L;
+  Instruction *previous;
+  TValue v2;
+  if (fs->pc <= fs->lasttarget || e1->k != VNONRELOC ||
+      !tokonst(fs, e2, &v2) || !ttisstring(&v2))
+    return 0;
+  previous = &fs->f->code[fs->pc - 1];
+  if (GET_OPCODE(*previous) != OP_LOADK ||
+      GETARG_A(*previous) != e1->u.info ||
+      !ttisstring(&fs->f->k[GETARG_Bx(*previous)]))
+    return 0;
+  luaD_checkstack(L, 2);
+  setobj2s(L, L->top, &fs->f->k[GETARG_Bx(*previous)]);
+  setobj2s(L, L->top + 1, &v2);
+  L->top += 2;
+  luaV_concat(L, 2);
+  fs->pc--;  /* remove load of first operand */
+  freeexp(fs, e1);
+  e1->u.info = luaK_stringK(fs, tsvalue(L->top - 1));
+  e1->k = VK;
+  L->top--;
+  return 1;
+}
+
+
 void luaK_prefix (FuncState *fs, UnOpr op, expdesc *e, int line) {
   expdesc e2;
   e2.t = e2.f = NO_JUMP; e2.k = VKINT; e2.u.ival = 0;
@@ -926,6 +1042,8 @@ void luaK_posfix (FuncState *fs, BinOpr op,
         SETARG_B(getcode(fs, e2), e1->u.info);
         e1->k = VRELOCABLE; e1->u.info = e2->u.info;
       }
+      else if (concatfolding(fs, e1, e2))
+        break;  /* result has been folded */
       else {
         luaK_exp2nextreg(fs, e2);  /* operand must be on the 'stack' */
         codeexpval(fs, OP_CONCAT, e1, e2, line);
@@ -972,3 +1090,1343 @@ void luaK_setlist (FuncState *fs, int base, int nelems, int tostore) {
   fs->freereg = base + 1;  /* free registers with list values */
 }
 
+
+
+/*
+** {======================================================
+** Peephole optimizer (for chunks loaded with mode 'O' or 'I')
+** Runs over the functions of a chunk once it is complete, from the
+** main function inwards. With mode 'I', each function first gets the
+** code of the small local functions it calls that cannot call anything
+** nor raise errors (see 'inlinecalls'); the inlined calls do not run
+** call hooks. Then it replaces reads of local
+** variables and upvalues that keep a constant through all their scope
+** by that constant, folding the operations and tests that become
+** constant and using the integer loop instructions for numeric loops
+** that get an integer initial value and step. Then it threads jumps to
+** jumps, turns jumps to returns into returns, folds a 'not' used only
+** by a test into the test, and removes unreachable code, jumps to the
+** next instruction, moves that undo the previous move, loads of a
+** constant or nil into a register that already has it, and loads of a
+** constant into a temporary used right away as an operand. Line
+** information and local-variable ranges follow the code. At last, it
+** lets local functions that are only called be reused by later runs of
+** their 'CLOSURE' (unless the debug API handed them out). It assumes
+** that hooks do not change local variables or upvalues.
+** =======================================================
+*/
+
+/* marks for each instruction */
+#define OTARGET		1	/* some instruction jumps or skips to it */
+#define OSLOT		2	/* must stay right after the previous one */
+#define ODEAD		4	/* will be removed */
+#define OREACHED	8	/* execution may reach it */
+#define OKEPT		16	/* kept because it is the slot of a reached one */
+
+/* maximum number of jumps followed by 'finaltarget' */
+#define MAXTHREAD	100
+
+#define isclosure(op)	((op) == OP_CLOSURE || (op) == OP_LCLOSURE)
+
+#define UNKNOWN		(-1)	/* unknown contents of a register */
+#define KNIL		(-2)	/* register known to be nil */
+
+
+/* maximum size of the functions inlined with mode 'I' */
+#if !defined(LUAI_MAXINLINE)
+#define LUAI_MAXINLINE	16
+#endif
+
+/* where the code calling an inlined function finds one of its upvalues */
+#define ACCUPVAL(u)	(-1 - (u))	/* in upvalue 'u' (else in a register) */
+#define NOACCESS	ACCUPVAL(MAXUPVAL + 1)	/* cannot find it */
+
+
+/* constant known for an upvalue */
+typedef struct KValue {
+  TValue v;
+  int known;  /* whether 'v' is meaningful */
+  Proto *fn;  /* if not NULL, the upvalue keeps a closure of 'fn'... */
+  int *fnup;  /* ...whose upvalues are there (see 'ACCUPVAL') */
+} KValue;
+
+
+/*
+** Destination of an instruction that jumps to its 'sBx' offset, or -1
+*/
+static int jumpdest (Instruction i, int pc) {
+  switch (GET_OPCODE(i)) {
+    case OP_JMP: case OP_FORLOOP: case OP_FORPREP: case OP_TFORLOOP:
+    case OP_FORLOOPI: case OP_FORPREPI:
+      return pc + 1 + GETARG_sBx(i);
+    default: return -1;
+  }
+}
+
+
+/*
+** Whether the instruction after 'i' must stay right after it: the jump
+** of a test, the instruction skipped by a 'LOADBOOL', the loop after a
+** 'TFORCALL', or an extra argument.
+*/
+static int haveslot (Instruction i) {
+  OpCode op = GET_OPCODE(i);
+  return testTMode(op) || op == OP_LOADKX || op == OP_TFORCALL ||
+         (op == OP_LOADBOOL && GETARG_C(i)) ||
+         (op == OP_SETLIST && GETARG_C(i) == 0);
+}
+
+
+/*
+** Fill 'succ' with the instructions that may run after the one at 'pc'
+** and return how many they are
+*/
+static int successors (Instruction *code, int pc, int *succ) {
+  Instruction i = code[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_JMP: case OP_FORPREP: case OP_FORPREPI:
+      succ[0] = pc + 1 + GETARG_sBx(i);
+      return 1;
+    case OP_FORLOOP: case OP_FORLOOPI: case OP_TFORLOOP:
+      succ[0] = pc + 1;
+      succ[1] = pc + 1 + GETARG_sBx(i);
+      return 2;
+    case OP_RETURN:
+      return 0;
+    case OP_LOADBOOL:
+      succ[0] = pc + (GETARG_C(i) ? 2 : 1);
+      return 1;
+    case OP_LOADKX:
+      succ[0] = pc + 2;
+      return 1;
+    case OP_SETLIST:
+      succ[0] = pc + (GETARG_C(i) == 0 ? 2 : 1);
+      return 1;
+    default:
+      succ[0] = pc + 1;
+      if (testTMode(GET_OPCODE(i))) {
+        succ[1] = pc + 2;
+        return 2;
+      }
+      return 1;
+  }
+}
+
+
+/*
+** Final destination of the jump at 'pc', following jumps that do not
+** close upvalues
+*/
+static int finaltarget (Instruction *code, int pc) {
+  int dest = pc + 1 + GETARG_sBx(code[pc]);
+  int count;
+  for (count = 0; count < MAXTHREAD; count++) {
+    Instruction i = code[dest];
+    int next = dest + 1 + GETARG_sBx(i);
+    if (GET_OPCODE(i) != OP_JMP || GETARG_A(i) != 0 || next == dest)
+      break;
+    dest = next;
+  }
+  return dest;
+}
+
+
+/*
+** Number of local variables active at 'pc' (which are the registers
+** below that number)
+*/
+static int nactive (Proto *f, int pc) {
+  int n = 0;
+  int i;
+  for (i = 0; i < f->sizelocvars; i++) {
+    if (f->locvars[i].startpc <= pc && pc < f->locvars[i].endpc)
+      n++;
+  }
+  return n;
+}
+
+
+/*
+** Register of the local variable 'v' (the number of variables before it
+** still active where it starts)
+*/
+static int varreg (Proto *f, int v) {
+  int start = f->locvars[v].startpc;
+  int n = 0;
+  int i;
+  for (i = 0; i < v; i++) {
+    if (f->locvars[i].startpc <= start && start < f->locvars[i].endpc)
+      n++;
+  }
+  return n;
+}
+
+
+/*
+** Index in 'f->k' of constant 'v', which is added to it if needed; -1
+** if there is no room for it
+*/
+static int protoK (lua_State *L, Proto *f, const TValue *v) {
+  int k;
+  for (k = 0; k < f->sizek; k++) {
+    if (ttype(&f->k[k]) == ttype(v) && luaV_rawequalobj(&f->k[k], v))
+      return k;
+  }
+  if (k > MAXARG_Bx)
+    return -1;
+  luaM_reallocvector(L, f->k, f->sizek, k + 1, TValue);
+  f->sizek = k + 1;
+  setobj(L, &f->k[k], v);
+  luaC_barrier(L, f, v);
+  return k;
+}
+
+
+static void marktargets (Proto *f, int *marks) {
+  Instruction *code = f->code;
+  int n = f->sizecode;
+  int pc;
+  for (pc = 0; pc < n; pc++) {
+    int d = jumpdest(code[pc], pc);
+    if (d >= 0) marks[d] |= OTARGET;
+    if ((testTMode(GET_OPCODE(code[pc])) ||
+        (GET_OPCODE(code[pc]) == OP_LOADBOOL && GETARG_C(code[pc]))) &&
+        pc + 2 <= n)
+      marks[pc + 2] |= OTARGET;  /* skipped to */
+  }
+}
+
+
+/*
+** Replace the test at 'pc' by a jump: to the jump that follows it
+** ('jumps' true) or over that jump
+*/
+static void fixtest (Instruction *code, int *marks, int pc, int jumps) {
+  code[pc] = CREATE_ABx(OP_JMP, 0, (jumps ? 0 : 1) + MAXARG_sBx);
+  marks[pc + 1] &= ~OSLOT;  /* the next one is no longer tied to it */
+}
+
+
+/*
+** Fold the instruction at 'pc' if all its operands are constants
+*/
+static void foldconst (lua_State *L, Proto *f, int *marks, int pc) {
+  Instruction *code = f->code;
+  Instruction i = code[pc];
+  OpCode op = GET_OPCODE(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  const TValue *v1, *v2;
+  TValue res;
+  if (!ISK(b) || !ISK(c))
+    return;
+  v1 = &f->k[INDEXK(b)];
+  v2 = &f->k[INDEXK(c)];
+  if (OP_ADD <= op && op <= OP_SHR) {
+    int aop = (op - OP_ADD) + LUA_OPADD;
+    int k;
+    if (!ttisnumber(v1) || !ttisnumber(v2) ||
+        !validop(aop, cast(TValue *, v1), cast(TValue *, v2)))
+      return;
+    luaO_arith(L, aop, v1, v2, &res);
+    if (ttisfloat(&res) &&  /* as in 'constfolding' */
+        (luai_numisnan(fltvalue(&res)) || fltvalue(&res) == 0))
+      return;
+    k = protoK(L, f, &res);
+    if (k >= 0)
+      code[pc] = CREATE_ABx(OP_LOADK, GETARG_A(i), k);
+  }
+  else if (op == OP_EQ)
+    fixtest(code, marks, pc, luaV_rawequalobj(v1, v2) == GETARG_A(i));
+  else if ((op == OP_LT || op == OP_LE) &&
+           ttisnumber(v1) && ttisnumber(v2)) {
+    int r = (op == OP_LT) ? luaV_lessthan(L, v1, v2)
+                          : luaV_lessequal(L, v1, v2);
+    fixtest(code, marks, pc, r == GETARG_A(i));
+  }
+}
+
+
+/*
+** Whether instruction 'i' may change register 'r'
+*/
+static int changesreg (Instruction i, int r) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i);
+  switch (op) {
+    case OP_LOADNIL: return (a <= r && r <= a + GETARG_B(i));
+    case OP_CALL: case OP_TAILCALL: case OP_VARARG: return (r >= a);
+    case OP_TFORCALL: return (r >= a + 3);
+    case OP_MOVE2: case OP_SELF: return (r == a || r == a + 1);
+    case OP_FORLOOP: case OP_FORLOOPI: return (r == a || r == a + 3);
+    case OP_FORPREP: case OP_FORPREPI: return (a <= r && r <= a + 2);
+    case OP_CONCAT:  /* also works over its operands */
+      return (r == a || (GETARG_B(i) <= r && r <= GETARG_C(i)));
+    default: return (testAMode(op) && r == a);
+  }
+}
+
+
+/*
+** Whether function 'p' (or a function nested in it) may assign to its
+** upvalue 'u'
+*/
+static int upvalchanged (Proto *p, int u) {
+  int pc, i;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction ins = p->code[pc];
+    if (GET_OPCODE(ins) == OP_SETUPVAL && GETARG_B(ins) == u)
+      return 1;
+    else if (isclosure(GET_OPCODE(ins))) {
+      Proto *np = p->p[GETARG_Bx(ins)];
+      for (i = 0; i < np->sizeupvalues; i++) {
+        if (!np->upvalues[i].instack && np->upvalues[i].idx == u &&
+            upvalchanged(np, i))
+          return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*
+** If the local variable 'v' in register 'r' gets a constant that it
+** keeps through all its scope, store the constant in 'kv' and return
+** its index in 'k'; otherwise return -1. Any path into the scope must
+** go through the load of the constant, which precedes the start of the
+** scope (perhaps with loads of other variables of the same declaration
+** in between).
+*/
+static int constvar (lua_State *L, Proto *f, int *marks, int v, int r,
+                     TValue *kv) {
+  Instruction *code = f->code;
+  int start = f->locvars[v].startpc;
+  int end = f->locvars[v].endpc;
+  int init, pc, i;
+  for (init = start - 1; init >= 0; init--) {  /* find the load */
+    Instruction ins = code[init];
+    int a = GETARG_A(ins);
+    OpCode op = GET_OPCODE(ins);
+    if (marks[init] & ODEAD)
+      continue;
+    else if (!(op == OP_LOADK || op == OP_LOADNIL ||
+              (op == OP_LOADBOOL && GETARG_C(ins) == 0)))
+      return -1;  /* not a simple load */
+    else if (op == OP_LOADNIL && a <= r && r <= a + GETARG_B(ins))
+      break;
+    else if (a == r)
+      break;
+    else if (a < r)
+      return -1;  /* not part of the same declaration */
+  }
+  if (init < 0)
+    return -1;
+  for (pc = 0; pc < f->sizecode; pc++) {  /* check paths into the scope */
+    int succ[2];
+    int ns = successors(code, pc, succ);
+    for (i = 0; i < ns; i++) {
+      int s = succ[i];
+      if (init < s && s < end &&
+          !(init <= pc && pc < end && s == pc + 1) &&
+          !(start <= pc && pc < end && start <= s))
+        return -1;
+    }
+  }
+  for (pc = start; pc < end; pc++) {  /* check assignments */
+    Instruction ins = code[pc];
+    if (changesreg(ins, r))
+      return -1;
+    else if (isclosure(GET_OPCODE(ins))) {
+      Proto *np = f->p[GETARG_Bx(ins)];
+      for (i = 0; i < np->sizeupvalues; i++) {
+        if (np->upvalues[i].instack && np->upvalues[i].idx == r &&
+            upvalchanged(np, i))
+          return -1;
+      }
+    }
+  }
+  switch (GET_OPCODE(code[init])) {
+    case OP_LOADK:
+      setobj(L, kv, &f->k[GETARG_Bx(code[init])]);
+      return GETARG_Bx(code[init]);
+    case OP_LOADBOOL:
+      setbvalue(kv, GETARG_B(code[init]));
+      return protoK(L, f, kv);
+    default:
+      setnilvalue(kv);
+      return protoK(L, f, kv);
+  }
+}
+
+
+/*
+** Use the constant with index 'k' for the reads of register 'r' by the
+** instruction at 'pc' (as an 'RK' operand only if 'asrk'); return
+** whether it became an operand
+*/
+static int usekonst (lua_State *L, Proto *f, int *marks, int pc, int r,
+                     int k, int asrk) {
+  Instruction *code = f->code;
+  Instruction i = code[pc];
+  OpCode op = GET_OPCODE(i);
+  const TValue *kv = &f->k[k];
+  int a = GETARG_A(i);
+  int used = 0;
+  switch (op) {
+    case OP_MOVE: {
+      if (GETARG_B(i) == r)
+        code[pc] = CREATE_ABx(OP_LOADK, a, k);
+      break;
+    }
+    case OP_NOT: {
+      if (GETARG_B(i) == r)
+        code[pc] = CREATE_ABC(OP_LOADBOOL, a, l_isfalse(kv), 0);
+      break;
+    }
+    case OP_TEST: {
+      if (a == r)
+        fixtest(code, marks, pc, (!l_isfalse(kv)) == GETARG_C(i));
+      break;
+    }
+    case OP_TESTSET: {
+      if (GETARG_B(i) == r) {
+        if ((!l_isfalse(kv)) == GETARG_C(i)) {  /* copies and jumps? */
+          code[pc] = CREATE_ABx(OP_LOADK, a, k);
+          marks[pc + 1] &= ~OSLOT;
+        }
+        else
+          fixtest(code, marks, pc, 0);
+      }
+      break;
+    }
+    default: {
+      if (!asrk || getOpMode(op) != iABC || k > MAXINDEXRK)
+        break;  /* cannot be an operand */
+      if (getBMode(op) == OpArgK && GETARG_B(i) == r) {
+        SETARG_B(code[pc], RKASK(k));
+        used = 1;
+      }
+      if (getCMode(op) == OpArgK && GETARG_C(i) == r) {
+        SETARG_C(code[pc], RKASK(k));
+        used = 1;
+      }
+      if (used)
+        foldconst(L, f, marks, pc);
+      break;
+    }
+  }
+  return used;
+}
+
+
+/*
+** If the instruction at 'pc' reads a register that the previous one
+** loads with a constant, use the constant instead; when the register
+** is a temporary used only as an operand, remove the load
+*/
+static void foldload (lua_State *L, Proto *f, int *marks, int pc) {
+  Instruction i = f->code[pc];
+  Instruction prev = f->code[pc - 1];
+  OpCode op = GET_OPCODE(i);
+  int t = GETARG_A(prev);
+  int temp, asrk;
+  if (GET_OPCODE(prev) != OP_LOADK || (marks[pc - 1] & (ODEAD | OSLOT)) ||
+      (marks[pc] & OTARGET))
+    return;
+  temp = (t >= nactive(f, pc));  /* a temporary? */
+  asrk = !(getBMode(op) == OpArgR && GETARG_B(i) == t) &&
+         !(op == OP_SETTABLE && GETARG_A(i) == t) && temp;
+  if (usekonst(L, f, marks, pc, t, GETARG_Bx(prev), asrk))
+    marks[pc - 1] |= ODEAD;
+  if (!temp && f->code[pc] != i)  /* read of a local made a constant? */
+    f->kvars = 1;
+}
+
+
+static void constvars (lua_State *L, Proto *f, int *marks) {
+  int v;
+  for (v = 0; v < f->sizelocvars; v++) {
+    TValue kv;
+    int r = varreg(f, v);
+    int k = constvar(L, f, marks, v, r, &kv);
+    int pc;
+    if (k >= 0) {
+      for (pc = f->locvars[v].startpc; pc < f->locvars[v].endpc; pc++) {
+        Instruction i = f->code[pc];
+        usekonst(L, f, marks, pc, r, k, 1);
+        if (f->code[pc] != i)
+          f->kvars = 1;  /* debug information must name the constant */
+      }
+    }
+  }
+}
+
+
+static void threadjumps (Proto *f, int *marks) {
+  Instruction *code = f->code;
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (GET_OPCODE(code[pc]) == OP_JMP) {
+      int dest = finaltarget(code, pc);
+      Instruction d = code[dest];
+      if (!(marks[pc] & OSLOT) && GET_OPCODE(d) == OP_RETURN &&
+          GETARG_B(d) != 0)  /* unconditional jump to a fixed return? */
+        code[pc] = d;  /* return right here */
+      else if (abs(dest - (pc + 1)) <= MAXARG_sBx)
+        SETARG_sBx(code[pc], dest - (pc + 1));
+    }
+  }
+}
+
+
+/*
+** Mark for removal useless instructions inside basic blocks; 'known'
+** keeps the constant (index in 'k') or nil known to be in each register
+*/
+static void markuseless (Proto *f, int *marks) {
+  Instruction *code = f->code;
+  int known[MAXREGS];
+  int pc, r;
+  for (r = 0; r < MAXREGS; r++) known[r] = UNKNOWN;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction i = code[pc];
+    int a = GETARG_A(i);
+    int removable = !(marks[pc] & (OTARGET | OSLOT));
+    if (marks[pc] & OTARGET) {  /* start of a basic block? */
+      for (r = 0; r < MAXREGS; r++) known[r] = UNKNOWN;
+    }
+    if (marks[pc] & ODEAD)
+      continue;  /* already removed */
+    switch (GET_OPCODE(i)) {
+      case OP_LOADK: {
+        if (removable && known[a] == GETARG_Bx(i))
+          marks[pc] |= ODEAD;
+        known[a] = GETARG_Bx(i);
+        break;
+      }
+      case OP_LOADNIL: {
+        int b = GETARG_B(i);
+        int allnil = 1;
+        for (r = a; r <= a + b; r++) {
+          if (known[r] != KNIL) allnil = 0;
+          known[r] = KNIL;
+        }
+        if (removable && allnil)
+          marks[pc] |= ODEAD;
+        break;
+      }
+      case OP_MOVE: {
+        int b = GETARG_B(i);
+        if (removable && pc > 0 && !(marks[pc - 1] & ODEAD) &&
+            code[pc - 1] == CREATE_ABC(OP_MOVE, b, a, 0))
+          marks[pc] |= ODEAD;  /* undoes previous move */
+        known[a] = known[b];
+        break;
+      }
+      case OP_NOT: {
+        Instruction t = code[pc + 1];
+        if (removable && GET_OPCODE(t) == OP_TEST && GETARG_A(t) == a &&
+            !(marks[pc + 1] & OTARGET) &&
+            a >= nactive(f, pc + 1)) {  /* temporary? */
+          code[pc + 1] = CREATE_ABC(OP_TEST, GETARG_B(i), 0, !GETARG_C(t));
+          marks[pc] |= ODEAD;  /* test the operand instead */
+        }
+        else
+          known[a] = UNKNOWN;
+        break;
+      }
+      case OP_LOADBOOL: case OP_GETUPVAL: {
+        known[a] = UNKNOWN;
+        break;
+      }
+      case OP_JMP: {
+        if (!(marks[pc] & OSLOT) && a == 0 && GETARG_sBx(i) == 0)
+          marks[pc] |= ODEAD;  /* jump to next instruction */
+        for (r = 0; r < MAXREGS; r++) known[r] = UNKNOWN;
+        break;
+      }
+      default: {  /* may write other registers or run other code */
+        for (r = 0; r < MAXREGS; r++) known[r] = UNKNOWN;
+        break;
+      }
+    }
+  }
+}
+
+
+/*
+** Mark instructions that execution may reach; uses 'work' as a stack
+*/
+static void markreached (Proto *f, int *marks, int *work) {
+  int n = 0;
+  work[n++] = 0;
+  marks[0] |= OREACHED;
+  while (n > 0) {
+    int succ[2];
+    int pc = work[--n];
+    int ns = successors(f->code, pc, succ);
+    int s;
+    if (pc + 1 < f->sizecode && (marks[pc + 1] & OSLOT))
+      marks[pc + 1] |= OKEPT;  /* keep it with its owner */
+    for (s = 0; s < ns; s++) {
+      if (succ[s] < f->sizecode && !(marks[succ[s]] & OREACHED)) {
+        marks[succ[s]] |= OREACHED;
+        work[n++] = succ[s];
+      }
+    }
+  }
+}
+
+
+#define kept(m)		(((m) & (OREACHED | OKEPT)) && !((m) & ODEAD))
+
+
+/*
+** Whether register 'r' surely has an integer when execution reaches
+** 'pc': the last instruction before it that sets the register loads an
+** integer constant (or copies such a register), and no jump enters in
+** between
+*/
+static int intreg (Proto *f, int *marks, int pc, int r) {
+  while (!(marks[pc] & OTARGET) && --pc >= 0) {
+    Instruction ins = f->code[pc];
+    if (marks[pc] & ODEAD)
+      continue;
+    else if (changesreg(ins, r)) {
+      switch (GET_OPCODE(ins)) {
+        case OP_LOADK:
+          return ttisinteger(&f->k[GETARG_Bx(ins)]);
+        case OP_MOVE:
+          return intreg(f, marks, pc, GETARG_B(ins));
+        case OP_MOVE2:
+          return intreg(f, marks, pc,
+                        (r == GETARG_A(ins)) ? GETARG_B(ins) : GETARG_C(ins));
+        default:
+          return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/*
+** Turn numeric loops whose initial value and step became integer
+** constants into their integer versions
+*/
+static void intloops (Proto *f, int *marks) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    Instruction ins = f->code[pc];
+    int a = GETARG_A(ins);
+    if (GET_OPCODE(ins) == OP_FORPREP &&
+        intreg(f, marks, pc, a) && intreg(f, marks, pc, a + 2)) {
+      SET_OPCODE(f->code[pc], OP_FORPREPI);
+      SET_OPCODE(f->code[jumpdest(ins, pc)], OP_FORLOOPI);
+    }
+  }
+}
+
+
+/*
+** Whether instruction 'i' may read register 'r' (not counting captures
+** by closures)
+*/
+static int readsreg (Instruction i, int r) {
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i);
+  int b = GETARG_B(i);
+  int c = GETARG_C(i);
+  switch (op) {
+    case OP_LOADK: case OP_LOADKX: case OP_LOADBOOL: case OP_LOADNIL:
+    case OP_GETUPVAL: case OP_JMP: case OP_CLOSURE: case OP_LCLOSURE:
+    case OP_VARARG: case OP_EXTRAARG:
+      return 0;
+    case OP_SETUPVAL: case OP_TEST: return (r == a);
+    case OP_SETTABLE:
+      return (r == a || (!ISK(b) && r == b) || (!ISK(c) && r == c));
+    case OP_CALL: case OP_TAILCALL: return (r >= a && (b == 0 || r < a + b));
+    case OP_RETURN: return (r >= a && (b == 0 || r < a + b - 1));
+    case OP_SETLIST: return (r >= a && (b == 0 || r <= a + b));
+    case OP_CONCAT: return (b <= r && r <= c);
+    case OP_FORLOOP: case OP_FORPREP: case OP_FORLOOPI: case OP_FORPREPI:
+    case OP_TFORCALL:
+      return (a <= r && r <= a + 2);
+    case OP_TFORLOOP: return (r == a + 1);
+    default:  /* reads only its operands B and C */
+      return ((getBMode(op) == OpArgR && r == b) ||
+              (getBMode(op) == OpArgK && !ISK(b) && r == b) ||
+              (getCMode(op) == OpArgR && r == c) ||
+              (getCMode(op) == OpArgK && !ISK(c) && r == c));
+  }
+}
+
+
+/*
+** Whether the instruction at 'pc' creates a closure that captures the
+** local variable in register 'r'
+*/
+static int captures (Proto *f, int pc, int r) {
+  Instruction i = f->code[pc];
+  if (isclosure(GET_OPCODE(i))) {
+    Proto *np = f->p[GETARG_Bx(i)];
+    int u;
+    for (u = 0; u < np->sizeupvalues; u++) {
+      if (np->upvalues[u].instack && np->upvalues[u].idx == r)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+
+/*
+** If the next instruction after 'pc' that reads or changes register 'r'
+** is a call of the function in 'r', return its position; otherwise -1
+*/
+static int callafter (Proto *f, int pc, int r) {
+  for (pc++; pc < f->sizecode; pc++) {
+    Instruction i = f->code[pc];
+    OpCode op = GET_OPCODE(i);
+    if (readsreg(i, r) || changesreg(i, r))
+      return ((op == OP_CALL || op == OP_TAILCALL) && GETARG_A(i) == r)
+             ? pc : -1;
+  }
+  return -1;
+}
+
+
+/*
+** Whether the closure that the instruction at 'pc' creates for local
+** variable 'v' (in register 'r') stays in the frame: through all the
+** scope of the variable no function captures it, nothing assigns to it,
+** and it is read only by moves to temporaries that are called next
+*/
+static int noescape (Proto *f, int pc, int v, int r) {
+  if (captures(f, pc, r))
+    return 0;  /* recursive local function */
+  for (pc++; pc < f->locvars[v].endpc; pc++) {
+    Instruction i = f->code[pc];
+    OpCode op = GET_OPCODE(i);
+    int t;
+    if (captures(f, pc, r) || changesreg(i, r))
+      return 0;
+    else if (!readsreg(i, r))
+      continue;
+    else if (op == OP_MOVE)
+      t = GETARG_A(i);
+    else if (op == OP_MOVE2 && GETARG_B(i) != GETARG_C(i))
+      t = GETARG_A(i) + (GETARG_C(i) == r);
+    else
+      return 0;
+    if (t < nactive(f, pc) || callafter(f, pc, t) < 0)
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Let the closures assigned to local variables that do not escape from
+** the frame be reused by later runs of their instructions
+*/
+static void localclosures (Proto *f) {
+  int v;
+  for (v = 0; v < f->sizelocvars; v++) {
+    int pc = f->locvars[v].startpc - 1;  /* creation of the closure */
+    int r = varreg(f, v);
+    if (pc >= 0 && GET_OPCODE(f->code[pc]) == OP_CLOSURE &&
+        GETARG_A(f->code[pc]) == r && noescape(f, pc, v, r))
+      SET_OPCODE(f->code[pc], OP_LCLOSURE);
+  }
+}
+
+
+/*
+** Whether instruction 'i' can neither call a function (directly or
+** through a metamethod or a finalizer) nor raise an error, so that
+** nothing can tell whether it runs inlined: the debug API and
+** tracebacks never see inlined calls
+*/
+static int leafins (Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_MOVE: case OP_MOVE2: case OP_LOADK: case OP_LOADKX:
+    case OP_LOADBOOL: case OP_LOADNIL: case OP_GETUPVAL: case OP_SETUPVAL:
+    case OP_NOT: case OP_TEST: case OP_TESTSET: case OP_RETURN:
+    case OP_EXTRAARG:
+      return 1;
+    case OP_JMP:
+      return (GETARG_A(i) == 0);  /* closes no upvalues */
+    case OP_EQ:  /* no metamethod when comparing with a constant */
+      return (ISK(GETARG_B(i)) || ISK(GETARG_C(i)));
+    default:
+      return 0;
+  }
+}
+
+
+/*
+** Prototype of the function that local variable 'v' keeps through all
+** its scope, if it is small and simple enough to be inlined; otherwise
+** NULL. Its code can only have instructions accepted by 'leafins' and
+** cannot return a variable number of values.
+*/
+static Proto *inlinable (Proto *f, int v) {
+  int pc = f->locvars[v].startpc - 1;  /* creation of the closure */
+  int r = varreg(f, v);
+  Proto *fn;
+  int q, u;
+  if (pc < 0 || GET_OPCODE(f->code[pc]) != OP_CLOSURE ||
+      GETARG_A(f->code[pc]) != r)
+    return NULL;
+  fn = f->p[GETARG_Bx(f->code[pc])];
+  if (fn->is_vararg || fn->sizecode > LUAI_MAXINLINE || captures(f, pc, r))
+    return NULL;
+  for (q = 0; q < fn->sizecode; q++) {
+    Instruction i = fn->code[q];
+    if (!leafins(i) ||
+        (GET_OPCODE(i) == OP_RETURN && (GETARG_B(i) == 0 ||
+                                        (q > 0 && haveslot(fn->code[q - 1])))))
+      return NULL;
+  }
+  for (q = pc + 1; q < f->locvars[v].endpc; q++) {  /* check assignments */
+    Instruction i = f->code[q];
+    if (changesreg(i, r))
+      return NULL;
+    else if (isclosure(GET_OPCODE(i))) {
+      Proto *np = f->p[GETARG_Bx(i)];
+      for (u = 0; u < np->sizeupvalues; u++) {
+        if (np->upvalues[u].instack && np->upvalues[u].idx == r &&
+            upvalchanged(np, u))
+          return NULL;
+      }
+    }
+  }
+  return fn;
+}
+
+
+/*
+** Fill 'acc' with where 'f' finds the upvalues of 'fn' to call it
+** inlined, when its closure is in a local variable of 'f' ('up' < 0)
+** or in upvalue 'up'
+*/
+static void fnaccess (Proto *fn, const KValue *upk, int up, int *acc) {
+  int i;
+  for (i = 0; i < fn->sizeupvalues; i++) {
+    if (up >= 0)
+      acc[i] = upk[up].fnup[i];
+    else if (fn->upvalues[i].instack)
+      acc[i] = fn->upvalues[i].idx;
+    else
+      acc[i] = ACCUPVAL(fn->upvalues[i].idx);
+  }
+}
+
+
+/*
+** Where 'np', a function created by 'f', finds the upvalues of 'fn',
+** given where 'f' finds them
+*/
+static int *nestedaccess (lua_State *L, Proto *fn, const int *acc,
+                          Proto *np) {
+  int *nacc = luaM_newvector(L, fn->sizeupvalues, int);
+  int i, u;
+  for (i = 0; i < fn->sizeupvalues; i++) {
+    nacc[i] = NOACCESS;
+    for (u = 0; u < np->sizeupvalues; u++) {
+      Upvaldesc *uv = &np->upvalues[u];
+      if (uv->instack ? (uv->idx == acc[i]) : (ACCUPVAL(uv->idx) == acc[i]))
+        nacc[i] = ACCUPVAL(u);
+    }
+  }
+  return nacc;
+}
+
+
+/*
+** If the instruction at 'pc' loads into a temporary a function that
+** can be inlined, and the next use of the temporary is a call of it
+** with a fixed number of arguments (and of results, unless it is a
+** tail call), return the function, with the position of the call in
+** 'call' and the upvalue that has the closure (or -1) in 'up';
+** otherwise return NULL
+*/
+static Proto *inlinesite (Proto *f, const KValue *upk, int pc, int *call,
+                          int *up) {
+  Instruction i = f->code[pc];
+  OpCode op = GET_OPCODE(i);
+  int t = GETARG_A(i);
+  Proto *fn = NULL;
+  int v;
+  *up = -1;
+  if (op == OP_GETUPVAL && upk != NULL && upk[GETARG_B(i)].fn != NULL) {
+    *up = GETARG_B(i);
+    fn = upk[*up].fn;
+  }
+  else if (op == OP_MOVE || op == OP_MOVE2) {
+    for (v = 0; v < f->sizelocvars; v++) {
+      if (f->locvars[v].startpc <= pc && pc < f->locvars[v].endpc &&
+          varreg(f, v) == GETARG_B(i)) {
+        fn = inlinable(f, v);
+        break;
+      }
+    }
+  }
+  if (fn == NULL || t < nactive(f, pc) || (*call = callafter(f, pc, t)) < 0)
+    return NULL;
+  i = f->code[*call];
+  if (GETARG_B(i) == 0 || (GET_OPCODE(i) == OP_CALL && GETARG_C(i) == 0) ||
+      t + 1 + fn->maxstacksize > MAXREGS)
+    return NULL;
+  return fn;
+}
+
+
+/*
+** Operand 'x' (of kind 'mode') of an instruction of 'fn' inlined into
+** 'f' with its registers from 'base' on, or -1 if a constant does not
+** fit
+*/
+static int inlineoperand (lua_State *L, Proto *f, Proto *fn, int base,
+                          enum OpArgMask mode, int x) {
+  if (mode == OpArgR)
+    return x + base;
+  else if (mode == OpArgK && !ISK(x))
+    return x + base;
+  else if (mode == OpArgK) {
+    int k = protoK(L, f, &fn->k[INDEXK(x)]);
+    return (k >= 0 && k <= MAXINDEXRK) ? RKASK(k) : -1;
+  }
+  else return x;
+}
+
+
+/*
+** Translate instruction 'i' of 'fn' (other than a return) to run
+** inlined in 'f', with its registers from 'base' on and its upvalues
+** where 'acc' says; return 0 if that is not possible. Jump offsets are
+** kept.
+*/
+static int inlineins (lua_State *L, Proto *f, Proto *fn, const int *acc,
+                      int base, Instruction *pi) {
+  Instruction i = *pi;
+  OpCode op = GET_OPCODE(i);
+  int a = GETARG_A(i) + base;
+  int b, c, u;
+  switch (getOpMode(op)) {
+    case iABx: {
+      int k = 0;
+      if (op == OP_LOADK && (k = protoK(L, f, &fn->k[GETARG_Bx(i)])) < 0)
+        return 0;
+      *pi = CREATE_ABx(op, a, k);
+      return 1;
+    }
+    case iAsBx: {
+      if (op != OP_JMP)  /* (a jump has no register) */
+        SETARG_A(*pi, a);
+      return 1;
+    }
+    case iAx: return 1;  /* handled with its instruction */
+    default: break;
+  }
+  b = inlineoperand(L, f, fn, base, getBMode(op), GETARG_B(i));
+  c = inlineoperand(L, f, fn, base, getCMode(op), GETARG_C(i));
+  if (b < 0 || c < 0)
+    return 0;
+  switch (op) {
+    case OP_EQ: case OP_LT: case OP_LE:  /* 'A' is not a register */
+      a = GETARG_A(i);
+      /* FALLTHROUGH */
+    default:
+      *pi = CREATE_ABC(op, a, b, c);
+      return 1;
+    case OP_GETUPVAL: case OP_SETUPVAL: case OP_GETTABUP:
+      u = acc[GETARG_B(i)];
+      break;
+    case OP_SETTABUP:
+      u = acc[GETARG_A(i)];
+      break;
+  }
+  if (u == NOACCESS)
+    return 0;
+  else if (u < 0) {  /* in an upvalue of 'f' */
+    u = ACCUPVAL(u);
+    if (op == OP_SETTABUP)
+      *pi = CREATE_ABC(op, u, b, c);
+    else
+      *pi = CREATE_ABC(op, a, u, c);
+  }
+  else {  /* in a register of 'f' */
+    switch (op) {
+      case OP_GETUPVAL: *pi = CREATE_ABC(OP_MOVE, a, u, 0); break;
+      case OP_SETUPVAL: *pi = CREATE_ABC(OP_MOVE, u, a, 0); break;
+      case OP_GETTABUP: *pi = CREATE_ABC(OP_GETTABLE, a, u, c); break;
+      default: *pi = CREATE_ABC(OP_SETTABLE, u, b, c); break;
+    }
+  }
+  return 1;
+}
+
+
+/*
+** Whether all the code of 'fn' can run inlined in 'f' with its
+** registers from 'base' on
+*/
+static int caninline (lua_State *L, Proto *f, Proto *fn, const int *acc,
+                      int base) {
+  int q;
+  for (q = 0; q < fn->sizecode; q++) {
+    Instruction i = fn->code[q];
+    if (GET_OPCODE(i) == OP_EXTRAARG && GET_OPCODE(fn->code[q - 1]) ==
+        OP_LOADKX && protoK(L, f, &fn->k[GETARG_Ax(i)]) < 0)
+      return 0;
+    else if (GET_OPCODE(i) != OP_RETURN && !inlineins(L, f, fn, acc, base, &i))
+      return 0;
+  }
+  return 1;
+}
+
+
+/*
+** Size of the code for a call of 'fn' inlined, with 'nargs' arguments
+** and 'nres' results (-1 for a tail call, whose returns stay returns);
+** fill 'pos' with where each instruction of 'fn' goes (from 'start' on)
+*/
+static int inlinesize (Proto *fn, int nargs, int nres, int start,
+                       int *pos) {
+  int q;
+  int n = start + (nargs < fn->numparams);  /* nil for missing arguments */
+  for (q = 0; q < fn->sizecode; q++) {
+    Instruction i = fn->code[q];
+    pos[q] = n;
+    if (GET_OPCODE(i) != OP_RETURN || nres < 0)
+      n++;
+    else {  /* moves, nils for missing results, and jump to the end */
+      int m = GETARG_B(i) - 1;
+      n += (m < nres ? m + 1 : nres) + (q < fn->sizecode - 1);
+    }
+  }
+  pos[fn->sizecode] = n;
+  return n - start;
+}
+
+
+/*
+** Emit at 'code[start]' the call at 'pc' of 'f' to 'fn' inlined, with
+** the instruction positions computed by 'inlinesize'
+*/
+static void emitinline (lua_State *L, Proto *f, Proto *fn, const int *acc,
+                        int pc, Instruction *code, int *lineinfo,
+                        int start, const int *pos) {
+  Instruction call = f->code[pc];
+  int t = GETARG_A(call);
+  int nargs = GETARG_B(call) - 1;
+  int nres = GETARG_C(call) - 1;
+  int n = start;
+  int q, j;
+  if (nargs < fn->numparams) {
+    lineinfo[n] = f->lineinfo[pc];
+    code[n++] = CREATE_ABC(OP_LOADNIL, t + 1 + nargs,
+                           fn->numparams - nargs - 1, 0);
+  }
+  for (q = 0; q < fn->sizecode; q++) {
+    Instruction i = fn->code[q];
+    int line = fn->lineinfo[q];
+    lua_assert(n == pos[q]);
+    if (GET_OPCODE(i) == OP_RETURN && nres < 0) {
+      lineinfo[n] = line;
+      code[n++] = CREATE_ABC(OP_RETURN, t + 1 + GETARG_A(i), GETARG_B(i), 0);
+    }
+    else if (GET_OPCODE(i) == OP_RETURN) {
+      int a = t + 1 + GETARG_A(i);
+      int m = GETARG_B(i) - 1;
+      for (j = 0; j < m && j < nres; j++) {
+        lineinfo[n] = line;
+        code[n++] = CREATE_ABC(OP_MOVE, t + j, a + j, 0);
+      }
+      if (m < nres) {
+        lineinfo[n] = line;
+        code[n++] = CREATE_ABC(OP_LOADNIL, t + m, nres - m - 1, 0);
+      }
+      if (q < fn->sizecode - 1) {
+        lineinfo[n] = line;
+        code[n] = CREATE_ABx(OP_JMP, 0,
+                             pos[fn->sizecode] - (n + 1) + MAXARG_sBx);
+        n++;
+      }
+    }
+    else {
+      int d = jumpdest(i, q);
+      if (GET_OPCODE(i) == OP_EXTRAARG &&
+          GET_OPCODE(fn->code[q - 1]) == OP_LOADKX)
+        i = CREATE_Ax(OP_EXTRAARG, protoK(L, f, &fn->k[GETARG_Ax(i)]));
+      else
+        inlineins(L, f, fn, acc, t + 1, &i);
+      if (d >= 0)
+        SETARG_sBx(i, pos[d] - (n + 1));
+      lineinfo[n] = line;
+      code[n++] = i;
+    }
+  }
+}
+
+
+static void copyvar (LocVar *to, const LocVar *from, const int *newpc) {
+  to->varname = from->varname;
+  to->startpc = newpc[from->startpc];
+  to->endpc = newpc[from->endpc];
+}
+
+
+/*
+** Inline in 'f' the calls of small local functions (of 'f' or of the
+** functions creating it, through the upvalues in 'upk') whose closures
+** never change. Each call runs the code of the function in the
+** registers from the one after the called function, with the moves of
+** the results in place of its returns; the load of the function is
+** removed. The locals of the function become locals of 'f', after
+** '(inline)' ones for the temporaries up to the register of the
+** function, so that the passes that follow do not take its registers
+** for temporaries. Line information follows the code of the called
+** function.
+*/
+static void inlinecalls (lua_State *L, Proto *f, const KValue *upk) {
+  int n = f->sizecode;
+  Proto **fnat = luaM_newvector(L, n, Proto *);  /* function called at pc */
+  int *upat = luaM_newvector(L, 3 * (n + 1), int);  /* upvalue with it */
+  int *dropped = upat + n + 1;  /* whether the load at pc is removed */
+  int *newpc = dropped + n + 1;
+  int acc[MAXUPVAL + 1];
+  Instruction *code;
+  int *lineinfo;
+  LocVar *vars;
+  int pc, call, up, k, size;
+  int ncalls = 0, nvars = f->sizelocvars, v = 0, nv = 0;
+  for (pc = 0; pc < n; pc++) { fnat[pc] = NULL; dropped[pc] = 0; }
+  for (pc = 0; pc < n; pc++) {  /* find the calls to inline */
+    Proto *fn = inlinesite(f, upk, pc, &call, &up);
+    if (fn != NULL) {
+      fnaccess(fn, upk, up, acc);
+      if (caninline(L, f, fn, acc, GETARG_A(f->code[call]) + 1)) {
+        fnat[call] = fn;
+        upat[call] = up;
+        dropped[pc] = 1;
+        ncalls++;
+        nvars += GETARG_A(f->code[call]) + 1 - nactive(f, call) +
+                 fn->sizelocvars;
+      }
+    }
+  }
+  for (pc = 0, size = 0; pc < n; pc++) {  /* compute new positions */
+    Instruction i = f->code[pc];
+    newpc[pc] = size;
+    if (dropped[pc])
+      size += (GET_OPCODE(i) == OP_MOVE2);  /* keeps its second move */
+    else if (fnat[pc] != NULL) {
+      Proto *fn = fnat[pc];
+      int *pos = luaM_newvector(L, fn->sizecode + 1, int);
+      size += inlinesize(fn, GETARG_B(i) - 1, GETARG_C(i) - 1, 0, pos);
+      luaM_freearray(L, pos, fn->sizecode + 1);
+    }
+    else
+      size++;
+  }
+  newpc[n] = size;
+  if (ncalls > 0) {
+    TString *name = luaS_newliteral(L, "(inline)");
+    code = luaM_newvector(L, size, Instruction);
+    lineinfo = luaM_newvector(L, size, int);
+    vars = luaM_newvector(L, nvars, LocVar);
+    for (pc = 0; pc < n; pc++) {
+      Instruction i = f->code[pc];
+      k = newpc[pc];
+      if (dropped[pc]) {
+        if (GET_OPCODE(i) == OP_MOVE2) {
+          code[k] = CREATE_ABC(OP_MOVE, GETARG_A(i) + 1, GETARG_C(i), 0);
+          lineinfo[k] = f->lineinfo[pc];
+        }
+      }
+      else if (fnat[pc] != NULL) {
+        Proto *fn = fnat[pc];
+        int t = GETARG_A(i);
+        int *pos = luaM_newvector(L, fn->sizecode + 1, int);
+        inlinesize(fn, GETARG_B(i) - 1, GETARG_C(i) - 1, k, pos);
+        fnaccess(fn, upk, upat[pc], acc);
+        emitinline(L, f, fn, acc, pc, code, lineinfo, k, pos);
+        for (; v < f->sizelocvars && f->locvars[v].startpc <= pc; v++)
+          copyvar(&vars[nv++], &f->locvars[v], newpc);  /* active here */
+        for (up = nactive(f, pc); up <= t; up++, nv++) {
+          vars[nv].varname = name;
+          vars[nv].startpc = k;
+          vars[nv].endpc = pos[fn->sizecode];
+        }
+        for (up = 0; up < fn->sizelocvars; up++, nv++) {
+          vars[nv].varname = fn->locvars[up].varname;
+          vars[nv].startpc = pos[fn->locvars[up].startpc];
+          vars[nv].endpc = pos[fn->locvars[up].endpc];
+        }
+        luaM_freearray(L, pos, fn->sizecode + 1);
+        if (t + 1 + fn->maxstacksize > f->maxstacksize)
+          f->maxstacksize = cast_byte(t + 1 + fn->maxstacksize);
+      }
+      else {
+        int d = jumpdest(i, pc);
+        if (d >= 0)
+          SETARG_sBx(i, newpc[d] - (k + 1));
+        code[k] = i;
+        lineinfo[k] = f->lineinfo[pc];
+      }
+    }
+    for (; v < f->sizelocvars; v++)
+      copyvar(&vars[nv++], &f->locvars[v], newpc);
+    lua_assert(nv == nvars);
+    for (k = 0; k < nvars; k++)
+      luaC_objbarrier(L, f, vars[k].varname);
+    luaM_freearray(L, f->locvars, f->sizelocvars);
+    f->locvars = vars;
+    f->sizelocvars = nvars;
+    luaM_freearray(L, f->code, f->sizecode);
+    luaM_freearray(L, f->lineinfo, f->sizelineinfo);
+    f->code = code;
+    f->lineinfo = lineinfo;
+    f->sizecode = f->sizelineinfo = size;
+  }
+  luaM_freearray(L, fnat, n);
+  luaM_freearray(L, upat, 3 * (n + 1));
+}
+
+
+static void optimize (lua_State *L, Proto *f, const KValue *upk,
+                      int inlining);
+
+
+/*
+** Optimize the functions created by 'f', with the constants known for
+** their upvalues
+*/
+static void optnested (lua_State *L, Proto *f, int *marks,
+                       const KValue *upk, int inlining) {
+  int acc[MAXUPVAL + 1];
+  int pc, i, v;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (isclosure(GET_OPCODE(f->code[pc]))) {
+      Proto *np = f->p[GETARG_Bx(f->code[pc])];
+      int nup = np->sizeupvalues;
+      KValue *npk = luaM_newvector(L, nup, KValue);
+      for (i = 0; i < nup; i++) {
+        Upvaldesc *uv = &np->upvalues[i];
+        npk[i].known = 0;
+        npk[i].fn = NULL;
+        if (!uv->instack) {
+          if (upk != NULL)
+            npk[i] = upk[uv->idx];
+          if (npk[i].fn != NULL)
+            npk[i].fnup = nestedaccess(L, npk[i].fn, npk[i].fnup, np);
+        }
+        else {
+          for (v = 0; v < f->sizelocvars; v++) {  /* find the variable */
+            if (f->locvars[v].startpc <= pc && pc < f->locvars[v].endpc &&
+                varreg(f, v) == uv->idx) {
+              npk[i].known =
+                  (constvar(L, f, marks, v, uv->idx, &npk[i].v) >= 0);
+              if (inlining && (npk[i].fn = inlinable(f, v)) != NULL) {
+                fnaccess(npk[i].fn, NULL, -1, acc);
+                npk[i].fnup = nestedaccess(L, npk[i].fn, acc, np);
+              }
+              break;
+            }
+          }
+        }
+      }
+      optimize(L, np, npk, inlining);
+      for (i = 0; i < nup; i++) {
+        if (npk[i].fn != NULL)
+          luaM_freearray(L, npk[i].fnup, npk[i].fn->sizeupvalues);
+      }
+      luaM_freearray(L, npk, nup);
+    }
+  }
+}
+
+
+static void optimize (lua_State *L, Proto *f, const KValue *upk,
+                      int inlining) {
+  Instruction *code;
+  int n;
+  int *marks, *newpc;
+  int pc, k, i;
+  if (inlining)
+    inlinecalls(L, f, upk);
+  code = f->code;
+  n = f->sizecode;
+  marks = luaM_newvector(L, 2 * (n + 1), int);
+  newpc = marks + n + 1;
+  for (pc = 0; pc <= n; pc++) marks[pc] = 0;
+  for (pc = 0; pc < n; pc++) {
+    Instruction ins = code[pc];
+    if (haveslot(ins))
+      marks[pc + 1] |= OSLOT;
+    if (GET_OPCODE(ins) == OP_GETUPVAL && upk != NULL &&
+        upk[GETARG_B(ins)].known) {  /* upvalue with a known constant? */
+      k = protoK(L, f, &upk[GETARG_B(ins)].v);
+      if (k >= 0)
+        code[pc] = CREATE_ABx(OP_LOADK, GETARG_A(ins), k);
+    }
+  }
+  marktargets(f, marks);
+  for (pc = 1; pc < n; pc++)
+    foldload(L, f, marks, pc);
+  constvars(L, f, marks);
+  intloops(f, marks);
+  optnested(L, f, marks, upk, inlining);
+  threadjumps(f, marks);
+  for (pc = 0; pc <= n; pc++) marks[pc] &= ~OTARGET;
+  marktargets(f, marks);
+  markuseless(f, marks);
+  markreached(f, marks, newpc);
+  for (pc = n - 1, k = n; pc >= 0; pc--) {  /* 'k' is the next kept one */
+    if (kept(marks[pc])) {
+      int d = jumpdest(code[pc], pc);
+      if (GET_OPCODE(code[pc]) == OP_JMP && GETARG_A(code[pc]) == 0 &&
+          !(marks[pc] & OSLOT) && pc < d && d <= k)
+        marks[pc] |= ODEAD;  /* jumps over removed code only */
+      else
+        k = pc;
+    }
+  }
+  for (pc = 0, k = 0; pc < n; pc++) {  /* compute new positions */
+    newpc[pc] = k;
+    if (kept(marks[pc]))
+      k++;
+  }
+  newpc[n] = k;
+  for (pc = 0; pc < n; pc++) {  /* move kept instructions */
+    if (kept(marks[pc])) {
+      Instruction ins = code[pc];
+      int d = jumpdest(ins, pc);
+      if (d >= 0)
+        SETARG_sBx(ins, newpc[d] - (newpc[pc] + 1));
+      code[newpc[pc]] = ins;
+      f->lineinfo[newpc[pc]] = f->lineinfo[pc];
+    }
+  }
+  for (i = 0; i < f->sizelocvars; i++) {
+    f->locvars[i].startpc = newpc[f->locvars[i].startpc];
+    f->locvars[i].endpc = newpc[f->locvars[i].endpc];
+  }
+  luaM_freearray(L, marks, 2 * (n + 1));
+  luaM_reallocvector(L, f->code, f->sizecode, k, Instruction);
+  f->sizecode = k;
+  luaM_reallocvector(L, f->lineinfo, f->sizelineinfo, k, int);
+  f->sizelineinfo = k;
+  localclosures(f);
+}
+
+
+void luaK_optimize (lua_State *L, Proto *f, int inlining) {
+  optimize(L, f, NULL, inlining);
+}
+
+/* }====================================================== */
@@ -21,6 +21,7 @@
 #include "ldebug.h"
 #include "ldo.h"
 #include "lfunc.h"
+#include "lgc.h"
 #include "lobject.h"
 #include "lopcodes.h"
 #include "lstate.h"
@@ -175,6 +176,7 @@ LUA_API const char *lua_getlocal (lua_State *L, const lua_Debug *ar, int n) {
     StkId pos = NULL;  /* to avoid warnings */
     name = findlocal(L, ar->i_ci, n, &pos);
     if (name) {
+      markescaped(pos);
       setobj2s(L, L->top, pos);
       api_incr_top(L);
     }
@@ -260,6 +262,7 @@ static int auxgetinfo (lua_State *L, const char *what, lua_Debug *ar,
         else {
           ar->isvararg = f->l.p->is_vararg;
           ar->nparams = f->l.p->numparams;
+          ar->nups -= f->l.p->nbound;  /* cells of frozen globals */
         }
         break;
       }
@@ -311,6 +314,7 @@ LUA_API int lua_getinfo (lua_State *L, const char *what, lua_Debug *ar) {
   cl = ttisclosure(func) ? clvalue(func) : NULL;
   status = auxgetinfo(L, what, ar, cl, ci);
   if (strchr(what, 'f')) {
+    markescaped(func);
     setobjs2s(L, L->top, func);
     api_incr_top(L);
   }
@@ -401,6 +405,11 @@ static int findsetreg (Proto *p, int lastpc, int reg) {
         }
         break;
       }
+      case OP_MOVE2: {
+        if (reg == a || reg == a + 1)
+          setreg = filterpc(pc, jmptarget);
+        break;
+      }
       default:
         if (testAMode(op) && reg == a)  /* any instruction that set A */
           setreg = filterpc(pc, jmptarget);
@@ -411,6 +420,56 @@ static int findsetreg (Proto *p, int lastpc, int reg) {
 }
 
 
+/*
+** check whether instruction at 'pc' loads value 'kv' into its register
+*/
+static int isloadof (Proto *p, int pc, const TValue *kv) {
+  Instruction i = p->code[pc];
+  switch (GET_OPCODE(i)) {
+    case OP_LOADK:
+      return luaV_rawequalobj(&p->k[GETARG_Bx(i)], kv);
+    case OP_LOADKX:
+      return luaV_rawequalobj(&p->k[GETARG_Ax(p->code[pc + 1])], kv);
+    case OP_LOADNIL:
+      return ttisnil(kv);
+    case OP_LOADBOOL:
+      return (ttisboolean(kv) && GETARG_C(i) == 0 &&
+              bvalue(kv) == GETARG_B(i));
+    default: return 0;
+  }
+}
+
+
+/*
+** The optimizer ('O' mode) replaces reads of a local never assigned
+** after its declaration by the constant it holds ('p->kvars'); find the
+** innermost active local at 'pc' still holding the constant 'kv' it was
+** declared with, to give that value its name back. (In such functions,
+** a literal equal to one of those locals takes its name too.)
+*/
+static const char *constlocal (Proto *p, int pc, const TValue *kv,
+                               const char **name) {
+  int i;
+  int reg = 0;
+  const char *found = NULL;
+  if (!p->kvars)
+    return NULL;
+  for (i = 0; i < p->sizelocvars && p->locvars[i].startpc <= pc; i++) {
+    if (pc < p->locvars[i].endpc) {  /* is variable active? */
+      int setpc = findsetreg(p, pc, reg);
+      if (setpc != -1 && setpc < p->locvars[i].startpc &&
+          isloadof(p, setpc, kv))  /* not changed since declaration? */
+        found = getstr(p->locvars[i].varname);
+      reg++;
+    }
+  }
+  if (found == NULL)
+    return NULL;
+  *name = found;
+  return "local";
+}
+
+
 static const char *getobjname (Proto *p, int lastpc, int reg,
                                const char **name) {
   int pc;
@@ -429,6 +488,12 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
           return getobjname(p, pc, b, name);  /* get name for 'b' */
         break;
       }
+      case OP_MOVE2: {
+        int b = (reg == GETARG_A(i)) ? GETARG_B(i) : GETARG_C(i);
+        if (b < GETARG_A(i))
+          return getobjname(p, pc, b, name);  /* get name for source */
+        break;
+      }
       case OP_GETTABUP:
       case OP_GETTABLE: {
         int k = GETARG_C(i);  /* key index */
@@ -440,13 +505,17 @@ static const char *getobjname (Proto *p, int lastpc, int reg,
         return (vn && strcmp(vn, LUA_ENV) == 0) ? "global" : "field";
       }
       case OP_GETUPVAL: {
-        *name = upvalname(p, GETARG_B(i));
-        return "upvalue";
+        int b = GETARG_B(i);
+        *name = upvalname(p, b);
+        return (b >= p->sizeupvalues - p->nbound) ? "global" : "upvalue";
       }
       case OP_LOADK:
       case OP_LOADKX: {
         int b = (op == OP_LOADK) ? GETARG_Bx(i)
                                  : GETARG_Ax(p->code[pc + 1]);
+        const char *what = constlocal(p, pc, &p->k[b], name);
+        if (what)  /* a move from a constant local? */
+          return what;
         if (ttisstring(&p->k[b])) {
           *name = svalue(&p->k[b]);
           return "constant";
@@ -524,6 +593,15 @@ static int isinstack (CallInfo *ci, const TValue *o) {
 }
 
 
+/*
+** Checks whether value 'o' is a constant of function 'p' (an RK operand)
+*/
+static int isKvalue (Proto *p, const TValue *o) {
+  ptrdiff_t i = o - p->k;
+  return (0 <= i && i < p->sizek && p->k + i == o);
+}
+
+
 /*
 ** Checks whether value 'o' came from an upvalue. (That can only happen
 ** with instructions OP_GETTABUP/OP_SETTABUP, which operate directly on
@@ -536,7 +614,7 @@ static const char *getupvalname (CallInfo *ci, const TValue *o,
   for (i = 0; i < c->nupvalues; i++) {
     if (c->upvals[i]->v == o) {
       *name = upvalname(c->p, i);
-      return "upvalue";
+      return (i >= c->nupvalues - c->p->nbound) ? "global" : "upvalue";
     }
   }
   return NULL;
@@ -552,6 +630,8 @@ static const char *varinfo (lua_State *L, const TValue *o) {
     if (!kind && isinstack(ci, o))  /* no? try a register */
       kind = getobjname(ci_func(ci)->p, currentpc(ci),
                         cast_int(o - ci->u.l.base), &name);
+    else if (!kind && isKvalue(ci_func(ci)->p, o))  /* a constant? */
+      kind = constlocal(ci_func(ci)->p, currentpc(ci), o, &name);
   }
   return (kind) ? luaO_pushfstring(L, " (%s '%s')", kind, name) : "";
 }
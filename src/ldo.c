@@ -107,9 +107,9 @@ static void seterrorobj (lua_State *L, int errcode, StkId oldtop) {
 }
 
 
-// ׳쳣
+// 抛出异常
 l_noret luaD_throw (lua_State *L, int errcode) {
-  // 쳣
+  // 有异常函数
   if (L->errorJmp) {  /* thread has an error handler? */
     L->errorJmp->status = errcode;  /* set status */
     LUAI_THROW(L, L->errorJmp);  /* jump to it */
@@ -585,6 +585,7 @@ static int recover (lua_State *L, int status) {
   L->ci = ci;
   L->allowhook = getoah(ci->callstatus);  /* restore original 'allowhook' */
   L->nny = 0;  /* should be zero to be yieldable */
+  luaE_dropbatch(L, 0);
   luaD_shrinkstack(L);
   L->errfunc = ci->u.c.old_errfunc;
   return 1;  /* continue running the coroutine */
@@ -666,6 +667,7 @@ LUA_API int lua_resume (lua_State *L, lua_State *from, int nargs) {
     }
     if (errorstatus(status)) {  /* unrecoverable error? */
       L->status = cast_byte(status);  /* mark thread as 'dead' */
+      luaE_dropbatch(L, 0);
       seterrorobj(L, status, L->top);  /* push error message */
       L->ci->top = L->top;
     }
@@ -716,13 +718,14 @@ LUA_API int lua_yieldk (lua_State *L, int nresults, lua_KContext ctx,
 int luaD_pcall (lua_State *L, Pfunc func, void *u,
                 ptrdiff_t old_top, ptrdiff_t ef) {
   int status;
-  // 洢״̬
+  // 存储旧状态
   CallInfo *old_ci = L->ci;
   lu_byte old_allowhooks = L->allowhook;
   unsigned short old_nny = L->nny;
+  unsigned short old_lockbatch = L->lockbatch;
   ptrdiff_t old_errfunc = L->errfunc;
 
-  // ص
+  // 错误回调函数
   L->errfunc = ef;
   status = luaD_rawrunprotected(L, func, u);
   if (status != LUA_OK) {  /* an error occurred? */
@@ -732,6 +735,7 @@ int luaD_pcall (lua_State *L, Pfunc func, void *u,
     L->ci = old_ci;
     L->allowhook = old_allowhooks;
     L->nny = old_nny;
+    luaE_dropbatch(L, old_lockbatch);
     luaD_shrinkstack(L);
   }
   L->errfunc = old_errfunc;
@@ -747,7 +751,7 @@ struct SParser {  /* data to 'f_parser' */
   ZIO *z;
   Mbuffer buff;  /* dynamic structure used by the scanner */
   Dyndata dyd;  /* dynamic structures used by the parser */
-  const char *mode;
+  const char *mode;  /* 'b', 't', 'O' (optimize text chunks), 'I', 'F' */
   const char *name;
 };
 
@@ -760,35 +764,44 @@ static void checkmode (lua_State *L, const char *mode, const char *x) {
   }
 }
 
-// ﷨
+// 进行语法分析
 static void f_parser (lua_State *L, void *ud) {
   LClosure *cl;
   struct SParser *p = cast(struct SParser *, ud);
   int c = zgetc(p->z);  /* read first character */
-  // ģʽ binary  text
+  // 检测模式， binary 或者 text
   if (c == LUA_SIGNATURE[0]) {
-	// binary ģʽ
+	// binary 模式
     checkmode(L, p->mode, "binary");
     cl = luaU_undump(L, p->z, p->name);
   }
   else {
-	// text ģʽ
+    int optimize = 0;  /* 'O' optimizes; 'I' also inlines small functions */
+	// text 模式
     checkmode(L, p->mode, "text");
-    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c);
+    if (p->mode != NULL)
+      optimize = strchr(p->mode, 'I') ? 2 : (strchr(p->mode, 'O') != NULL);
+    cl = luaY_parser(L, p->z, &p->buff, &p->dyd, p->name, c, optimize);
   }
   lua_assert(cl->nupvalues == cl->p->sizeupvalues);
   luaF_initupvals(L, cl);
+  if (p->mode != NULL && strchr(p->mode, 'F') != NULL) {  /* bind globals? */
+    const TValue *gt = luaH_getint(hvalue(&G(L)->l_registry),
+                                   LUA_RIDX_GLOBALS);
+    if (ttistable(gt) && G(L)->frozen != NULL)
+      setclLvalue(L, L->top - 1, luaF_bindglobals(L, cl, hvalue(gt)));
+  }
 }
 
 
-// ģʽ£﷨
+// 保护模式下，进行语法分析
 int luaD_protectedparser (lua_State *L, ZIO *z, const char *name,
                                         const char *mode) {
   struct SParser p;
   int status;
-  // ˼
+  // 顾名思义
   L->nny++;  /* cannot yield during parsing */
-  // ʼ Sparser ṹ, name="=stdin", mode = ""
+  // 初始化 Sparser 结构, name="=stdin", mode = ""
   p.z = z; p.name = name; p.mode = mode;
   p.dyd.actvar.arr = NULL; p.dyd.actvar.size = 0;
   p.dyd.gt.arr = NULL; p.dyd.gt.size = 0;
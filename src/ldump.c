@@ -15,6 +15,7 @@
 #include "lua.h"
 
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 #include "lundump.h"
 
@@ -88,8 +89,19 @@ static void DumpString (const TString *s, DumpState *D) {
 
 
 static void DumpCode (const Proto *f, DumpState *D) {
+  int i;
+  int first = f->sizeupvalues - f->nbound;  /* first bound upvalue */
   DumpInt(f->sizecode, D);
-  DumpVector(f->code, f->sizecode, D);
+  if (f->nbound == 0)
+    DumpVector(f->code, f->sizecode, D);
+  else {  /* dump reads of bound globals as the original ones */
+    for (i = 0; i < f->sizecode; i++) {
+      Instruction ins = f->code[i];
+      if (GET_OPCODE(ins) == OP_GETUPVAL && GETARG_B(ins) >= first)
+        ins = CREATE_ABC(OP_GETTABUP, GETARG_A(ins), f->envup, GETARG_C(ins));
+      DumpVar(ins, D);
+    }
+  }
 }
 
 
@@ -135,7 +147,7 @@ static void DumpProtos (const Proto *f, DumpState *D) {
 
 
 static void DumpUpvalues (const Proto *f, DumpState *D) {
-  int i, n = f->sizeupvalues;
+  int i, n = f->sizeupvalues - f->nbound;  /* (not the bound ones) */
   DumpInt(n, D);
   for (i = 0; i < n; i++) {
     DumpByte(f->upvalues[i].instack, D);
@@ -156,7 +168,7 @@ static void DumpDebug (const Proto *f, DumpState *D) {
     DumpInt(f->locvars[i].startpc, D);
     DumpInt(f->locvars[i].endpc, D);
   }
-  n = (D->strip) ? 0 : f->sizeupvalues;
+  n = (D->strip) ? 0 : f->sizeupvalues - f->nbound;
   DumpInt(n, D);
   for (i = 0; i < n; i++)
     DumpString(f->upvalues[i].name, D);
@@ -181,10 +193,28 @@ static void DumpFunction (const Proto *f, TString *psource, DumpState *D) {
 }
 
 
-static void DumpHeader (DumpState *D) {
+/*
+** Whether 'f' or a function inside it uses opcodes that the official
+** Lua does not have (those after OP_EXTRAARG)
+*/
+static int usesextraops (const Proto *f) {
+  int i;
+  for (i = 0; i < f->sizecode; i++) {
+    if (GET_OPCODE(f->code[i]) > OP_EXTRAARG)
+      return 1;
+  }
+  for (i = 0; i < f->sizep; i++) {
+    if (usesextraops(f->p[i]))
+      return 1;
+  }
+  return 0;
+}
+
+
+static void DumpHeader (const Proto *f, DumpState *D) {
   DumpLiteral(LUA_SIGNATURE, D);
   DumpByte(LUAC_VERSION, D);
-  DumpByte(LUAC_FORMAT, D);
+  DumpByte(usesextraops(f) ? LUAC_FORMATX : LUAC_FORMAT, D);
   DumpLiteral(LUAC_DATA, D);
   DumpByte(sizeof(int), D);
   DumpByte(sizeof(size_t), D);
@@ -207,8 +237,8 @@ int luaU_dump(lua_State *L, const Proto *f, lua_Writer w, void *data,
   D.data = data;
   D.strip = strip;
   D.status = 0;
-  DumpHeader(&D);
-  DumpByte(f->sizeupvalues, &D);
+  DumpHeader(f, &D);
+  DumpByte(f->sizeupvalues - f->nbound, &D);
   DumpFunction(f, NULL, &D);
   return D.status;
 }
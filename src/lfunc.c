@@ -18,7 +18,9 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
+#include "ltable.h"
 
 
 
@@ -31,21 +33,36 @@ CClosure *luaF_newCclosure (lua_State *L, int n) {
 
 
 LClosure *luaF_newLclosure (lua_State *L, int n) {
-  GCObject *o = luaC_newobj(L, LUA_TLCL, sizeLclosure(n));
-  LClosure *c = gco2lcl(o);
+  GCObject *o;
+  LClosure *c;
+  if (n < NCLPOOLS)  /* small closure? */
+    o = luaC_newpooledobj(L, LUA_TLCL, &G(L)->clpool[n], sizeLclosure(n));
+  else
+    o = luaC_newobj(L, LUA_TLCL, sizeLclosure(n));
+  c = gco2lcl(o);
   c->p = NULL;
   c->nupvalues = cast_byte(n);
   while (n--) c->upvals[n] = NULL;
   return c;
 }
 
+UpVal *luaF_newupval (lua_State *L) {
+  return cast(UpVal *, luaM_poolalloc(L, &G(L)->uvpool, sizeof(UpVal)));
+}
+
+
+void luaF_freeupval (lua_State *L, UpVal *uv) {
+  luaM_poolfree(L, &G(L)->uvpool, uv, sizeof(UpVal));
+}
+
+
 /*
 ** fill a closure with new closed upvalues
 */
 void luaF_initupvals (lua_State *L, LClosure *cl) {
   int i;
   for (i = 0; i < cl->nupvalues; i++) {
-    UpVal *uv = luaM_new(L, UpVal);
+    UpVal *uv = luaF_newupval(L);
     uv->refcount = 1;
     uv->v = &uv->u.value;  /* make it closed */
     setnilvalue(uv->v);
@@ -66,7 +83,7 @@ UpVal *luaF_findupval (lua_State *L, StkId level) {
     pp = &p->u.open.next;
   }
   /* not found: create a new upvalue */
-  uv = luaM_new(L, UpVal);
+  uv = luaF_newupval(L);
   uv->refcount = 0;
   uv->u.open.next = *pp;  /* link it to list of open upvalues */
   uv->u.open.touched = 1;
@@ -86,7 +103,7 @@ void luaF_close (lua_State *L, StkId level) {
     lua_assert(upisopen(uv));
     L->openupval = uv->u.open.next;  /* remove from 'open' list */
     if (uv->refcount == 0)  /* no references? */
-      luaM_free(L, uv);  /* free upvalue */
+      luaF_freeupval(L, uv);  /* free upvalue */
     else {
       setobj(L, &uv->u.value, uv->v);  /* move value to upvalue slot */
       uv->v = &uv->u.value;  /* now current value lives here */
@@ -105,6 +122,7 @@ Proto *luaF_newproto (lua_State *L) {
   f->sizep = 0;
   f->code = NULL;
   f->cache = NULL;
+  f->root = NULL;
   f->sizecode = 0;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
@@ -113,6 +131,9 @@ Proto *luaF_newproto (lua_State *L) {
   f->numparams = 0;
   f->is_vararg = 0;
   f->maxstacksize = 0;
+  f->nbound = 0;
+  f->envup = 0;
+  f->kvars = 0;
   f->locvars = NULL;
   f->sizelocvars = 0;
   f->linedefined = 0;
@@ -149,3 +170,176 @@ const char *luaF_getlocalname (const Proto *f, int local_number, int pc) {
   return NULL;  /* not found */
 }
 
+
+/*
+** {======================================================
+** Binding of frozen globals
+** A function reads a frozen global through an extra upvalue, the cell
+** of the global, in place of a 'GETTABUP' on its environment. Cells
+** come after the other upvalues; a 'GETUPVAL' of a cell keeps in 'C'
+** the key of the original instruction, so that 'ldump' can write the
+** function as it was.
+** =======================================================
+*/
+
+/* a function whose globals are being bound */
+typedef struct BindState {
+  Proto *p;
+  int env;  /* upvalue of 'p' with the environment */
+  struct BindState *prev;  /* enclosing function */
+} BindState;
+
+
+/*
+** Upvalue of 'p' with the environment that its enclosing function has
+** in upvalue 'e', or -1
+*/
+static int envupval (Proto *p, int e) {
+  int u;
+  for (u = 0; u < p->sizeupvalues; u++) {
+    if (!p->upvalues[u].instack && p->upvalues[u].idx == e)
+      return u;
+  }
+  return -1;
+}
+
+
+/*
+** Whether 'p' or a function inside it assigns to the environment
+** (upvalue 'e' of 'p')
+*/
+static int envchanged (Proto *p, int e) {
+  int pc, i;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction ins = p->code[pc];
+    if (GET_OPCODE(ins) == OP_SETUPVAL && GETARG_B(ins) == e)
+      return 1;
+  }
+  for (i = 0; i < p->sizep; i++) {
+    int ne = envupval(p->p[i], e);
+    if (ne >= 0 && envchanged(p->p[i], ne))
+      return 1;
+  }
+  return 0;
+}
+
+
+/*
+** Upvalue of the function in 'bs' with the cell of 'key', which is
+** added (to it and to its enclosing functions) if needed; -1 if there
+** is no room for it
+*/
+static int cellupval (lua_State *L, BindState *bs, TString *key) {
+  Proto *p = bs->p;
+  int n = p->sizeupvalues;
+  int u, idx = 0;
+  for (u = n - p->nbound; u < n; u++) {
+    if (p->upvalues[u].name == key)
+      return u;
+  }
+  if (n >= MAXUPVAL ||
+      (bs->prev != NULL && (idx = cellupval(L, bs->prev, key)) < 0))
+    return -1;
+  luaM_reallocvector(L, p->upvalues, n, n + 1, Upvaldesc);
+  p->upvalues[n].name = key;
+  p->upvalues[n].instack = 0;
+  p->upvalues[n].idx = cast_byte(idx);  /* (not used by main function) */
+  p->sizeupvalues = n + 1;
+  p->nbound++;
+  p->envup = cast_byte(bs->env);
+  luaC_objbarrier(L, p, key);
+  return n;
+}
+
+
+static void bindproto (lua_State *L, BindState *bs, Table *env) {
+  Proto *p = bs->p;
+  const BindState *top = bs;
+  int pc, i;
+  while (top->prev != NULL)
+    top = top->prev;
+  p->root = top->p;  /* to unbind the whole chunk (see 'lua_setupvalue') */
+  p->envup = cast_byte(bs->env);
+  luaC_objbarrier(L, p, top->p);
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction ins = p->code[pc];
+    int c = GETARG_C(ins);
+    if (GET_OPCODE(ins) == OP_GETTABUP && GETARG_B(ins) == bs->env &&
+        ISK(c) && ttisshrstring(&p->k[INDEXK(c)])) {
+      TString *key = tsvalue(&p->k[INDEXK(c)]);
+      int u;
+      if (luaH_cell(L, env, key) != NULL && (u = cellupval(L, bs, key)) >= 0)
+        p->code[pc] = CREATE_ABC(OP_GETUPVAL, GETARG_A(ins), u, c);
+    }
+  }
+  for (i = 0; i < p->sizep; i++) {
+    BindState nbs;
+    nbs.p = p->p[i];
+    nbs.env = envupval(nbs.p, bs->env);
+    nbs.prev = bs;
+    if (nbs.env >= 0)
+      bindproto(L, &nbs, env);
+  }
+}
+
+
+/*
+** Bind the reads of frozen globals of 'env' by main function 'cl' (of
+** a new chunk, whose environment will be 'env') and by the functions
+** inside it, unless some of them assigns to '_ENV'. Returns the
+** closure to use instead of 'cl'.
+*/
+LClosure *luaF_bindglobals (lua_State *L, LClosure *cl, Table *env) {
+  Proto *p = cl->p;
+  int n = cl->nupvalues;
+  BindState bs;
+  LClosure *ncl;
+  int i;
+  if (n == 0 || envchanged(p, 0))
+    return cl;
+  bs.p = p;
+  bs.env = 0;
+  bs.prev = NULL;
+  bindproto(L, &bs, env);
+  if (p->nbound == 0)
+    return cl;
+  ncl = luaF_newLclosure(L, p->sizeupvalues);
+  ncl->p = p;
+  for (i = 0; i < p->sizeupvalues; i++) {
+    UpVal *uv = (i < n) ? cl->upvals[i]
+                        : luaH_cell(L, env, p->upvalues[i].name);
+    uv->refcount++;
+    ncl->upvals[i] = uv;
+  }
+  return ncl;
+}
+
+
+/*
+** Undo the binding of 'p' and of the functions inside it, when the
+** environment of its chunk ('p' is the main function) changes to
+** another table: the reads of frozen globals go back to 'GETTABUP' and
+** the cells leave the upvalues of the prototypes. (Closures already
+** created keep the cells after their other upvalues, unused.)
+*/
+void luaF_unbindglobals (lua_State *L, Proto *p) {
+  int first = p->sizeupvalues - p->nbound;  /* first bound upvalue */
+  int pc, i;
+  if (p->nbound == 0)
+    return;
+  for (pc = 0; pc < p->sizecode; pc++) {
+    Instruction ins = p->code[pc];
+    if (GET_OPCODE(ins) == OP_GETUPVAL && GETARG_B(ins) >= first)
+      p->code[pc] = CREATE_ABC(OP_GETTABUP, GETARG_A(ins), p->envup,
+                                            GETARG_C(ins));
+  }
+  luaM_reallocvector(L, p->upvalues, p->sizeupvalues, first, Upvaldesc);
+  p->sizeupvalues = first;
+  p->nbound = 0;
+  p->envup = 0;
+  for (i = 0; i < p->sizep; i++)
+    luaF_unbindglobals(L, p->p[i]);
+}
+
+/* }====================================================== */
+
@@ -193,12 +193,14 @@ void luaC_upvalbarrier_ (lua_State *L, UpVal *uv) {
 
 void luaC_fix (lua_State *L, GCObject *o) {
   global_State *g = G(L);
-  // ֻ obj ԱΪ fix
+  if (isshared(o))  /* shared strings are already never collected */
+    return;
+  // 只有最近创建的 obj 可以被设置为 fix
   lua_assert(g->allgc == o);  /* object must be 1st in 'allgc' list! */
   white2gray(o);  /* they will be gray forever */
-  //  allgc ɾ
+  // 从 allgc 中删除
   g->allgc = o->next;  /* remove object from 'allgc' list */
-  // ӵ fixedgc 
+  // 添加到 fixedgc 链表
   o->next = g->fixedgc;  /* link it to 'fixedgc' list */
   g->fixedgc = o;
 }
@@ -207,18 +209,32 @@ void luaC_fix (lua_State *L, GCObject *o) {
 /*
 ** create a new collectable object (with given type and size) and link
 ** it to 'allgc' list.
-** һԱgcĶ󣬲ӵallgc 
+** 创建一个可以被gc的对象，并添加到allgc 链表中
 */
 GCObject *luaC_newobj (lua_State *L, int tt, size_t sz) {
-  // ȫֱ
+  // 获得全局表
   global_State *g = G(L);
-  // ڴ
+  // 请求内存
   GCObject *o = cast(GCObject *, luaM_newobject(L, novariant(tt), sz));
-  // marked ־ òƺ״̬й
+  // marked 这个标志 貌似和这个对象的状态有关
+  o->marked = luaC_white(g);
+  // 设置类型
+  o->tt = tt;
+  // 将新分配的对象加入 可gc对象链表
+  o->next = g->allgc;
+  g->allgc = o;
+  return o;
+}
+
+
+/*
+** same as 'luaC_newobj', but takes the memory from the given pool
+*/
+GCObject *luaC_newpooledobj (lua_State *L, int tt, void **pool, size_t sz) {
+  global_State *g = G(L);
+  GCObject *o = cast(GCObject *, luaM_poolalloc(L, pool, sz));
   o->marked = luaC_white(g);
-  // 
   o->tt = tt;
-  // ·Ķ gc
   o->next = g->allgc;
   g->allgc = o;
   return o;
@@ -302,6 +318,19 @@ static void markmt (global_State *g) {
 }
 
 
+/*
+** mark the keys of frozen globals (which their tables may not keep)
+*/
+static void markfrozen (global_State *g) {
+  Frozen *fz;
+  int i;
+  for (fz = g->frozen; fz != NULL; fz = fz->next) {
+    for (i = 0; i < fz->nkeys; i++)
+      markobject(g, fz->keys[i].key);
+  }
+}
+
+
 /*
 ** mark all objects in list of being-finalized
 */
@@ -490,6 +519,7 @@ static int traverseproto (global_State *g, Proto *f) {
   if (f->cache && iswhite(f->cache))
     f->cache = NULL;  /* allow cache to be collected */
   markobjectN(g, f->source);
+  markobjectN(g, f->root);
   for (i = 0; i < f->sizek; i++)  /* mark literals */
     markvalue(g, &f->k[i]);
   for (i = 0; i < f->sizeupvalues; i++)  /* mark upvalue names */
@@ -554,8 +584,10 @@ static lu_mem traversethread (global_State *g, lua_State *th) {
       g->twups = th;
     }
   }
+#if !defined(LUA_USE_THREADS)  /* else its OS thread may be reading it */
   else if (g->gckind != KGC_EMERGENCY)
     luaD_shrinkstack(th); /* do not change stack in emergency cycle */
+#endif
   return (sizeof(lua_State) + sizeof(TValue) * th->stacksize +
           sizeof(CallInfo) * th->nci);
 }
@@ -687,18 +719,22 @@ void luaC_upvdeccount (lua_State *L, UpVal *uv) {
   lua_assert(uv->refcount > 0);
   uv->refcount--;
   if (uv->refcount == 0 && !upisopen(uv))
-    luaM_free(L, uv);
+    luaF_freeupval(L, uv);
 }
 
 
 static void freeLclosure (lua_State *L, LClosure *cl) {
+  int n = cl->nupvalues;
   int i;
-  for (i = 0; i < cl->nupvalues; i++) {
+  for (i = 0; i < n; i++) {
     UpVal *uv = cl->upvals[i];
     if (uv)
       luaC_upvdeccount(L, uv);
   }
-  luaM_freemem(L, cl, sizeLclosure(cl->nupvalues));
+  if (n < NCLPOOLS)  /* small closure? */
+    luaM_poolfree(L, &G(L)->clpool[n], cl, sizeLclosure(n));
+  else
+    luaM_freemem(L, cl, sizeLclosure(n));
 }
 
 
@@ -809,31 +845,57 @@ static GCObject *udata2finalize (global_State *g) {
 }
 
 
-static void dothecall (lua_State *L, void *ud) {
-  UNUSED(ud);
-  luaD_callnoyield(L, L->top - 2, 0);
+/*
+** Calls the finalizers of up to 'n' objects from 'tobefnz'. All calls
+** run inside this single protected call, so a batch pays for one
+** 'setjmp' and one save of hooks and GC state, not one per object.
+*/
+typedef struct FinBatch {
+  unsigned int n;  /* maximum number of objects to finalize */
+  unsigned int done;  /* objects already taken from 'tobefnz' */
+} FinBatch;
+
+
+static void dofinalizers (lua_State *L, void *ud) {
+  global_State *g = G(L);
+  FinBatch *b = cast(FinBatch *, ud);
+  while (g->tobefnz && b->done < b->n) {
+    const TValue *tm;
+    TValue v;
+    b->done++;  /* counts even if its finalizer raises an error */
+    setgcovalue(L, &v, udata2finalize(g));
+    tm = luaT_gettmbyobj(L, &v, TM_GC);
+    if (tm != NULL && ttisfunction(tm)) {  /* is there a finalizer? */
+      setobj2s(L, L->top, tm);  /* push finalizer... */
+      setobj2s(L, L->top + 1, &v);  /* ... and its argument */
+      L->top += 2;  /* and (next line) call the finalizer */
+      luaD_callnoyield(L, L->top - 2, 0);
+    }
+  }
 }
 
 
-static void GCTM (lua_State *L, int propagateerrors) {
+/*
+** Finalizes up to 'n' objects; returns how many it took from
+** 'tobefnz'. An error in a finalizer ends the batch; the objects not
+** yet finalized stay in 'tobefnz'.
+*/
+static unsigned int callfinalizers (lua_State *L, unsigned int n,
+                                    int propagateerrors) {
   global_State *g = G(L);
-  const TValue *tm;
-  TValue v;
-  setgcovalue(L, &v, udata2finalize(g));
-  tm = luaT_gettmbyobj(L, &v, TM_GC);
-  if (tm != NULL && ttisfunction(tm)) {  /* is there a finalizer? */
-    int status;
-    lu_byte oldah = L->allowhook;
-    int running  = g->gcrunning;
-    L->allowhook = 0;  /* stop debug hooks during GC metamethod */
-    g->gcrunning = 0;  /* avoid GC steps */
-    setobj2s(L, L->top, tm);  /* push finalizer... */
-    setobj2s(L, L->top + 1, &v);  /* ... and its argument */
-    L->top += 2;  /* and (next line) call the finalizer */
-    status = luaD_pcall(L, dothecall, NULL, savestack(L, L->top - 2), 0);
-    L->allowhook = oldah;  /* restore hooks */
-    g->gcrunning = running;  /* restore state */
-    if (status != LUA_OK && propagateerrors) {  /* error while running __gc? */
+  int status;
+  FinBatch b;
+  lu_byte oldah = L->allowhook;
+  int running  = g->gcrunning;
+  b.n = n;
+  b.done = 0;
+  L->allowhook = 0;  /* stop debug hooks during GC metamethod */
+  g->gcrunning = 0;  /* avoid GC steps */
+  status = luaD_pcall(L, dofinalizers, &b, savestack(L, L->top), 0);
+  L->allowhook = oldah;  /* restore hooks */
+  g->gcrunning = running;  /* restore state */
+  if (status != LUA_OK) {  /* error while running __gc? */
+    if (propagateerrors) {
       if (status == LUA_ERRRUN) {  /* is there an error object? */
         const char *msg = (ttisstring(L->top - 1))
                             ? svalue(L->top - 1)
@@ -843,22 +905,27 @@ static void GCTM (lua_State *L, int propagateerrors) {
       }
       luaD_throw(L, status);  /* re-throw error */
     }
+    L->top--;  /* remove error object */
   }
+  return b.done;
 }
 
 
 /*
-** call a few (up to 'g->gcfinnum') finalizers
+** call a few (up to 'g->gcfinnum', but no more than 'g->gcfinmax')
+** finalizers
 */
 static int runafewfinalizers (lua_State *L) {
   global_State *g = G(L);
-  unsigned int i;
+  unsigned int n = (g->gcfinnum < g->gcfinmax) ? g->gcfinnum : g->gcfinmax;
+  unsigned int i = 0;
   lua_assert(!g->tobefnz || g->gcfinnum > 0);
-  for (i = 0; g->tobefnz && i < g->gcfinnum; i++)
-    GCTM(L, 1);  /* call one finalizer */
+  if (g->tobefnz && n > 0)
+    i = callfinalizers(L, n, 1);
   g->gcfinnum = (!g->tobefnz) ? 0  /* nothing more to finalize? */
-                    : g->gcfinnum * 2;  /* else call a few more next time */
-  return i;
+                : (g->gcfinnum < g->gcfinmax) ? g->gcfinnum * 2
+                : g->gcfinnum;  /* else call a few more next time */
+  return cast_int(i);
 }
 
 
@@ -868,7 +935,20 @@ static int runafewfinalizers (lua_State *L) {
 static void callallpendingfinalizers (lua_State *L, int propagateerrors) {
   global_State *g = G(L);
   while (g->tobefnz)
-    GCTM(L, propagateerrors);
+    callfinalizers(L, UINT_MAX, propagateerrors);
+}
+
+
+/*
+** Finalizes up to 'n' pending objects ('n' <= 0 means all of them) for
+** hosts that drain the finalizer queue themselves; returns how many
+** objects it finalized.
+*/
+int luaC_runfinalizers (lua_State *L, int n) {
+  global_State *g = G(L);
+  if (g->tobefnz == NULL) return 0;
+  return cast_int(callfinalizers(L, (n > 0) ? cast(unsigned int, n)
+                                            : cast(unsigned int, MAX_INT), 1));
 }
 
 
@@ -976,12 +1056,19 @@ static int entersweep (lua_State *L) {
 }
 
 
-void luaC_freeallobjects (lua_State *L) {
+/* call the finalizers of all objects, as when closing the state */
+void luaC_callallfinalizers (lua_State *L) {
   global_State *g = G(L);
   separatetobefnz(g, 1);  /* separate all objects with finalizers */
   lua_assert(g->finobj == NULL);
   callallpendingfinalizers(L, 0);
   lua_assert(g->tobefnz == NULL);
+}
+
+
+void luaC_freeallobjects (lua_State *L) {
+  global_State *g = G(L);
+  luaC_callallfinalizers(L);
   g->currentwhite = WHITEBITS; /* this "white" makes all objects look dead */
   g->gckind = KGC_NORMAL;
   sweepwholelist(L, &g->finobj);
@@ -1004,6 +1091,7 @@ static l_mem atomic (lua_State *L) {
   /* registry and global metatables may be changed by API */
   markvalue(g, &g->l_registry);
   markmt(g);  /* mark global metatables */
+  markfrozen(g);
   /* remark occasional upvalues of (maybe) dead threads */
   remarkupvals(g);
   propagateall(g);  /* propagate changes */
@@ -1092,11 +1180,13 @@ static lu_mem singlestep (lua_State *L) {
     case GCSswpend: {  /* finish sweeps */
       makewhite(g, g->mainthread);  /* sweep main thread */
       checkSizes(L, g);
+      /* release pooled memory (all of it in an emergency) */
+      luaE_trimpools(L, g->gckind == KGC_EMERGENCY);
       g->gcstate = GCScallfin;
       return 0;
     }
-    case GCScallfin: {  /* call remaining finalizers */
-      if (g->tobefnz && g->gckind != KGC_EMERGENCY) {
+    case GCScallfin: {  /* call remaining finalizers (unless left to host) */
+      if (g->tobefnz && g->gckind != KGC_EMERGENCY && g->gcfinmax > 0) {
         int n = runafewfinalizers(L);
         return (n * GCFINALIZECOST);
       }
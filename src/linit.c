@@ -28,6 +28,7 @@
 
 
 #include <stddef.h>
+#include <string.h>
 
 #include "lua.h"
 
@@ -57,16 +58,170 @@ static const luaL_Reg loadedlibs[] = {
 };
 
 
-LUALIB_API void luaL_openlibs (lua_State *L) {
+/*
+** C modules linked into the program, which 'require' finds (through
+** 'luaL_getstaticlib') without entries in 'package.preload'. A module
+** is opened only when first required. Other modules linked into the
+** program may be added here (by hand or by the build), keeping the
+** table sorted by name.
+*/
+static const luaL_Reg staticlibs[] = {
+#if defined(LUA_COMPAT_BITLIB)
+  {LUA_BITLIBNAME, luaopen_bit32},
+#endif
+  {LUA_COLIBNAME, luaopen_coroutine},
+  {LUA_DBLIBNAME, luaopen_debug},
+  {LUA_IOLIBNAME, luaopen_io},
+  {LUA_MATHLIBNAME, luaopen_math},
+  {LUA_OSLIBNAME, luaopen_os},
+#if defined(LUA_USE_TASKLIB)
+  {LUA_PARALLELLIBNAME, luaopen_parallel},
+#endif
+  {LUA_STRLIBNAME, luaopen_string},
+  {LUA_TABLIBNAME, luaopen_table},
+#if defined(LUA_USE_TASKLIB)
+  {LUA_TASKLIBNAME, luaopen_task},
+#endif
+  {LUA_UTF8LIBNAME, luaopen_utf8}
+};
+
+
+LUALIB_API lua_CFunction luaL_getstaticlib (const char *name) {
+  size_t lo = 0;
+  size_t hi = sizeof(staticlibs)/sizeof(staticlibs[0]);
+  while (lo < hi) {  /* binary search */
+    size_t m = lo + (hi - lo) / 2;
+    int cmp = strcmp(name, staticlibs[m].name);
+    if (cmp == 0) return staticlibs[m].func;
+    else if (cmp < 0) hi = m;
+    else lo = m + 1;
+  }
+  return NULL;  /* not linked into the program */
+}
+
+
+/*
+** {======================================================
+** Lazy opening
+** Each library global starts as an empty stub whose metatable has the
+** library name in '__name'. Indexing, assigning to, or traversing a
+** stub opens the library (through 'luaL_getstaticlib'), sets the global
+** to the library, and makes the stub forward to it.
+** =======================================================
+*/
+
+/*
+** open the library of the stub at index 1, leaving it on the top
+*/
+static void openstub (lua_State *L) {
+  const char *name;
+  lua_getmetatable(L, 1);
+  lua_getfield(L, -1, "__name");
+  name = lua_tostring(L, -1);
+  luaL_requiref(L, name, luaL_getstaticlib(name), 0);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -4, "__index");  /* stub forwards to the library */
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -4, "__newindex");
+  if (lua_getglobal(L, name) != LUA_TNIL && lua_rawequal(L, -1, 1)) {
+    lua_pushvalue(L, -2);
+    lua_setglobal(L, name);  /* global still is the stub: replace it */
+  }
+  lua_pop(L, 1);  /* remove global */
+  lua_insert(L, -3);  /* move library below metatable and name */
+  lua_pop(L, 2);
+}
+
+
+static int stub_index (lua_State *L) {
+  openstub(L);
+  lua_pushvalue(L, 2);
+  lua_gettable(L, -2);
+  return 1;
+}
+
+
+static int stub_newindex (lua_State *L) {
+  openstub(L);
+  lua_pushvalue(L, 2);
+  lua_pushvalue(L, 3);
+  lua_settable(L, -3);
+  return 0;
+}
+
+
+static int stub_next (lua_State *L) {
+  lua_settop(L, 2);
+  if (lua_next(L, 1))
+    return 2;
+  lua_pushnil(L);
+  return 1;
+}
+
+
+static int stub_pairs (lua_State *L) {
+  openstub(L);
+  lua_pushcfunction(L, stub_next);
+  lua_insert(L, -2);
+  lua_pushnil(L);
+  return 3;
+}
+
+
+static void newstub (lua_State *L, const char *name) {
+  lua_newtable(L);  /* stub */
+  lua_createtable(L, 0, 4);  /* its metatable */
+  lua_pushstring(L, name);
+  lua_setfield(L, -2, "__name");
+  lua_pushcfunction(L, stub_index);
+  lua_setfield(L, -2, "__index");
+  lua_pushcfunction(L, stub_newindex);
+  lua_setfield(L, -2, "__newindex");
+  lua_pushcfunction(L, stub_pairs);
+  lua_setfield(L, -2, "__pairs");
+  lua_setmetatable(L, -2);
+  if (strcmp(name, LUA_STRLIBNAME) == 0) {  /* string methods also open it */
+    lua_pushliteral(L, "");  /* dummy string */
+    lua_createtable(L, 0, 1);  /* temporary metatable for strings */
+    lua_pushvalue(L, -3);
+    lua_setfield(L, -2, "__index");
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);  /* pop dummy string */
+  }
+  lua_setglobal(L, name);
+}
+
+/* }====================================================== */
+
+
+static void openlibs (lua_State *L, int lazy) {
   const luaL_Reg *lib;
   /* "require" functions from 'loadedlibs' and set results to global table */
-  /*  ڽ */
+  /* 引入 内建 库*/
   for (lib = loadedlibs; lib->func; lib++) {
+    if (lazy && luaL_getstaticlib(lib->name) == lib->func)
+      newstub(L, lib->name);
+    else {
 	// top
 	//  lastload lib
-    luaL_requiref(L, lib->name, lib->func, 1);
+      luaL_requiref(L, lib->name, lib->func, 1);
 	// top
-    lua_pop(L, 1);  /* remove lib */
+      lua_pop(L, 1);  /* remove lib */
+    }
   }
 }
 
+
+LUALIB_API void luaL_openlibs (lua_State *L) {
+  openlibs(L, 0);
+}
+
+
+/*
+** Like 'luaL_openlibs', but each library other than the basic and the
+** package ones is opened only when the program first uses it.
+*/
+LUALIB_API void luaL_openlazylibs (lua_State *L) {
+  openlibs(L, 1);
+}
+
@@ -28,11 +28,11 @@
 #include "lzio.h"
 
 
-// ȡһַ浽 ls->current
+// 读取下一个字符，并保存到 ls->current
 #define next(ls) (ls->current = zgetc(ls->z))
 
 
-// ⵱ǰַǷǻз
+// 检测当前字符，是否是换行符
 #define currIsNewline(ls)	(ls->current == '\n' || ls->current == '\r')
 
 
@@ -54,20 +54,20 @@ static const char *const luaX_tokens [] = {
 static l_noret lexerror (LexState *ls, const char *msg, int token);
 
 
-//  ls д洢ַ c һ ls->current
+// 在 ls 中存储字符 c， 一般来自 ls->current
 static void save (LexState *ls, int c) {
-  // ȡbuff
+  // 获取buff
   Mbuffer *b = ls->buff;
-  // ʣռ
+  // 检测剩余空间
   if (luaZ_bufflen(b) + 1 > luaZ_sizebuffer(b)) {
-	// ռ䲻
+	// 空间不够，申请
     size_t newsize;
     if (luaZ_sizebuffer(b) >= MAX_SIZE/2)
       lexerror(ls, "lexical element too long", 0);
     newsize = luaZ_sizebuffer(b) * 2;
     luaZ_resizebuffer(ls->L, b, newsize);
   }
-  // ¼
+  // 记录
   b->buffer[luaZ_bufflen(b)++] = cast(char, c);
 }
 
@@ -76,13 +76,15 @@ void luaX_init (lua_State *L) {
   int i;
   TString *e = luaS_newliteral(L, LUA_ENV);  /* create env name */
 
-  // gc
+  // 不可gc
   luaC_fix(L, obj2gco(e));  /* never collect this name */
-  // ʼ tokenַ־û
+  // 初始化 token字符串，并持久化
   for (i=0; i<NUM_RESERVED; i++) {
     TString *ts = luaS_new(L, luaX_tokens[i]);
     luaC_fix(L, obj2gco(ts));  /* reserved words are never collected */
-    ts->extra = cast_byte(i+1);  /* reserved word */
+    if (!isshared(ts))  /* shared strings are read-only (and already set) */
+      ts->extra = cast_byte(i+1);  /* reserved word */
+    lua_assert(ts->extra == i+1);
   }
 }
 
@@ -104,7 +106,9 @@ const char *luaX_token2str (LexState *ls, int token) {
 
 static const char *txtToken (LexState *ls, int token) {
   switch (token) {
-    case TK_NAME: case TK_STRING:
+    case TK_NAME:  /* (names may be scanned in place, out of the buffer) */
+      return luaO_pushfstring(ls->L, "'%s'", getstr(ls->t.seminfo.ts));
+    case TK_STRING:
     case TK_FLT: case TK_INT:
       save(ls, '\0');
       return luaO_pushfstring(ls->L, "'%s'", luaZ_buffer(ls->buff));
@@ -159,11 +163,11 @@ TString *luaX_newstring (LexState *ls, const char *str, size_t l) {
 static void inclinenumber (LexState *ls) {
   int old = ls->current;
   lua_assert(currIsNewline(ls));
-  // ȡһַ
+  // 读取下一个字符
   next(ls);  /* skip '\n' or '\r' */
   if (currIsNewline(ls) && ls->current != old)
     next(ls);  /* skip '\n\r' or '\r\n' */
-  // 
+  // 检测行数
   if (++ls->linenumber >= MAX_INT)
     lexerror(ls, "chunk has too many lines", 0);
 }
@@ -187,6 +191,117 @@ void luaX_setinput (lua_State *L, LexState *ls, ZIO *z, TString *source,
 
 
 
+/*
+** {======================================================
+** Scanning in place
+** The current character is always the last one read from the input
+** buffer ('z->p[-1]'), so runs of characters that start with it can be
+** scanned right there instead of one by one through 'next' and 'save'.
+** =======================================================
+*/
+
+/* perfect hash of reserved words (with 2 to 8 characters) */
+#define kwhash(s,l)  \
+	((cast_uchar((s)[0]) + 30 * cast_uchar((s)[(l) - 1]) + 2 * (l)) & 63)
+
+/* reserved word (index plus 1) with each 'kwhash'; ORDER RESERVED */
+static const lu_byte kwslot[64] = {
+   0,  0,  0,  4,  0,  0,  7,  0,  8,  0,  0,  0, 15,  0,  0, 16,
+   0, 12, 20,  0,  0,  0, 17, 22,  0,  0,  9,  0, 14,  0, 13,  1,
+  19, 11, 18,  6,  0,  5,  0, 21,  0,  0,  3,  0,  0,  0,  0,  0,
+   0, 10,  0,  0,  0,  0,  2,  0,  0,  0,  0,  0,  0,  0,  0,  0
+};
+
+
+/* token of reserved word 's' (with length 'l'), or 0 if it is a name */
+static int reservedword (const char *s, size_t l) {
+  if (2 <= l && l <= 8) {
+    int r = kwslot[kwhash(s, l)];
+    if (r != 0 && strncmp(luaX_tokens[r - 1], s, l) == 0 &&
+        luaX_tokens[r - 1][l] == '\0')
+      return r - 1 + FIRST_RESERVED;
+  }
+  return 0;
+}
+
+
+/* save the 'l' characters at 's' */
+static void savelstr (LexState *ls, const char *s, size_t l) {
+  Mbuffer *b = ls->buff;
+  if (luaZ_bufflen(b) + l > luaZ_sizebuffer(b)) {
+    size_t newsize = luaZ_sizebuffer(b);
+    do {
+      if (newsize >= MAX_SIZE/2)
+        lexerror(ls, "lexical element too long", 0);
+      newsize *= 2;
+    } while (luaZ_bufflen(b) + l > newsize);
+    luaZ_resizebuffer(ls->L, b, newsize);
+  }
+  memcpy(b->buffer + luaZ_bufflen(b), s, l);
+  luaZ_bufflen(b) += l;
+}
+
+
+/* skip the current character and the 'n' ones after it in the buffer */
+static void skipinput (LexState *ls, size_t n) {
+  ls->z->p += n;
+  ls->z->n -= n;
+  next(ls);
+}
+
+
+/* 'l' gets the length of the run of characters in the buffer after the
+   current one (each in 'c') for which 'cond' holds */
+#define inputrun(ls,l,cond)  do { \
+  const char *p_ = (ls)->z->p; size_t m_ = (ls)->z->n; int c; \
+  for ((l) = 0; (l) < m_ && (c = cast_uchar(p_[l]), (cond)); (l)++) {} \
+  } while (0)
+
+
+/* save the current character and the run after it for which 'cond' holds */
+#define saverun(ls,cond)  do { size_t n_; \
+  lua_assert(cast_uchar((ls)->z->p[-1]) == (ls)->current); \
+  inputrun(ls, n_, cond); \
+  savelstr(ls, (ls)->z->p - 1, n_ + 1); \
+  skipinput(ls, n_); } while (0)
+
+
+/* skip the current character and the run after it for which 'cond' holds */
+#define skiprun(ls,cond)  do { size_t n_; \
+  inputrun(ls, n_, cond); \
+  skipinput(ls, n_); } while (0)
+
+
+/*
+** Read a name or a reserved word. Unless the name goes on in the next
+** buffer, it is not saved, and reserved words are not even interned.
+*/
+static int read_name (LexState *ls, SemInfo *seminfo) {
+  const char *s = ls->z->p - 1;  /* name starts with current character */
+  size_t n;
+  int tk;
+  lua_assert(cast_uchar(*s) == ls->current);
+  inputrun(ls, n, lislalnum(c));
+  if (n < ls->z->n)  /* name ends inside the buffer? */
+    skipinput(ls, n);  /* (does not refill the buffer) */
+  else {  /* go on as usual */
+    savelstr(ls, s, n + 1);
+    skipinput(ls, n);
+    while (lislalnum(ls->current))
+      save_and_next(ls);
+    s = luaZ_buffer(ls->buff);
+    n = luaZ_bufflen(ls->buff) - 1;
+  }
+  if ((tk = reservedword(s, n + 1)) != 0)
+    return tk;
+  seminfo->ts = luaX_newstring(ls, s, n + 1);
+  return TK_NAME;
+}
+
+/* }====================================================== */
+
+
+
 /*
 ** =======================================================
 ** LEXICAL ANALYZER
@@ -262,10 +377,8 @@ static int read_numeral (LexState *ls, SemInfo *seminfo) {
   for (;;) {
     if (check_next2(ls, expo))  /* exponent part? */
       check_next2(ls, "-+");  /* optional exponent sign */
-    if (lisxdigit(ls->current))
-      save_and_next(ls);
-    else if (ls->current == '.')
-      save_and_next(ls);
+    if (lisxdigit(ls->current) || ls->current == '.')
+      saverun(ls, (lisxdigit(c) || c == '.') && c != expo[0] && c != expo[1]);
     else break;
   }
   save(ls, '\0');
@@ -289,17 +402,17 @@ static int read_numeral (LexState *ls, SemInfo *seminfo) {
 ** its number of '='s; otherwise, return a negative number (-1 iff there
 ** are no '='s after initial bracket)
 */
-// [=====[    ]=======]
+// [=====[  或者  ]=======]
 // [===[  return 3
 // ]====] return 4
 // [[ & ]] return 0
-// ûУ򷵻 -1
+// 如果没有，则返回 -1
 static int skip_sep (LexState *ls) {
   int count = 0;
   int s = ls->current;
   lua_assert(s == '[' || s == ']');
   save_and_next(ls);
-  // count ==  [   ] ֮ '=' 
+  // count == 两个 [ 或者 两个 ] 之间的 '=' 的数量
   while (ls->current == '=') {
     save_and_next(ls);
     count++;
@@ -310,7 +423,7 @@ static int skip_sep (LexState *ls) {
 
 static void read_long_string (LexState *ls, SemInfo *seminfo, int sep) {
   int line = ls->linenumber;  /* initial line (for error message) */
-  //  ls->current ָڶ [
+  // 现在 ls->current 指向第二个 [
   save_and_next(ls);  /* skip 2nd '[' */
   // --[[
   //		233
@@ -320,7 +433,7 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, int sep) {
   for (;;) {
     switch (ls->current) {
       case EOZ: {  /* error */
-		// 쳣
+		// 异常
         const char *what = (seminfo ? "string" : "comment");
         const char *msg = luaO_pushfstring(ls->L,
                      "unfinished long %s (starting at line %d)", what, line);
@@ -328,7 +441,7 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, int sep) {
         break;  /* to avoid warnings */
       }
       case ']': {
-		// ȷƥ䣬  [==[  ƥ ]==]
+		// 确保匹配，  [==[  匹配 ]==]
         if (skip_sep(ls) == sep) {
           save_and_next(ls);  /* skip 2nd ']' */
           goto endloop;
@@ -336,20 +449,20 @@ static void read_long_string (LexState *ls, SemInfo *seminfo, int sep) {
         break;
       }
       case '\n': case '\r': {
-		// ƥ任 зжط
+		// 匹配换行 换行符可能有多重风格
         save(ls, '\n');
         inclinenumber(ls);
-		// ע͵Ļֱbuff
+		// 如果是注释的话，直接清空buff
         if (!seminfo) luaZ_resetbuffer(ls->buff);  /* avoid wasting space */
         break;
       }
       default: {
-		//  seminfo Ϊ long stringΪ comment
+		// 有 seminfo 为 long string，否则为 comment
         if (seminfo) save_and_next(ls);
         else next(ls);
       }
     }
-  } endloop: // ıȡ󴴽ַ
+  } endloop: // 文本，读取后创建字符串对象
   if (seminfo)
     seminfo->ts = luaX_newstring(ls, luaZ_buffer(ls->buff) + (2 + sep),
                                      luaZ_bufflen(ls->buff) - 2*(2 + sep));
@@ -418,7 +531,7 @@ static int readdecesc (LexState *ls) {
   return r;
 }
 
-// ȡַ
+// 读取字符串
 static void read_string (LexState *ls, int del, SemInfo *seminfo) {
   save_and_next(ls);  /* keep delimiter (for error messages) */
   while (ls->current != del) {
@@ -428,11 +541,11 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
         break;  /* to avoid warnings */
       case '\n':
       case '\r':
-		// ͨ "" '' ַУ\n ֻ תַ '\'  'n'
+		// 普通的 "" '' 字符串中，不能有\n， 只能是 转移字符 '\' 和 'n'
         lexerror(ls, "unfinished string", TK_STRING);
         break;  /* to avoid warnings */
       case '\\': {  /* escape sequences */
-		// ת
+		// 转义
         int c;  /* final character to be saved */
         save_and_next(ls);  /* keep '\\' for error messages */
         switch (ls->current) {
@@ -443,7 +556,7 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
           case 'r': c = '\r'; goto read_save;
           case 't': c = '\t'; goto read_save;
           case 'v': c = '\v'; goto read_save;
-		  //  \x023  ַ
+		  //  \x023  字符
           case 'x': c = readhexaesc(ls); goto read_save;
           case 'u': utf8esc(ls);  goto no_save;
           case '\n': case '\r':
@@ -476,7 +589,7 @@ static void read_string (LexState *ls, int del, SemInfo *seminfo) {
        no_save: break;
       }
       default:
-        save_and_next(ls);
+        saverun(ls, c != del && c != '\\' && c != '\n' && c != '\r');
     }
   }
   save_and_next(ls);  /* skip delimiter */
@@ -490,64 +603,64 @@ static int llex (LexState *ls, SemInfo *seminfo) {
   for (;;) {
     switch (ls->current) {
       case '\n': case '\r': {  /* line breaks */
-		// з
+		// 跳过换行符
         inclinenumber(ls);
         break;
       }
       case ' ': case '\f': case '\t': case '\v': {  /* spaces */
-		// հַ
-        next(ls);
+		// 跳过空白字符
+        skiprun(ls, c == ' ' || c == '\t' || c == '\f' || c == '\v');
         break;
       }
       case '-': {  /* '-' or '--' (comment) */
-		// -  --
-		// һ -
+		// - 或者 --
+		// 跳过第一个 -
         next(ls);
-		//  -
+		// 单 -
         if (ls->current != '-') return '-';
         /* else is a comment */
-		// --  ע
+		// --  注释
         next(ls);
         if (ls->current == '[') {  /* long comment? */
 		  // --[[ 233 ]]
           int sep = skip_sep(ls);
           luaZ_resetbuffer(ls->buff);  /* 'skip_sep' may dirty the buffer */
           if (sep >= 0) {
-			// ȷʵǳעͣ
+			// 确实是长注释，并跳过
             read_long_string(ls, NULL, sep);  /* skip long comment */
-			//  buff
+			// 清除 buff
             luaZ_resetbuffer(ls->buff);  /* previous call may dirty the buff. */
             break;
           }
         }
         /* else short comment */
-		// ע 
+		// 短注释 
 		// -- 2333
         while (!currIsNewline(ls) && ls->current != EOZ)
-          next(ls);  /* skip until end of line (or end of file) */
+          skiprun(ls, c != '\n' && c != '\r');  /* skip until end of line */
         break;
       }
       case '[': {  /* long string or simply '[' */
-		// a = [[ ˵ɶ,
-		//        
+		// a = [[ 你说啥,
+		//        我听不见
 		// ]]
         int sep = skip_sep(ls);
         if (sep >= 0) {
-		  // ӣȡ
+		  // 长句子，读取
           read_long_string(ls, seminfo, sep);
           return TK_STRING;
         }
-		// Ҳ [== ڶ [
+		// 找不到 [== 第二个 [
         else if (sep != -1)  /* '[=...' missing second bracket */
           lexerror(ls, "invalid long string delimiter", TK_STRING);
-		// ֻһ [
+		// 只是一个单纯的 [
         return '[';
       }
       case '=': {
         next(ls);
-		//  ==
+		// 检测 ==
         if (check_next1(ls, '=')) return TK_EQ;
-        else return '='; // ֻһ =
+        else return '='; // 只是一个 =
       }
       case '<': {
         next(ls);
@@ -589,7 +702,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         else return ':';
       }
       case '"': case '\'': {  /* short literal strings */
-		// "   '
+		// " 或者  '
         read_string(ls, ls->current, seminfo);
         return TK_STRING;
       }
@@ -608,7 +721,7 @@ static int llex (LexState *ls, SemInfo *seminfo) {
       }
       case '0': case '1': case '2': case '3': case '4':
       case '5': case '6': case '7': case '8': case '9': {
-		// ȡ һ
+		// 读取 一个数字
         return read_numeral(ls, seminfo);
       }
       case EOZ: {
@@ -616,29 +729,11 @@ static int llex (LexState *ls, SemInfo *seminfo) {
         return TK_EOS;
       }
       default: {
-		// ͨ ַ ֻǱʶ  ؼ
-        if (lislalpha(ls->current)) {  /* identifier or reserved word? */
-		  // ȡַ ɴӡַ  0-9
-          TString *ts;
-          do {
-            save_and_next(ls);
-          } while (lislalnum(ls->current));
-		  // תΪ lua 
-          ts = luaX_newstring(ls, luaZ_buffer(ls->buff),
-                                  luaZ_bufflen(ls->buff));
-		  // 浽 seminfo 
-          seminfo->ts = ts;
-		  // жǷǹؼ
-          if (isreserved(ts))  /* reserved word? */
-			// תΪؼֵ TOKEN
-            return ts->extra - 1 + FIRST_RESERVED;
-          else {
-			// ʶ
-            return TK_NAME;
-          }
-        }
+		// 普通的 字符， 只能是标识符 或者 关键字
+        if (lislalpha(ls->current))  /* identifier or reserved word? */
+          return read_name(ls, seminfo);
         else {  /* single-char tokens (+ - / ...) */
-		  // ַ token
+		  // 单字符 token
           int c = ls->current;
           next(ls);
           return c;
@@ -650,14 +745,14 @@ static int llex (LexState *ls, SemInfo *seminfo) {
 
 
 void luaX_next (LexState *ls) {
-  // ȡһ token
+  // 读取下一个 token
   ls->lastline = ls->linenumber;
   if (ls->lookahead.token != TK_EOS) {  /* is there a look-ahead token? */
     ls->t = ls->lookahead;  /* use this one */
     ls->lookahead.token = TK_EOS;  /* and discharge it */
   }
   else
-	// ȡһ token
+	// 读取下一个 token
     ls->t.token = llex(ls, &ls->t.seminfo);  /* read next token */
 }
 
@@ -48,7 +48,7 @@ typedef union {
 
 
 typedef struct Token {
-  // token id
+  // token 的id
   int token;
   SemInfo seminfo;
 } Token;
@@ -57,13 +57,13 @@ typedef struct Token {
 /* state of the lexer plus state of the parser when shared by all
    functions */
 typedef struct LexState {
-  // ǰλ
+  // 当前解析的位置
   int current;  /* current character (charint) */
-  // ܹ
+  // 总共的行数
   int linenumber;  /* input line counter */
-  // 󱻷һ
+  // 最后被分析的一行
   int lastline;  /* line of last token 'consumed' */
-  // Ŀǰ Token
+  // 目前分析出来的 Token
   Token t;  /* current token */
   Token lookahead;  /* look ahead token */
   // funcstate
@@ -72,13 +72,13 @@ typedef struct LexState {
   struct lua_State *L;
   // zio
   ZIO *z;  /* input stream */
-  // ʱ
+  // 临时缓冲区
   Mbuffer *buff;  /* buffer for tokens */
   Table *h;  /* to avoid collection/reuse strings */
   struct Dyndata *dyd;  /* dynamic structures used by the parser */
-  // ǰԴ
+  // 当前来源
   TString *source;  /* current source name */
-  // 
+  // 环境变量的名称
   TString *envn;  /* environment variable name */
   char decpoint;  /* locale decimal point */
 } LexState;
@@ -107,6 +107,22 @@ typedef LUAI_UACINT l_uacInt;
 #endif
 
 
+/*
+** 'l_sinline' defines a static function that must be inlined; the
+** locks of threaded builds make the API functions big enough that
+** compilers stop inlining their small helpers on their own
+*/
+#if !defined(l_sinline)
+#if defined(__GNUC__)
+#define l_sinline	static __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define l_sinline	static __forceinline
+#else
+#define l_sinline	static
+#endif
+#endif
+
+
 /* type casts (a macro highlights casts in the code) */
 #define cast(t, exp)	((t)(exp))
 
@@ -210,6 +226,58 @@ typedef unsigned long Instruction;
 ** macros that are executed whenever program enters the Lua core
 ** ('lua_lock') and leaves the core ('lua_unlock')
 */
+#if defined(LUA_USE_THREADS) && !defined(lua_lock)
+
+/*
+** In threaded builds, the lock of a state is biased to one OS thread,
+** which takes and releases it without atomic operations while no other
+** thread asks for it; everything else goes through 'luaE_lock' and
+** 'luaE_unlock' (see lstate.c). Inside a batch (see 'luaE_beginbatch')
+** the thread running 'L' holds the lock already, and 'lua_lock' and
+** 'lua_unlock' on 'L' only test 'L->lockbatch'.
+*/
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define luai_threadlocal	__declspec(thread)
+#define luai_get(p)		(*(p))
+#define luai_set(p,v)		(*(p) = (v))
+#define luai_setrel(p,v)	(*(p) = (v))  /* volatile stores release */
+#define luai_barrier()		_ReadWriteBarrier()
+#else
+#define luai_threadlocal	__thread
+#define luai_get(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#define luai_set(p,v)		__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define luai_setrel(p,v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define luai_barrier()		__atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/* its address identifies the running OS thread */
+LUAI_DDEC luai_threadlocal char luai_threadid;
+#define luai_self()	(cast(void *, &luai_threadid))
+
+#define luai_lock(L)  \
+	{ global_State *g_ = G(L); \
+	  if (luai_get(&g_->lockowner) == luai_self()) { \
+	    luai_set(&g_->lockheld, 1); \
+	    luai_barrier(); \
+	    if (luai_get(&g_->lockrevoked)) luaE_lock(L); \
+	  } \
+	  else luaE_lock(L); }
+
+#define luai_unlock(L)  \
+	{ global_State *g_ = G(L); \
+	  if (luai_get(&g_->lockowner) == luai_self() && \
+	      luai_get(&g_->lockheld)) \
+	    luai_setrel(&g_->lockheld, 0); \
+	  else luaE_unlock(L); }
+
+#define lua_lock(L)	{ if ((L)->lockbatch == 0) luai_lock(L) }
+#define lua_unlock(L)	{ if ((L)->lockbatch == 0) luai_unlock(L) }
+
+#define luai_threadyield(L)	luaE_threadyield(L)
+
+#endif
+
 #if !defined(lua_lock)
 #define lua_lock(L)	((void) 0)
 #define lua_unlock(L)	((void) 0)
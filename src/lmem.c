@@ -83,16 +83,16 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   if (nsize > realosize && g->gcrunning)
     luaC_fullgc(L, 1);  /* force a GC whenever possible */
 #endif
-  // ڴ
+  // 分配内存
   newblock = (*g->frealloc)(g->ud, block, osize, nsize);
   if (newblock == NULL && nsize > 0) {
-	// ڴʧܣgcһ ٷ
+	// 分配内存失败，尝试gc一下 再分配
     lua_assert(nsize > realosize);  /* cannot fail when shrinking a block */
     if (g->version) {  /* is state fully built? */
       luaC_fullgc(L, 1);  /* try to free some memory... */
       newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
     }
-    if (newblock == NULL) // ʧܣǾ go die ׳쳣
+    if (newblock == NULL) // 还是失败，那就 go die 抛出异常
       luaD_throw(L, LUA_ERRMEM);
   }
   lua_assert((nsize == 0) == (newblock == NULL));
@@ -100,3 +100,50 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   return newblock;
 }
 
+
+/*
+** {======================================================
+** Pools: free lists of small blocks with a fixed size
+** A pooled block is linked through its first word. It does not count
+** as allocated memory (so that it does not delay collections); the
+** collector gives pooled blocks back to 'frealloc' with 'luaM_pooltrim'.
+** =======================================================
+*/
+
+#define nextblock(b)	(*cast(void **, (b)))
+
+
+void *luaM_poolalloc (lua_State *L, void **pool, size_t size) {
+  void *block = *pool;
+  if (block == NULL)  /* empty pool? */
+    return luaM_malloc(L, size);
+  *pool = nextblock(block);
+  G(L)->GCdebt += size;
+  return block;
+}
+
+
+void luaM_poolfree (lua_State *L, void **pool, void *block, size_t size) {
+  lua_assert(size >= sizeof(void *));
+  nextblock(block) = *pool;
+  *pool = block;
+  G(L)->GCdebt -= size;
+}
+
+
+/*
+** free half of the blocks in a pool (all of them if 'all')
+*/
+void luaM_pooltrim (lua_State *L, void **pool, size_t size, int all) {
+  global_State *g = G(L);
+  while (*pool != NULL) {
+    void *block = *pool;
+    *pool = nextblock(block);  /* remove it from the pool */
+    (*g->frealloc)(g->ud, block, size, 0);
+    if (!all && *pool != NULL)
+      pool = &nextblock(*pool);  /* keep next one */
+  }
+}
+
+/* }====================================================== */
+
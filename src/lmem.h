@@ -58,6 +58,12 @@
 
 LUAI_FUNC l_noret luaM_toobig (lua_State *L);
 
+LUAI_FUNC void *luaM_poolalloc (lua_State *L, void **pool, size_t size);
+LUAI_FUNC void luaM_poolfree (lua_State *L, void **pool, void *block,
+                                                         size_t size);
+LUAI_FUNC void luaM_pooltrim (lua_State *L, void **pool, size_t size,
+                                                         int all);
+
 /* not to be called directly */
 LUAI_FUNC void *luaM_realloc_ (lua_State *L, void *block, size_t oldsize,
                                                           size_t size);
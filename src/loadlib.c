@@ -14,6 +14,7 @@
 #include "lprefix.h"
 
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,8 +26,8 @@
 
 
 /*
-** LUA_PATH_VAR and LUA_CPATH_VAR are the names of the environment
-** variables that Lua check to set its paths.
+** LUA_PATH_VAR, LUA_CPATH_VAR, and LUA_APATH_VAR are the names of the
+** environment variables that Lua check to set its paths.
 */
 #if !defined(LUA_PATH_VAR)
 #define LUA_PATH_VAR	"LUA_PATH"
@@ -36,10 +37,22 @@
 #define LUA_CPATH_VAR	"LUA_CPATH"
 #endif
 
+#if !defined(LUA_APATH_VAR)
+#define LUA_APATH_VAR	"LUA_APATH"
+#endif
+
 #define LUA_PATHSUFFIX		"_" LUA_VERSION_MAJOR "_" LUA_VERSION_MINOR
 
 #define LUA_PATHVARVERSION		LUA_PATH_VAR LUA_PATHSUFFIX
 #define LUA_CPATHVARVERSION		LUA_CPATH_VAR LUA_PATHSUFFIX
+#define LUA_APATHVARVERSION		LUA_APATH_VAR LUA_PATHSUFFIX
+
+/*
+** LUA_APATH_DEFAULT is the default list of module archives
+*/
+#if !defined(LUA_APATH_DEFAULT)
+#define LUA_APATH_DEFAULT	""
+#endif
 
 /*
 ** LUA_PATH_SEP is the character that separates templates in a path.
@@ -369,10 +382,134 @@ static int ll_loadlib (lua_State *L) {
 
 /*
 ** {======================================================
-** 'require' function
+** Cache for 'searchpath'
+** Each directory named in a path is read once into a set of file
+** names, so that a search does not try to open every candidate file;
+** the file name found for each module is also kept, per path. Names
+** in the sets are in lower case, so that a file in a case-insensitive
+** file system is not missed; a name found in a set is still checked
+** with 'fopen'. 'package.rescan' drops the cache.
 ** =======================================================
 */
 
+/* unique keys in the registry for the cache tables */
+static const int DIRS = 0;  /* DIRS[dirname] = set of names */
+static const int FOUND = 0;  /* FOUND[path][name] = file name */
+
+
+/* results of 'lsys_listdir' */
+#define DIRLISTED	0	/* names are in the set */
+#define DIRABSENT	1	/* directory does not exist */
+#define DIRUNKNOWN	2	/* directory cannot be listed */
+
+
+static void pushfname (lua_State *L, const char *s, size_t l) {
+  luaL_Buffer b;
+  char *p = luaL_buffinitsize(L, &b, l);
+  size_t i;
+  for (i = 0; i < l; i++)
+    p[i] = tolower((unsigned char)s[i]);
+  luaL_pushresultsize(&b, l);
+}
+
+
+/*
+** Add all names in directory 'dir' (empty or ending with a directory
+** separator) to the set on the top of the stack.
+*/
+static int lsys_listdir (lua_State *L, const char *dir);
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <dirent.h>
+#include <errno.h>
+
+static int readnames (lua_State *L) {
+  DIR *d = (DIR *)lua_touserdata(L, 1);
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    pushfname(L, e->d_name, strlen(e->d_name));
+    lua_pushboolean(L, 1);
+    lua_rawset(L, 2);
+  }
+  return 0;
+}
+
+
+static int lsys_listdir (lua_State *L, const char *dir) {
+  DIR *d = opendir((*dir == '\0') ? "." : dir);
+  int status;
+  if (d == NULL)
+    return (errno == ENOENT || errno == ENOTDIR) ? DIRABSENT : DIRUNKNOWN;
+  lua_pushcfunction(L, readnames);
+  lua_pushlightuserdata(L, d);
+  lua_pushvalue(L, -3);  /* set */
+  status = lua_pcall(L, 2, 0, 0);  /* protect 'd' from memory errors */
+  closedir(d);
+  if (status != LUA_OK) lua_error(L);
+  return DIRLISTED;
+}
+
+#elif defined(LUA_USE_WINDOWS)	/* }{ */
+
+#include <windows.h>
+
+static int readnames (lua_State *L) {
+  HANDLE h = (HANDLE)lua_touserdata(L, 1);
+  WIN32_FIND_DATAA *fd = (WIN32_FIND_DATAA *)lua_touserdata(L, 2);
+  do {
+    pushfname(L, fd->cFileName, strlen(fd->cFileName));
+    lua_pushboolean(L, 1);
+    lua_rawset(L, 3);
+  } while (FindNextFileA(h, fd));
+  return 0;
+}
+
+
+static int lsys_listdir (lua_State *L, const char *dir) {
+  WIN32_FIND_DATAA fd;
+  HANDLE h;
+  int status;
+  h = FindFirstFileA(lua_pushfstring(L, "%s*", dir), &fd);
+  lua_pop(L, 1);  /* remove pattern */
+  if (h == INVALID_HANDLE_VALUE) {
+    DWORD e = GetLastError();
+    return (e == ERROR_FILE_NOT_FOUND || e == ERROR_PATH_NOT_FOUND)
+           ? DIRABSENT : DIRUNKNOWN;
+  }
+  lua_pushcfunction(L, readnames);
+  lua_pushlightuserdata(L, h);
+  lua_pushlightuserdata(L, &fd);
+  lua_pushvalue(L, -4);  /* set */
+  status = lua_pcall(L, 3, 0, 0);  /* protect 'h' from memory errors */
+  FindClose(h);
+  if (status != LUA_OK) lua_error(L);
+  return DIRLISTED;
+}
+
+#else				/* }{ */
+
+static int lsys_listdir (lua_State *L, const char *dir) {
+  (void)(L); (void)(dir);  /* not used */
+  return DIRUNKNOWN;
+}
+
+#endif				/* } */
+
+
+/*
+** push cache table 'key' from the registry, creating it if needed
+*/
+static void getcache (lua_State *L, const int *key) {
+  if (lua_rawgetp(L, LUA_REGISTRYINDEX, key) != LUA_TTABLE) {
+    lua_pop(L, 1);  /* remove previous result */
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, key);
+  }
+}
+
 
 static int readable (const char *filename) {
   FILE *f = fopen(filename, "r");  /* try to open file */
@@ -382,6 +519,260 @@ static int readable (const char *filename) {
 }
 
 
+/*
+** Check whether file 'filename' exists and is readable, without
+** opening it when its directory listing says it does not exist.
+** DIRS[dirname] is the set of names in 'dirname', false if 'dirname'
+** does not exist, or true if it cannot be listed.
+*/
+static int cachedreadable (lua_State *L, const char *filename) {
+  const char *base = filename;
+  const char *p;
+  int res;
+  for (p = filename; *p != '\0'; p++) {  /* find base name */
+    if (*p == *LUA_DIRSEP || *p == '/')
+      base = p + 1;
+  }
+  getcache(L, &DIRS);
+  lua_pushlstring(L, filename, base - filename);  /* directory name */
+  lua_pushvalue(L, -1);
+  if (lua_rawget(L, -3) == LUA_TNIL) {  /* directory not read yet? */
+    int stat;
+    lua_pop(L, 1);  /* remove nil */
+    lua_newtable(L);
+    stat = lsys_listdir(L, lua_tostring(L, -2));
+    if (stat != DIRLISTED) {
+      lua_pop(L, 1);  /* remove set */
+      lua_pushboolean(L, stat == DIRUNKNOWN);
+    }
+    lua_pushvalue(L, -2);  /* directory name */
+    lua_pushvalue(L, -2);  /* its entry */
+    lua_rawset(L, -5);  /* DIRS[dirname] = entry */
+  }
+  if (lua_istable(L, -1)) {  /* has a set of names? */
+    pushfname(L, base, strlen(base));
+    res = (lua_rawget(L, -2) != LUA_TNIL);
+    lua_pop(L, 1);  /* remove result */
+  }
+  else
+    res = lua_toboolean(L, -1);
+  lua_pop(L, 3);  /* remove DIRS, directory name, and its entry */
+  return res && readable(filename);
+}
+
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Module archives (format in lauxlib.h)
+** An archive is mapped into memory the first time it is searched and
+** stays mapped while it is in the cache ARCHIVES[filename]; modules
+** are loaded straight from the mapping.
+** =======================================================
+*/
+
+static const int ARCHIVES = 0;
+
+#define ARCHIVE		"ARCHIVE*"
+
+typedef struct Archive {
+  const unsigned char *b;  /* contents (NULL if closed) */
+  size_t size;
+} Archive;
+
+
+/*
+** Map file 'filename' into memory. Returns its contents and sets
+** '*size'; returns NULL if the file cannot be opened.
+*/
+static void *lsys_map (const char *filename, size_t *size);
+
+/* unmap the contents of a file */
+static void lsys_unmap (void *b, size_t size);
+
+
+#if defined(LUA_USE_POSIX)	/* { */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void *lsys_map (const char *filename, size_t *size) {
+  struct stat st;
+  void *b = NULL;
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) return NULL;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    b = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (b == MAP_FAILED) b = NULL;
+    else *size = (size_t)st.st_size;
+  }
+  close(fd);  /* mapping keeps the file */
+  return b;
+}
+
+
+static void lsys_unmap (void *b, size_t size) {
+  munmap(b, size);
+}
+
+#elif defined(LUA_USE_WINDOWS)	/* }{ */
+
+#include <windows.h>
+
+static void *lsys_map (const char *filename, size_t *size) {
+  LARGE_INTEGER sz;
+  void *b = NULL;
+  HANDLE m;
+  HANDLE f = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (f == INVALID_HANDLE_VALUE) return NULL;
+  if (GetFileSizeEx(f, &sz) && sz.QuadPart > 0 &&
+      (m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+    b = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (b != NULL) *size = (size_t)sz.QuadPart;
+    CloseHandle(m);  /* view keeps the mapping */
+  }
+  CloseHandle(f);
+  return b;
+}
+
+
+static void lsys_unmap (void *b, size_t size) {
+  (void)(size);  /* not used */
+  UnmapViewOfFile(b);
+}
+
+#else				/* }{ */
+
+/* without mappings, read the whole file */
+static void *lsys_map (const char *filename, size_t *size) {
+  FILE *f = fopen(filename, "rb");
+  char *b = NULL;
+  long n;
+  if (f == NULL) return NULL;
+  if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) > 0 &&
+      fseek(f, 0, SEEK_SET) == 0 && (b = (char *)malloc(n)) != NULL) {
+    if (fread(b, 1, n, f) == (size_t)n) *size = (size_t)n;
+    else { free(b); b = NULL; }
+  }
+  fclose(f);
+  return b;
+}
+
+
+static void lsys_unmap (void *b, size_t size) {
+  (void)(size);  /* not used */
+  free(b);
+}
+
+#endif				/* } */
+
+
+static int archive_gc (lua_State *L) {
+  Archive *a = (Archive *)luaL_checkudata(L, 1, ARCHIVE);
+  if (a->b != NULL) {
+    lsys_unmap((void *)a->b, a->size);
+    a->b = NULL;
+  }
+  return 0;
+}
+
+
+static size_t getword (const unsigned char *p) {
+  return (size_t)p[0] | ((size_t)p[1] << 8) |
+         ((size_t)p[2] << 16) | ((size_t)p[3] << 24);
+}
+
+
+/* number of modules in an archive with a valid header and index */
+static size_t nmodules (const Archive *a) {
+  size_t n;
+  if (a->size < LUA_ARHEADERSIZE ||
+      memcmp(a->b, LUA_ARSIGNATURE, sizeof(LUA_ARSIGNATURE) - 1) != 0 ||
+      getword(a->b + 4) != LUA_ARVERSION)
+    return (size_t)-1;
+  n = getword(a->b + 8);
+  if (n > (a->size - LUA_ARHEADERSIZE) / LUA_ARENTRYSIZE)
+    return (size_t)-1;  /* index does not fit in the archive */
+  return n;
+}
+
+
+/*
+** Get archive 'filename' from ARCHIVES, mapping it if it is not there
+** yet. ARCHIVES[filename] is false when the file cannot be opened.
+** Raises an error if the file is not a valid archive.
+*/
+static const Archive *getarchive (lua_State *L, const char *filename) {
+  Archive *a;
+  getcache(L, &ARCHIVES);
+  if (lua_getfield(L, -1, filename) == LUA_TNIL) {  /* not mapped yet? */
+    lua_pop(L, 1);  /* remove nil */
+    a = (Archive *)lua_newuserdata(L, sizeof(Archive));
+    a->b = NULL;
+    if (luaL_newmetatable(L, ARCHIVE)) {
+      lua_pushcfunction(L, archive_gc);
+      lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    a->b = (const unsigned char *)lsys_map(filename, &a->size);
+    if (a->b == NULL) {  /* cannot open file? */
+      lua_pop(L, 1);  /* remove userdata (unmapped) */
+      lua_pushboolean(L, 0);
+    }
+    else if (nmodules(a) == (size_t)-1)
+      luaL_error(L, "file '%s' is not a valid module archive", filename);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, -3, filename);  /* ARCHIVES[filename] = archive */
+  }
+  a = (Archive *)lua_touserdata(L, -1);  /* NULL if false */
+  lua_pop(L, 2);  /* remove ARCHIVES and archive (kept by ARCHIVES) */
+  return a;
+}
+
+
+/*
+** Binary search for module 'name' in the index of archive 'a'.
+** Returns its entry, or NULL if not present.
+*/
+static const unsigned char *findmodule (lua_State *L, const Archive *a,
+                                        const char *name) {
+  size_t l = strlen(name);
+  size_t lo = 0;
+  size_t hi = nmodules(a);
+  while (lo < hi) {
+    size_t m = lo + (hi - lo) / 2;
+    const unsigned char *e = a->b + LUA_ARHEADERSIZE + m * LUA_ARENTRYSIZE;
+    size_t noff = getword(e);
+    size_t nsize = getword(e + 4);
+    int cmp;
+    if (noff > a->size || nsize > a->size - noff)
+      luaL_error(L, "corrupted module archive");
+    cmp = memcmp(name, a->b + noff, (l < nsize) ? l : nsize);
+    if (cmp == 0) cmp = (l > nsize) - (l < nsize);
+    if (cmp == 0) return e;
+    else if (cmp < 0) hi = m;
+    else lo = m + 1;
+  }
+  return NULL;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** 'require' function
+** =======================================================
+*/
+
+
 static const char *pushnexttemplate (lua_State *L, const char *path) {
   const char *l;
   while (*path == *LUA_PATH_SEP) path++;  /* skip separators */
@@ -398,15 +789,26 @@ static const char *searchpath (lua_State *L, const char *name,
                                              const char *sep,
                                              const char *dirsep) {
   luaL_Buffer msg;  /* to build error message */
+  int found;
   luaL_buffinit(L, &msg);
   if (*sep != '\0')  /* non-empty separator? */
     name = luaL_gsub(L, name, sep, dirsep);  /* replace it by 'dirsep' */
+  getcache(L, &FOUND);
+  luaL_getsubtable(L, -1, path);  /* FOUND[path] */
+  lua_remove(L, -2);  /* remove FOUND */
+  found = lua_gettop(L);
+  if (lua_getfield(L, found, name) == LUA_TSTRING)  /* found before? */
+    return lua_tostring(L, -1);
+  lua_pop(L, 1);  /* remove nil */
   while ((path = pushnexttemplate(L, path)) != NULL) {
     const char *filename = luaL_gsub(L, lua_tostring(L, -1),
                                      LUA_PATH_MARK, name);
     lua_remove(L, -2);  /* remove path template */
-    if (readable(filename))  /* does file exist and is readable? */
+    if (cachedreadable(L, filename)) {  /* does file exist and is readable? */
+      lua_pushvalue(L, -1);
+      lua_setfield(L, found, name);  /* FOUND[path][name] = filename */
       return filename;  /* return that file name */
+    }
     lua_pushfstring(L, "\n\tno file '%s'", filename);
     lua_remove(L, -2);  /* remove file name */
     luaL_addvalue(&msg);  /* concatenate error msg. entry */
@@ -416,6 +818,20 @@ static const char *searchpath (lua_State *L, const char *name,
 }
 
 
+/*
+** drop the contents of all directories and archives read so far
+*/
+static int ll_rescan (lua_State *L) {
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &DIRS);
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &FOUND);
+  lua_pushnil(L);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &ARCHIVES);
+  return 0;
+}
+
+
 static int ll_searchpath (lua_State *L) {
   const char *f = searchpath(L, luaL_checkstring(L, 1),
                                 luaL_checkstring(L, 2),
@@ -518,11 +934,63 @@ static int searcher_Croot (lua_State *L) {
 }
 
 
+/*
+** Look for a loader in 'package.preload' and then among the C modules
+** linked into the program ('luaL_getstaticlib').
+*/
 static int searcher_preload (lua_State *L) {
   const char *name = luaL_checkstring(L, 1);
   lua_getfield(L, LUA_REGISTRYINDEX, "_PRELOAD");
-  if (lua_getfield(L, -1, name) == LUA_TNIL)  /* not found? */
-    lua_pushfstring(L, "\n\tno field package.preload['%s']", name);
+  if (lua_getfield(L, -1, name) == LUA_TNIL) {  /* not found? */
+    lua_CFunction f = luaL_getstaticlib(name);
+    if (f != NULL)
+      lua_pushcfunction(L, f);
+    else
+      lua_pushfstring(L, "\n\tno field package.preload['%s']", name);
+  }
+  return 1;
+}
+
+
+/*
+** Look for module 'name' in the archives listed in 'package.apath'.
+** The loader is built straight from the archive contents.
+*/
+static int searcher_archive (lua_State *L) {
+  const char *name = luaL_checkstring(L, 1);
+  const char *path;
+  luaL_Buffer msg;  /* to build error message */
+  lua_getfield(L, lua_upvalueindex(1), "apath");
+  path = lua_tostring(L, -1);
+  if (path == NULL)
+    luaL_error(L, "'package.apath' must be a string");
+  luaL_buffinit(L, &msg);
+  while ((path = pushnexttemplate(L, path)) != NULL) {
+    const char *filename = lua_tostring(L, -1);
+    const Archive *a = getarchive(L, filename);
+    const unsigned char *e = (a == NULL) ? NULL : findmodule(L, a, name);
+    if (e != NULL) {  /* found it? */
+      size_t off = getword(e + 8);
+      size_t size = getword(e + 12);
+      const char *chunkname;
+      if (off > a->size || size > a->size - off)
+        luaL_error(L, "corrupted module archive '%s'", filename);
+      if (getword(e + 16) != LUA_ARSTORED)
+        luaL_error(L, "unsupported compression for module '%s' in '%s'",
+                      name, filename);
+      chunkname = lua_pushfstring(L, "@%s(%s)", filename, name);
+      return checkload(L, luaL_loadbufferx(L, (const char *)a->b + off, size,
+                                           chunkname, NULL) == LUA_OK,
+                          chunkname + 1);
+    }
+    if (a == NULL)
+      lua_pushfstring(L, "\n\tno file '%s'", filename);
+    else
+      lua_pushfstring(L, "\n\tno module '%s' in archive '%s'", name, filename);
+    lua_remove(L, -2);  /* remove archive name */
+    luaL_addvalue(&msg);  /* concatenate error msg. entry */
+  }
+  luaL_pushresult(&msg);  /* create error message */
   return 1;
 }
 
@@ -704,6 +1172,7 @@ static void setpath (lua_State *L, const char *fieldname, const char *envname1,
 static const luaL_Reg pk_funcs[] = {
   {"loadlib", ll_loadlib},
   {"searchpath", ll_searchpath},
+  {"rescan", ll_rescan},
 #if defined(LUA_COMPAT_MODULE)
   {"seeall", ll_seeall},
 #endif
@@ -711,6 +1180,7 @@ static const luaL_Reg pk_funcs[] = {
   {"preload", NULL},
   {"cpath", NULL},
   {"path", NULL},
+  {"apath", NULL},
   {"searchers", NULL},
   {"loaded", NULL},
   {NULL, NULL}
@@ -727,8 +1197,10 @@ static const luaL_Reg ll_funcs[] = {
 
 
 static void createsearcherstable (lua_State *L) {
+  /* 'searcher_archive' goes last, so the standard ones keep their places */
   static const lua_CFunction searchers[] =
-    {searcher_preload, searcher_Lua, searcher_C, searcher_Croot, NULL};
+    {searcher_preload, searcher_Lua, searcher_C, searcher_Croot,
+     searcher_archive, NULL};
   int i;
   /* create 'searchers' table */
   lua_createtable(L, sizeof(searchers)/sizeof(searchers[0]) - 1, 0);
@@ -754,27 +1226,29 @@ static void createsearcherstable (lua_State *L) {
 */
 static void createclibstable (lua_State *L) {
   lua_newtable(L);  /* create CLIBS table */
-  //  Ԫ
+  // 创建 元表
   lua_createtable(L, 0, 1);  /* create metatable for CLIBS */
-  // Ԫfield  ["__gc"] == gctm
+  // 在元表设置field  ["__gc"] == gctm
   lua_pushcfunction(L, gctm);
   lua_setfield(L, -2, "__gc");  /* set finalizer for CLIBS table */
-  // ջԪأΪ idx == -2 ԪصԪջ
+  // 将栈顶元素，设置为 idx == -2 元素的元表，并弹出栈顶
   lua_setmetatable(L, -2);
-  // registry[address ofCLIBS] = table CLIBS
+  // registry[address of（CLIBS）] = table CLIBS
   lua_rawsetp(L, LUA_REGISTRYINDEX, &CLIBS);  /* set CLIBS table in registry */
 }
 
 
 LUAMOD_API int luaopen_package (lua_State *L) {
   createclibstable(L);
-  //  package table, Ϊÿ search upvalue
+  // 创建 package table, 并作为每个 search函数的 upvalue
   luaL_newlib(L, pk_funcs);  /* create 'package' table */
   createsearcherstable(L);
   /* set field 'path' */
   setpath(L, "path", LUA_PATHVARVERSION, LUA_PATH_VAR, LUA_PATH_DEFAULT);
   /* set field 'cpath' */
   setpath(L, "cpath", LUA_CPATHVARVERSION, LUA_CPATH_VAR, LUA_CPATH_DEFAULT);
+  /* set field 'apath' */
+  setpath(L, "apath", LUA_APATHVARVERSION, LUA_APATH_VAR, LUA_APATH_DEFAULT);
   /* store config information */
   lua_pushliteral(L, LUA_DIRSEP "\n" LUA_PATH_SEP "\n" LUA_PATH_MARK "\n"
                      LUA_EXEC_DIR "\n" LUA_IGMARK "\n");
@@ -31,7 +31,7 @@
 /*
 ** tags for Tagged Values have the following use of bits:
 ** bits 0-3: actual tag (a LUA_T* value)
-** bits 4-5: variant bits  ͬͣŲͬĺ
+** bits 4-5: variant bits  不同的类型，有着不同的含义
 ** bit 6: whether value is collectable
 ** bit 7 6   5 4  3 2 1 0
 **       gc        t a g       
@@ -46,35 +46,35 @@
 */
 
 /* Variant tags for functions */
-// ֱ Lua function light C function regular C function
-// light CӦþһһָ
-//  regular Ǻбհ
-// λ tag  4-5λ
+// 分别代表 Lua function， light C function， regular C function
+// light C，应该就是一个单一函数指针
+// 而 regular 是含有闭包的
+// 左移四位，就是 tag 的 4-5位
 #define LUA_TLCL	(LUA_TFUNCTION | (0 << 4))  /* Lua closure */
 #define LUA_TLCF	(LUA_TFUNCTION | (1 << 4))  /* light C function */
 #define LUA_TCCL	(LUA_TFUNCTION | (2 << 4))  /* C closure */
 
 
 /* Variant tags for strings */
-// ַ
-// ַַ
+// 字符串
+// 短字符串，长字符串
 #define LUA_TSHRSTR	(LUA_TSTRING | (0 << 4))  /* short strings */
 #define LUA_TLNGSTR	(LUA_TSTRING | (1 << 4))  /* long strings */
 
 
 /* Variant tags for numbers */
-// 
-// 
+// 数字
+// 浮点数，整数
 #define LUA_TNUMFLT	(LUA_TNUMBER | (0 << 4))  /* float numbers */
 #define LUA_TNUMINT	(LUA_TNUMBER | (1 << 4))  /* integer numbers */
 
 
 /* Bit mark for collectable types */
-// gc
+// 可gc
 #define BIT_ISCOLLECTABLE	(1 << 6)
 
 /* mark a tag as collectable */
-// ʹ t ʶΪ gc
+// 使 t 被标识为 可gc
 #define ctb(t)			((t) | BIT_ISCOLLECTABLE)
 
 
@@ -94,8 +94,8 @@ typedef struct GCObject GCObject;
 /*
 ** Common type has only the common header
 */
-// ע⣬ GCObject һ Header
-// һ GCObjectһ union GCUnion СΪ 120 ֽ
+// 注意，这里的 GCObject 仅仅是一个 Header
+// 一个完整的 GCObject，是一个 union GCUnion 大小为 120 字节
 struct GCObject {
   CommonHeader;
 };
@@ -120,10 +120,10 @@ typedef union Value {
   lua_Number n;    /* float numbers */
 } Value;
 
-//  ֵ  
+// 包括 值 和 类型
 #define TValuefields	Value value_; int tt_
 
-// Luaеı
+// Lua中的变量
 typedef struct lua_TValue {
   TValuefields;
 } TValue;
@@ -133,90 +133,90 @@ typedef struct lua_TValue {
 /* macro defining a nil value */
 #define NILCONSTANT	{NULL}, LUA_TNIL
 
-//  TValue o  ֵ value_ (union Value)
+// 获得 TValue o 的 值 value_ (union Value)
 #define val_(o)		((o)->value_)
 
 
 /* raw type tag of a TValue */
-//  TValue o   tt_
+// 获得 TValue o 的 类型 tt_
 #define rttype(o)	((o)->tt_)
 
 /* tag with no variants (bits 0-3) */
-// ȡ͵ 0-3 ĸbit
+// 获取代表类型的 0-3 四个bit
 //
 #define novariant(x)	((x) & 0x0F)
 
 /* type tag of a TValue (bits 0-3 for tags + variant bits 4-5) */
-// o & 2^6-1  ֻȡ o  0-5 λ (Ҳ˵ Ƿgc)
+// o & 2^6-1  只取 o 的 0-5 六位 (也就是说不包含 是否可gc)
 #define ttype(o)	(rttype(o) & 0x3F)
 
 /* type tag of a TValue with no variants (bits 0-3) */
-//  novariantһ
+// 和 novariant一样
 #define ttnov(o)	(novariant(rttype(o)))
 
 
 /* Macros to test type */
-//  tag o,t Ƿȫһ
+// 检测 tag o,t 是否完全一致
 #define checktag(o,t)		(rttype(o) == (t))
-//  o,t Ƿһ
+// 检测 o,t 类型是否一样
 #define checktype(o,t)		(ttnov(o) == (t))
-// ǲ number,float,integer
-// LUA_TNUMFLT == LUA_TNUMBER | 0 << 4   0-3ʾ number4-5λʾfloat
-// integer ͬ
+// 检测是不是 number,float,integer
+// LUA_TNUMFLT == LUA_TNUMBER | 0 << 4  即 0-3表示 number，4-5位，表示这是float
+// integer 同理
 #define ttisnumber(o)		checktype((o), LUA_TNUMBER)
 #define ttisfloat(o)		checktag((o), LUA_TNUMFLT)
 #define ttisinteger(o)		checktag((o), LUA_TNUMINT)
-//  ǲnil
+// 检测 是不是nil
 #define ttisnil(o)		checktag((o), LUA_TNIL)
 // boolean
 #define ttisboolean(o)		checktag((o), LUA_TBOOLEAN)
-// light user data Ŀǰû㶮ʲô
+// light user data 这个目前还没搞懂是做什么的
 #define ttislightuserdata(o)	checktag((o), LUA_TLIGHTUSERDATA)
 // string
 #define ttisstring(o)		checktype((o), LUA_TSTRING)
-// ע⣬￪ʼõ ctb ˣʾͣdeadkeyǿgc
-// shr string ʲôŶŶŶ short string
+// 注意，从这里开始，用的是 ctb 了，表示下面的类型，除了deadkey都是可gc类型
+// shr string 是什么鬼。。。哦哦哦。。是 short string，
 #define ttisshrstring(o)	checktag((o), ctb(LUA_TSHRSTR))
 // long string
 #define ttislngstring(o)	checktag((o), ctb(LUA_TLNGSTR))
-// ǲ table
+// 检测是不是 table
 #define ttistable(o)		checktag((o), ctb(LUA_TTABLE))
-//  function
+// 检测 function
 #define ttisfunction(o)		checktype(o, LUA_TFUNCTION)
-//  ǲǱհ o & 2^5   0-5 λ
+// 检测 是不是闭包 o & 2^5   0-5 位
 #define ttisclosure(o)		((rttype(o) & 0x1F) == LUA_TFUNCTION)
-//  C հ Lua հ
+// 检测 C 函数闭包，和 Lua 闭包
 #define ttisCclosure(o)		checktag((o), ctb(LUA_TCCL))
 #define ttisLclosure(o)		checktag((o), ctb(LUA_TLCL))
 // light c function
 #define ttislcf(o)		checktag((o), LUA_TLCF)
 // user data?
 #define ttisfulluserdata(o)	checktag((o), ctb(LUA_TUSERDATA))
-//  ǲ thread
+// 检测 是不是 thread
 #define ttisthread(o)		checktag((o), ctb(LUA_TTHREAD))
-// deadkey table
+// deadkey， 在table里见过
 #define ttisdeadkey(o)		checktag((o), LUA_TDEADKEY)
 
 
 /* Macros to access values */
-// check_exp(c,e)   lua_assert £ȶ c , Ȼֵ e
-// û壬ֱֵ e
+// check_exp(c,e) 在 定义 lua_assert宏 的情况下，先断言 c , 然后再求值 e
+// 如果没定义，则直接求值 e
 // integer value
 #define ivalue(o)	check_exp(ttisinteger(o), val_(o).i)
 // float value
 #define fltvalue(o)	check_exp(ttisfloat(o), val_(o).n)
-// number value int  float
+// number value，可以是 int 或 float
 #define nvalue(o)	check_exp(ttisnumber(o), \
 	(ttisinteger(o) ? cast_num(ivalue(o)) : fltvalue(o)))
-// gc value, һָ GCObject ָ
+// gc value, 是一个指向 GCObject 的指针
 #define gcvalue(o)	check_exp(iscollectable(o), val_(o).gc)
-// light user data,  һ void* ָ
+// light user data,  一个 void* 指针
 #define pvalue(o)	check_exp(ttislightuserdata(o), val_(o).p)
-//  string  value
-//  gco2ts ꣬ GCObject* תΪ GCUnion е TString
-// Ϊ GCUnion еĳԱ CommonHeader ڴ沼һ£ֱת
+// 获得 string 的 value
+// 这里用 gco2ts 宏，把 GCObject* 转换为 GCUnion 中的 TString
+// 因为 GCUnion 中的成员，都是 CommonHeader 所以内存布局一致，可以直接转换
 #define tsvalue(o)	check_exp(ttisstring(o), gco2ts(val_(o).gc))
-// full user data, תΪ UData
+// full user data, 转换为 UData
 #define uvalue(o)	check_exp(ttisfulluserdata(o), gco2u(val_(o).gc))
 // union Closure
 #define clvalue(o)	check_exp(ttisclosure(o), gco2cl(val_(o).gc))
@@ -226,42 +226,42 @@ typedef struct lua_TValue {
 #define clCvalue(o)	check_exp(ttisCclosure(o), gco2ccl(val_(o).gc))
 // light c function,  f(unction)value
 #define fvalue(o)	check_exp(ttislcf(o), val_(o).f)
-// תΪ struct Table
+// 转换为 struct Table
 #define hvalue(o)	check_exp(ttistable(o), gco2t(val_(o).gc))
 // boolean value
 #define bvalue(o)	check_exp(ttisboolean(o), val_(o).b)
-// תΪ struct lua_State, GCUnion бע
+// 转换为 struct lua_State, GCUnion 中标注的
 #define thvalue(o)	check_exp(ttisthread(o), gco2th(val_(o).gc))
 /* a dead value may get the 'gc' field, but cannot access its contents */
 #define deadvalue(o)	check_exp(ttisdeadkey(o), cast(void *, val_(o).gc))
 
-// false,  false == nil || false
+// 定义false,  false == nil || false
 #define l_isfalse(o)	(ttisnil(o) || (ttisboolean(o) && bvalue(o) == 0))
 
-// Ƿ gc
+// 是否可 gc
 #define iscollectable(o)	(rttype(o) & BIT_ISCOLLECTABLE)
 
 
 /* Macros for internal tests */
-//  gc ⲿ(TValue) gc ڲ(GCUnion)Ƿһ¡
+// 检测 gc类型 的外部类型(TValue)，和 gc 内部类型(GCUnion)是否一致。。。
 #define righttt(obj)		(ttype(obj) == gcvalue(obj)->tt)
 
-// objǷ
-// gc    ȷûdead
+// 检测obj是否存活
+// 不可gc  或者  （类型正确，且没有dead）
 #define checkliveness(L,obj) \
 	lua_longassert(!iscollectable(obj) || \
 		(righttt(obj) && (L == NULL || !isdead(G(L),gcvalue(obj)))))
 
 
 /* Macros to set values */
-//  tt_
+// 设置类型 tt_
 #define settt_(o,t)	((o)->tt_=(t))
 
-//  obj Ϊ float x
+// 设置 obj 为 float x
 #define setfltvalue(obj,x) \
   { TValue *io=(obj); val_(io).n=(x); settt_(io, LUA_TNUMFLT); }
 
-// ı float Ϊ x
+// 改变 float 为 x
 #define chgfltvalue(obj,x) \
   { TValue *io=(obj); lua_assert(ttisfloat(io)); val_(io).n=(x); }
 
@@ -272,7 +272,7 @@ typedef struct lua_TValue {
 #define chgivalue(obj,x) \
   { TValue *io=(obj); lua_assert(ttisinteger(io)); val_(io).i=(x); }
 
-// ÿֵ nil
+// 设置空值 nil
 #define setnilvalue(obj) settt_(obj, LUA_TNIL)
 
 // light c function
@@ -287,14 +287,14 @@ typedef struct lua_TValue {
 #define setbvalue(obj,x) \
   { TValue *io=(obj); val_(io).b=(x); settt_(io, LUA_TBOOLEAN); }
 
-// obj = x
+// obj = x，
 // obj.tt_ = ctb(x.tt_)
 #define setgcovalue(L,obj,x) \
   { TValue *io = (obj); GCObject *i_g=(x); \
     val_(io).gc = i_g; settt_(io, ctb(i_g->tt)); }
 
 // string
-// оһӦһͼ⣬ͲĻᱨ
+// 这里感觉第一行应该是做一个类型检测，如果类型不符的话，编译器会报错
 #define setsvalue(L,obj,x) \
   { TValue *io = (obj); TString *x_ = (x); \
     val_(io).gc = obj2gco(x_); settt_(io, ctb(x_->tt)); \
@@ -307,7 +307,7 @@ typedef struct lua_TValue {
     checkliveness(L,io); }
 
 // thread
-//  x ֵ obj
+// 把 x 赋值给 obj
 #define setthvalue(L,obj,x) \
   { TValue *io = (obj); lua_State *x_ = (x); \
     val_(io).gc = obj2gco(x_); settt_(io, ctb(LUA_TTHREAD)); \
@@ -381,15 +381,15 @@ typedef TValue *StkId;  /* index to stack elements */
 ** (aligned according to 'UTString'; see next).
 */
 typedef struct TString {
-  CommonHeader; // gc 
+  CommonHeader; // gc 对象
   lu_byte extra;  /* reserved words for short strings; "has hash" for longs */
-  // byte ַĳ 0 - 2^8-1(255)
+  // byte 短字符串的长度 0 - 2^8-1(255)
   lu_byte shrlen;  /* length for short strings */
-  // ַ hash 
+  // 字符串的 hash 
   unsigned int hash;
-  // ²²:
-  // 1. ַҪõ lnglenԲ hash table 
-  // 2. ַ(Сڵ255),пܷ hash table 
+  // 从这里可以做如下猜测:
+  // 1. 长字符串需要用到 lnglen，所以不会放在 hash table 里
+  // 2. 短字符串(长度小于等于255),有可能放在 hash table 里
   union {
     size_t lnglen;  /* length for long strings */
     struct TString *hnext;  /* linked list for hash table */
@@ -410,22 +410,22 @@ typedef union UTString {
 ** Get the actual string (array of bytes) from a 'TString'.
 ** (Access to 'extra' ensures that value is really a 'TString'.)
 */
-// һTString洢ַʵڴ棬TString
+// 一个TString，存储字符串的实际内存，紧跟在TString后面
 #define getstr(ts)  \
   check_exp(sizeof((ts)->extra), cast(char *, (ts)) + sizeof(UTString))
 
 
 /* get the actual string (array of bytes) from a Lua value */
-// ʵʵַ
+// 获得实际的字符串
 #define svalue(o)       getstr(tsvalue(o))
 
 /* get string length from 'TString *s' */
-// ַ, short or long һ 
-// ע s  TString*
+// 字符串长度,根据 short or long 做一个区分 
+// 注意 s 是 TString*
 #define tsslen(s)	((s)->tt == LUA_TSHRSTR ? (s)->shrlen : (s)->u.lnglen)
 
 /* get string length from 'TValue *o' */
-// ͬϣ o  TValue*
+// 同上，但 o 是 TValue*
 #define vslen(o)	tsslen(tsvalue(o))
 
 
@@ -455,7 +455,7 @@ typedef union UUdata {
 **  Get the address of memory block inside 'Udata'.
 ** (Access to 'ttuv_' ensures that value is really a 'Udata'.)
 */
-//  UserData ʵֵ
+// 获得 UserData 的实际值
 #define getudatamem(u)  \
   check_exp(sizeof((u)->ttuv_), (cast(char*, (u)) + sizeof(UUdata)))
 
@@ -485,11 +485,11 @@ typedef struct Upvaldesc {
 /*
 ** Description of a local variable for function prototypes
 ** (used for debug information)
-** ֲϢ  debug
+** 局部变量的信息， 用作 debug
 */
 typedef struct LocVar {
-  TString *varname; // 
-  // 
+  TString *varname; // 变量名字
+  // 变量的生存周期
   int startpc;  /* first point where variable is active */
   int endpc;    /* first point where variable is dead */
 } LocVar;
@@ -498,45 +498,49 @@ typedef struct LocVar {
 /*
 ** Function Prototypes
 */
-// ԭ  һҪϢ
+// 函数原型  构建一个函数所需要的所有信息
 typedef struct Proto {
-  CommonHeader; // GC
-  // ̶Ĳ
+  CommonHeader; // GC对象
+  // 函数固定的参数个数
   lu_byte numparams;  /* number of fixed parameters */
   lu_byte is_vararg;  /* 2: declared vararg; 1: uses vararg */
-  // úҪ ջռ
+  // 该函数最多需要的 栈空间
   lu_byte maxstacksize;  /* number of registers needed by this function */
-  // upvalue
+  lu_byte nbound;  /* upvalues bound to frozen globals (the last ones) */
+  lu_byte envup;  /* upvalue with the environment of the bound globals */
+  lu_byte kvars;  /* were reads of constant locals made constants? */
+  // upvalue的数量
   int sizeupvalues;  /* size of 'upvalues' */
-  // 
+  // 常量的数量
   int sizek;  /* size of 'k' */
-  // ֽĳ
+  // 字节码的长度
   int sizecode;
-  // ӳϢ
+  // 映射信息的数量
   int sizelineinfo;
-  // Ƕ
+  // 内嵌函数的数量
   int sizep;  /* size of 'p' */
-  // ֲϢ
+  // 局部变量信息的数量
   int sizelocvars;
-  // һЩ debugϢ
+  // 一些用于 debug的信息
   int linedefined;  /* debug information  */
   int lastlinedefined;  /* debug information  */
-  // ʹõĳ
+  // 函数使用的常量
   TValue *k;  /* constants used by the function */
-  // úֽ
+  // 该函数的字节码
   Instruction *code;  /* opcodes */
-  // Ƕ
+  // 内嵌函数
   struct Proto **p;  /* functions defined inside the function */
-  // ֽ -> Դ ӳ
+  // 字节码 -> 源码 的映射
   int *lineinfo;  /* map from opcodes to source lines (debug information) */
-  // ֲϢ
+  // 局部变量信息
   LocVar *locvars;  /* information about local variables (debug information) */
 
-  // upvalue Ϣ
+  // upvalue 的信息
   Upvaldesc *upvalues;  /* upvalue information */
-  // һɸProto Closure
+  // 最后一个由该Proto创建的 Closure
   struct LClosure *cache;  /* last-created closure with this prototype */
-  // Դ
+  struct Proto *root;  /* main function of its chunk, if globals are bound */
+  // 源名称
   TString  *source;  /* used for debug information */
   // gclist
   GCObject *gclist;
@@ -554,30 +558,30 @@ typedef struct UpVal UpVal;
 ** Closures
 */
 
-// հͷ
-// ˵: 1.հgcͣ
-//		 2.upvalue  gcб
+// 闭包头
+// 说明: 1.闭包属于gc类型，
+//		 2.upvalue 的数量， gc列表
 #define ClosureHeader \
 	CommonHeader; lu_byte nupvalues; GCObject *gclist
 
-// C ıհ
+// C 函数的闭包
 typedef struct CClosure {
   ClosureHeader;
-  // ʵ
+  // 函数实体
   lua_CFunction f; 
-  // upvalue 
+  // upvalue 链表
   TValue upvalue[1];  /* list of upvalues */
 } CClosure;
 
 
-// Lua ıհ
+// Lua 函数的闭包
 typedef struct LClosure {
   ClosureHeader;
   struct Proto *p;
   UpVal *upvals[1];  /* list of upvalues */
 } LClosure;
 
-// հݽṹ
+// 闭包数据结构
 typedef union Closure {
   CClosure c;
   LClosure l;
@@ -615,20 +619,20 @@ typedef struct Node {
 } Node;
 
 
-// Table ݽṹ
+// Table 数据结构
 typedef struct Table {
-  // GC CommonHeader
+  // GC 对象的CommonHeader
   CommonHeader;
   lu_byte flags;  /* 1<<p means tagmethod(p) is not present */
   lu_byte lsizenode;  /* log2 of size of 'node' array */
-  // ĴС
+  // 数组的大小
   unsigned int sizearray;  /* size of 'array' array */
-  // 
+  // 数组
   TValue *array;  /* array part */
-  // ,Ԫ key-value ֵ
+  // 单链表,元素是 key-value 键值对
   Node *node;
   Node *lastfree;  /* any free position is before this position */
-  struct Table *metatable; // Ԫ
+  struct Table *metatable; // 元表
   GCObject *gclist;
 } Table;
 
@@ -65,6 +65,10 @@ LUAI_DDEF const char *const luaP_opnames[NUM_OPCODES+1] = {
   "CLOSURE",
   "VARARG",
   "EXTRAARG",
+  "MOVE2",
+  "FORLOOPI",
+  "FORPREPI",
+  "LCLOSURE",
   NULL
 };
 
@@ -120,5 +124,9 @@ LUAI_DDEF const lu_byte luaP_opmodes[NUM_OPCODES] = {
  ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_CLOSURE */
  ,opmode(0, 1, OpArgU, OpArgN, iABC)		/* OP_VARARG */
  ,opmode(0, 0, OpArgU, OpArgU, iAx)		/* OP_EXTRAARG */
+ ,opmode(0, 1, OpArgR, OpArgR, iABC)		/* OP_MOVE2 */
+ ,opmode(0, 1, OpArgR, OpArgN, iAsBx)		/* OP_FORLOOPI */
+ ,opmode(0, 1, OpArgR, OpArgN, iAsBx)		/* OP_FORPREPI */
+ ,opmode(0, 1, OpArgU, OpArgN, iABx)		/* OP_LCLOSURE */
 };
 
@@ -228,11 +228,17 @@ OP_CLOSURE,/*	A Bx	R(A) := closure(KPROTO[Bx])			*/
 
 OP_VARARG,/*	A B	R(A), R(A+1), ..., R(A+B-2) = vararg		*/
 
-OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
+OP_EXTRAARG,/*	Ax	extra (larger) argument for previous opcode	*/
+
+/* extra opcodes come last, so that the official ones keep their numbers */
+OP_MOVE2,/*	A B C	R(A) := R(B); R(A+1) := R(C)			*/
+OP_FORLOOPI,/*	A sBx	FORLOOP when R(A) and R(A+2) are integers	*/
+OP_FORPREPI,/*	A sBx	FORPREP when R(A) and R(A+2) are integers	*/
+OP_LCLOSURE/*	A Bx	R(A) := closure(KPROTO[Bx]) (reusing R(A))	*/
 } OpCode;
 
 
-#define NUM_OPCODES	(cast(int, OP_EXTRAARG) + 1)
+#define NUM_OPCODES	(cast(int, OP_LCLOSURE) + 1)
 
 
 
@@ -257,6 +263,11 @@ OP_EXTRAARG/*	Ax	extra (larger) argument for previous opcode	*/
 
   (*) All 'skips' (pc++) assume that next instruction is a jump.
 
+  (*) OP_LCLOSURE is used only for closures that are never copied out of
+  their frame (except to be called). When R(A) still has a closure of
+  the same prototype, left there by an earlier run of the instruction,
+  it gets the new upvalues instead of a new closure being created.
+
 ===========================================================================*/
 
 
@@ -46,15 +46,15 @@
 ** nodes for block list (list of active blocks)
 */
 typedef struct BlockCnt {
-  // ϼ BLock
+  // 上级 BLock
   struct BlockCnt *previous;  /* chain */
-  // һ label
+  // 第一个 label
   int firstlabel;  /* index of first label in this block */
   int firstgoto;  /* index of first pending goto in this block */
   lu_byte nactvar;  /* # active locals outside the block */
-  // Ƿ upval
+  // 是否是 upval
   lu_byte upval;  /* true if some variable in the block is an upvalue */
-  //  block Ƿѭ
+  // 这个 block 是否是循环
   lu_byte isloop;  /* true if 'block' is a loop */
 } BlockCnt;
 
@@ -146,7 +146,7 @@ static TString *str_checkname (LexState *ls) {
 
 
 static void init_exp (expdesc *e, expkind k, int i) {
-  // ʼ expdesc
+  // 初始化 expdesc
   e->f = e->t = NO_JUMP;
   e->k = k;
   e->u.info = i;
@@ -187,7 +187,7 @@ static void new_localvar (LexState *ls, TString *name) {
   dyd->actvar.arr[dyd->actvar.n++].idx = cast(short, reg);
 }
 
-// lsжȡһֵΪ name
+// 从ls中读取一个值，并保存为变量 name
 static void new_localvarliteral_ (LexState *ls, const char *name, size_t sz) {
   new_localvar(ls, luaX_newstring(ls, name, sz));
 }
@@ -195,7 +195,7 @@ static void new_localvarliteral_ (LexState *ls, const char *name, size_t sz) {
 #define new_localvarliteral(ls,v) \
 	new_localvarliteral_(ls, "" v, (sizeof(v)/sizeof(char))-1)
 
-// ȡ id Ϊ i ı
+// 获取 id 为 i 的变量
 static LocVar *getlocvar (FuncState *fs, int i) {
   int idx = fs->ls->dyd->actvar.arr[fs->firstlocal + i].idx;
   lua_assert(idx < fs->nlocvars);
@@ -203,12 +203,12 @@ static LocVar *getlocvar (FuncState *fs, int i) {
 }
 
 
-//  nvars local vars
+// 增加 nvars 个local vars
 static void adjustlocalvars (LexState *ls, int nvars) {
   FuncState *fs = ls->fs;
-  //  size
+  // 更新 size
   fs->nactvar = cast_byte(fs->nactvar + nvars);
-  // ʼ
+  // 初始化
   for (; nvars; nvars--) {
     getlocvar(fs, fs->nactvar - nvars)->startpc = fs->pc;
   }
@@ -233,18 +233,18 @@ static int searchupvalue (FuncState *fs, TString *name) {
 
 
 static int newupvalue (FuncState *fs, TString *name, expdesc *v) {
-  //  header
+  // 函数 header
   Proto *f = fs->f;
-  // ɵ size
+  // 旧的 size
   int oldsize = f->sizeupvalues;
-  // upvalues ܳ MAXUPVAL
+  // upvalues 不能超过 MAXUPVAL
   checklimit(fs, fs->nups + 1, MAXUPVAL, "upvalues");
-  // չ
+  // 扩展，
   luaM_growvector(fs->ls->L, f->upvalues, fs->nups, f->sizeupvalues,
                   Upvaldesc, MAXUPVAL, "upvalues");
-  // ʼ·
+  // 初始化新分配的
   while (oldsize < f->sizeupvalues) f->upvalues[oldsize++].name = NULL;
-  // upvalue
+  // 加入upvalue
   f->upvalues[fs->nups].instack = (v->k == VLOCAL);
   f->upvalues[fs->nups].idx = cast_byte(v->u.info);
   f->upvalues[fs->nups].name = name;
@@ -253,7 +253,7 @@ static int newupvalue (FuncState *fs, TString *name, expdesc *v) {
 }
 
 
-//  fs Ѱ Ϊ n ı
+// 在 fs 中寻找 名为 n 的变量
 static int searchvar (FuncState *fs, TString *n) {
   int i;
   for (i = cast_int(fs->nactvar) - 1; i >= 0; i--) {
@@ -445,7 +445,7 @@ static void movegotosout (FuncState *fs, BlockCnt *bl) {
   }
 }
 
-// ʼ block
+// 初始化 block
 static void enterblock (FuncState *fs, BlockCnt *bl, lu_byte isloop) {
   bl->isloop = isloop;
   bl->nactvar = fs->nactvar;
@@ -537,7 +537,7 @@ static void codeclosure (LexState *ls, expdesc *v) {
 
 static void open_func (LexState *ls, FuncState *fs, BlockCnt *bl) {
   Proto *f;
-  // ѵǰ fs  ls 
+  // 把当前的 fs 加入 ls 的链表
   fs->prev = ls->fs;  /* linked list of funcstates */
   fs->ls = ls;
   ls->fs = fs;
@@ -552,11 +552,11 @@ static void open_func (LexState *ls, FuncState *fs, BlockCnt *bl) {
   fs->nactvar = 0;
   fs->firstlocal = ls->dyd->actvar.n;
   fs->bl = NULL;
-  //  funcstate ȡ proto
+  // 从 funcstate 获取 proto
   f = fs->f;
   f->source = ls->source;
   f->maxstacksize = 2;  /* registers 0/1 are always valid */
-  // ʼ block
+  // 初始化 block
   enterblock(fs, bl, 0);
 }
 
@@ -610,15 +610,15 @@ static int block_follow (LexState *ls, int withuntil) {
 
 static void statlist (LexState *ls) {
   /* statlist -> { stat [';'] } */
-  // statlist ɸ stat ɣ ÿ stat Ը򲻸 ';'
-  // ѭֱ else/elseif/end/eos TOKEN
+  // statlist 由若干个 stat 组成， 每个 stat 后面可以跟或不跟 ';'
+  // 循环直到遇到 else/elseif/end/eos TOKEN
   while (!block_follow(ls, 1)) {
     if (ls->t.token == TK_RETURN) {
-	  //  return, ȡ return statement ֱӷ
+	  // 若遇到 return, 则读取 return statement 后，直接返回
       statement(ls);
       return;  /* 'return' must be last statement */
     }
-	// ¸ statement
+	// 生成下个 statement
     statement(ls);
   }
 }
@@ -818,11 +818,11 @@ static void body (LexState *ls, expdesc *e, int ismethod, int line) {
 }
 
 
-//  expr б
+// 生成 expr 列表
 static int explist (LexState *ls, expdesc *v) {
   /* explist -> expr { ',' expr } */
   int n = 1;  /* at least one expression */
-  // ȡһ expr
+  // 读取一个 expr
   expr(ls, v);
   while (testnext(ls, ',')) {
     luaK_exp2nextreg(ls->fs, v);
@@ -886,7 +886,7 @@ static void funcargs (LexState *ls, expdesc *f, int line) {
 ** =======================================================================
 */
 
-// Ҫʽ
+// 主要表达式
 static void primaryexp (LexState *ls, expdesc *v) {
   /* primaryexp -> NAME | '(' expr ')' */
   // name 
@@ -1068,7 +1068,7 @@ static const struct {
 ** subexpr -> (simpleexp | unop subexpr) { binop subexpr }
 ** where 'binop' is any binary operator with a priority higher than 'limit'
 */
-// simpleexp + ɸ binop sunexpr
+// simpleexp + 若干个 binop sunexpr
 //     5        +      ( 2 + 1)
 // simpleexp  binop     subexpr
 
@@ -1078,36 +1078,36 @@ static BinOpr subexpr (LexState *ls, expdesc *v, int limit) {
   BinOpr op;
   UnOpr uop;
   enterlevel(ls);
-  // unopr Ŀ
+  // unopr 单目运算符
   uop = getunopr(ls->t.token);
   if (uop != OPR_NOUNOPR) {
 	// unop subexpr
-	// Ŀ
+	// 单目运算符
     int line = ls->linenumber;
-	// ȡ subexpr
+	// 获取 subexpr
     luaX_next(ls);
     subexpr(ls, v, UNARY_PRIORITY);
 
-	// ΪղŻȡ subexpr ǰ׺ uop
+	// 为刚才获取的 subexpr 加上前缀 uop
     luaK_prefix(ls->fs, uop, v, line);
   }
   else simpleexp(ls, v); 
   /* expand while operators have priorities higher than 'limit' */
-  //  { binop sunexpr }
+  // 检测后续的 { binop sunexpr }
   op = getbinopr(ls->t.token);
   while (op != OPR_NOBINOPR && priority[op].left > limit) {
-	// ҵ binop, 
+	// 找到 binop, 且
     expdesc v2;
     BinOpr nextop;
     int line = ls->linenumber;
-	//  v ׺
+	// 把 v 放入中缀
     luaX_next(ls);
     luaK_infix(ls->fs, op, v);
     /* read sub-expression with higher priority */
-	// ȡ subexpr
+	// 读取 subexpr
     nextop = subexpr(ls, &v2, priority[op].right);
 
-	// 
+	// 组合
     luaK_posfix(ls->fs, op, v, &v2, line);
     op = nextop;
   }
@@ -1130,10 +1130,10 @@ static void expr (LexState *ls, expdesc *v) {
 ** =======================================================================
 */
 
-// ȡһblock
+// 读取一个block
 static void block (LexState *ls) {
   /* block -> statlist */
-  // block  statlist 
+  // block 由 statlist 组成
   FuncState *fs = ls->fs;
   BlockCnt bl;
   enterblock(fs, &bl, 0);
@@ -1265,7 +1265,7 @@ static void skipnoopstat (LexState *ls) {
 }
 
 
-// ȡ label
+// 读取 label
 static void labelstat (LexState *ls, TString *label, int line) {
   /* label -> '::' NAME '::' */
   FuncState *fs = ls->fs;
@@ -1323,32 +1323,37 @@ static void repeatstat (LexState *ls, int line) {
 }
 
 
-// ȡһ ʽ
+// 读取一个 表达式
+/* returns whether the expression is an integer constant */
 static int exp1 (LexState *ls) {
   expdesc e;
-  int reg;
+  int isint;
   // expr
   expr(ls, &e);
+  isint = (e.k == VKINT && e.t == NO_JUMP && e.f == NO_JUMP);
   luaK_exp2nextreg(ls->fs, &e);
   lua_assert(e.k == VNONRELOC);
-  reg = e.u.info;
-  return reg;
+  return isint;
 }
 
 
-static void forbody (LexState *ls, int base, int line, int nvars, int isnum) {
+static void forbody (LexState *ls, int base, int line, int nvars, int isnum,
+                     int isint) {
   /* forbody -> DO block */
   // for a=1,2 do
   //	block
   BlockCnt bl;
   FuncState *fs = ls->fs;
   int prep, endfor;
-  // Ӿֲ
+  // 增加局部变量
   adjustlocalvars(ls, 3);  /* control variables */
-  // Ѱ do
+  // 寻找 do
   checknext(ls, TK_DO);
   // 
-  prep = isnum ? luaK_codeAsBx(fs, OP_FORPREP, base, NO_JUMP) : luaK_jump(fs);
+  if (isnum)  /* numeric for? (integer initial value and step?) */
+    prep = luaK_codeAsBx(fs, isint ? OP_FORPREPI : OP_FORPREP, base, NO_JUMP);
+  else
+    prep = luaK_jump(fs);
   enterblock(fs, &bl, 0);  /* scope for declared variables */
   adjustlocalvars(ls, nvars);
   luaK_reserveregs(fs, nvars);
@@ -1356,8 +1361,9 @@ static void forbody (LexState *ls, int base, int line, int nvars, int isnum) {
   leaveblock(fs);  /* end of scope for declared variables */
   luaK_patchtohere(fs, prep);
   if (isnum)  /* numeric for? */
-    //  block Ϊѭ
-	endfor = luaK_codeAsBx(fs, OP_FORLOOP, base, NO_JUMP);
+    // 把上面的 block 作为循环体
+	endfor = luaK_codeAsBx(fs, isint ? OP_FORLOOPI : OP_FORLOOP, base,
+	                       NO_JUMP);
   else {  /* generic for */
     luaK_codeABC(fs, OP_TFORCALL, base, 0, nvars);
     luaK_fixline(fs, line);
@@ -1372,27 +1378,28 @@ static void fornum (LexState *ls, TString *varname, int line) {
   /* fornum -> NAME = exp1,exp1[,exp1] forbody */
   FuncState *fs = ls->fs;
   int base = fs->freereg;
+  int isint;
   new_localvarliteral(ls, "(for index)");
   new_localvarliteral(ls, "(for limit)");
   new_localvarliteral(ls, "(for step)");
-  // ѭ
+  // 循环变量
   new_localvar(ls, varname);
   checknext(ls, '=');
-  // ʼֵ
-  exp1(ls);  /* initial value */
+  // 起始值
+  isint = exp1(ls);  /* initial value */
   checknext(ls, ',');
-  // ֵֹ
+  // 终止值
   exp1(ls);  /* limit */
-  // ܴڵĲ
+  // 可能存在的步长
   if (testnext(ls, ','))
-    exp1(ls);  /* optional step */
+    isint &= exp1(ls);  /* optional step */
   else {  /* default step = 1 */
-	// ڲ
+	// 不存在步长
     luaK_codek(fs, fs->freereg, luaK_intK(fs, 1));
     luaK_reserveregs(fs, 1);
   }
-  // ѭ
-  forbody(ls, base, line, 1, 1);
+  // 循环体
+  forbody(ls, base, line, 1, 1, isint);
 }
 
 
@@ -1417,7 +1424,7 @@ static void forlist (LexState *ls, TString *indexname) {
   line = ls->linenumber;
   adjust_assign(ls, 3, explist(ls, &e), &e);
   luaK_checkstack(fs, 3);  /* extra space to call generator */
-  forbody(ls, base, line, nvars - 3, 0);
+  forbody(ls, base, line, nvars - 3, 0, 0);
 }
 
 
@@ -1427,13 +1434,13 @@ static void forstat (LexState *ls, int line) {
   //	for (fornum | forlist) 
   //		???
   //	end
-  // ѭ  fornum | forlist 
+  // 可能循环体 包含在 fornum | forlist 中
   FuncState *fs = ls->fs;
   TString *varname;
   BlockCnt bl;
   enterblock(fs, &bl, 1);  /* scope for loop and control variables */
   luaX_next(ls);  /* skip 'for' */
-  // ѭ
+  // 循环变量
   varname = str_checkname(ls);  /* first variable name */
   switch (ls->t.token) {
     case '=': fornum(ls, varname, line); break;
@@ -1445,7 +1452,7 @@ static void forstat (LexState *ls, int line) {
 }
 
 
-// ȡһ test_then_block
+// 读取一个 test_then_block
 static void test_then_block (LexState *ls, int *escapelist) {
   /* test_then_block -> [IF | ELSEIF] cond THEN block */
   // 
@@ -1453,8 +1460,8 @@ static void test_then_block (LexState *ls, int *escapelist) {
   FuncState *fs = ls->fs;
   expdesc v;
   int jf;  /* instruction to skip 'then' code (if condition is false) */
-  // if  elseif  token
-  // ϣ if  elseif llex зʱӦѾ pass 
+  // 跳过if 或者 elseif 这个 token
+  // 理论上， if 或者 elseif 在llex 中分析时，不就应该已经 pass 了
   luaX_next(ls);  /* skip IF or ELSEIF */
   // cond
   expr(ls, &v);  /* read condition */
@@ -1474,12 +1481,12 @@ static void test_then_block (LexState *ls, int *escapelist) {
       jf = luaK_jump(fs);
   }
   else {  /* regular case (not goto/break) */
-	//  cond == trueе block
+	// 如果 cond == true，则运行的 block
     luaK_goiftrue(ls->fs, &v);  /* skip over block if condition is false */
     enterblock(fs, &bl, 0);
     jf = v.f;
   }
-  // block  statlist
+  // block 的 statlist
   statlist(ls);  /* 'then' part */
   // leave block
   leaveblock(fs);
@@ -1491,10 +1498,10 @@ static void test_then_block (LexState *ls, int *escapelist) {
 }
 
 
-// ȡһ ifstat
+// 读取一个 ifstat
 static void ifstat (LexState *ls, int line) {
   /* ifstat -> IF cond THEN block {ELSEIF cond THEN block} [ELSE block] END */
-  /* һifstat ﷨
+  /* 一个ifstat 由下面的语法组成
   // if cond then
   //	block
   // {elseif cond then
@@ -1506,13 +1513,13 @@ static void ifstat (LexState *ls, int line) {
   FuncState *fs = ls->fs;
   int escapelist = NO_JUMP;  /* exit list for finished parts */
   test_then_block(ls, &escapelist);  /* IF cond THEN block */
-  // һ token  elseif һֱȥ
+  // 如果下一个 token 是 elseif ，则一直找下去
   while (ls->t.token == TK_ELSEIF)
     test_then_block(ls, &escapelist);  /* ELSEIF cond THEN block */
-  // ʱ token  else
+  // 此时 token 可能是 else
   if (testnext(ls, TK_ELSE))
     block(ls);  /* 'else' part */
-  // Ѱ end
+  // 寻找 end
   check_match(ls, TK_END, TK_IF, line);
   luaK_patchtohere(fs, escapelist);  /* patch escape list to 'if' end */
 }
@@ -1577,13 +1584,13 @@ static void funcstat (LexState *ls, int line) {
 
 static void exprstat (LexState *ls) {
   /* stat -> func | assignment */
-  // Ӧ ֵʽ
+  // 这个应该是 赋值表达式
   FuncState *fs = ls->fs;
   struct LHS_assign v;
-  // Ӻ׺
+  // 添加后缀
   suffixedexp(ls, &v.v);
   if (ls->t.token == '=' || ls->t.token == ',') { /* stat -> assignment ? */
-	// ֵʽ
+	// 赋值表达式
     v.prev = NULL;
     assignment(ls, &v, 1);
   }
@@ -1606,7 +1613,7 @@ static void retstat (LexState *ls) {
   else {
 	// return exprlist
     nret = explist(ls, &e);  /* optional return values */
-	// call or vavarg в
+	// call or vavarg 尚不清楚
     if (hasmultret(e.k)) {
       luaK_setmultret(fs, &e);
       if (e.k == VCALL && nret == 1) {  /* tail call? */
@@ -1617,29 +1624,29 @@ static void retstat (LexState *ls) {
       nret = LUA_MULTRET;  /* return all values */
     }
     else {
-	  // Ѱֵ
+	  // 寻常返回值
       if (nret == 1)  /* only one single value? */
-		// һֵ  e 浽reg
+		// 一个返回值， 将 e 保存到reg
         first = luaK_exp2anyreg(fs, &e);
       else {
-		// ֵͬ e 浽ret
+		// 多个返回值，同样将 e 保存到ret
         luaK_exp2nextreg(fs, &e);  /* values must go to the stack */
         first = fs->nactvar;  /* return all active values */
         lua_assert(nret == fs->freereg - first);
       }
     }
   }
-  // ֽ룬 reg е e 
+  // 生成字节码，将 reg 中的 e 返回
   luaK_ret(fs, first, nret);
   testnext(ls, ';');  /* skip optional semicolon */
 }
 
 
-// ȡһ statement, statement ԽΪ
+// 读取一个 statement, statement 相对较为复杂
 static void statement (LexState *ls) {
   int line = ls->linenumber;  /* may be needed for error messages */
   enterlevel(ls);
-  // Ϊ˼';'鹹һ xstat
+  // 为了加上';'，虚构一个 xstat
   // statement :== 
   //	xstat[;]
   // xstat :==
@@ -1654,29 +1661,29 @@ static void statement (LexState *ls) {
   //	retstat  PS: ret stat
   //	breakstat
   //	gotostat
-  //	УΪ exprstat
+  //	如果不属于上列，则为 exprstat
   //	exprstat
   //
   switch (ls->t.token) {
     case ';': {  /* stat -> ';' (empty statement) */
-	  // ֱ ;
+	  // 直接跳过 ;
       luaX_next(ls);  /* skip ';' */
       break;
     }
     case TK_IF: {  /* stat -> ifstat */
 	  // if a == b then
 	  // end
-	  // ȡ ifstat
+	  // 读取 ifstat
       ifstat(ls, line);
       break;
     }
     case TK_WHILE: {  /* stat -> whilestat */
-	  // ȡ whilestat
+	  // 读取 whilestat
       whilestat(ls, line);
       break;
     }
     case TK_DO: {  /* stat -> DO block END */
-	  //  do token
+	  // 跳过 do 这个token
       luaX_next(ls);  /* skip DO */
 	  // block
       block(ls);
@@ -1685,7 +1692,7 @@ static void statement (LexState *ls) {
       break;
     }
     case TK_FOR: {  /* stat -> forstat */
-	  // ȡ forstat
+	  // 读取 forstat
       forstat(ls, line);
       break;
     }
@@ -1741,17 +1748,17 @@ static void statement (LexState *ls) {
 static void mainfunc (LexState *ls, FuncState *fs) {
   BlockCnt bl;
   expdesc v;
-  // ʼ fsĶ block
+  // 初始化 fs，的顶层 block
   open_func(ls, fs, &bl);
   fs->f->is_vararg = 2;  /* main function is always declared vararg */
-  // ʼ expdesc
+  // 初始化 expdesc
   init_exp(&v, VLOCAL, 0);  /* create and... */
-  //  Ϊ upvalue
+  // 把 环境变量作为 upvalue
   newupvalue(fs, ls->envn, &v);  /* ...set environment upvalue */
-  // ȡһ token
+  // 读取第一个 token
   luaX_next(ls);  /* read first token */
 
-  // Ҫ statlist
+  // 主要的 statlist
   statlist(ls);  /* parse main body */
   check(ls, TK_EOS);
   close_func(ls);
@@ -1759,32 +1766,35 @@ static void mainfunc (LexState *ls, FuncState *fs) {
 
 
 LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                       Dyndata *dyd, const char *name, int firstchar) {
+                       Dyndata *dyd, const char *name, int firstchar,
+                       int optimize) {
   LexState lexstate;
   FuncState funcstate;
 
-  //  հ
+  // 创建 闭包
   LClosure *cl = luaF_newLclosure(L, 1);  /* create main closure */
-  // ѹջֹ gc 
+  // 压入栈，防止被 gc 回收了
   setclLvalue(L, L->top, cl);  /* anchor it (to avoid being collected) */
   luaD_inctop(L);
-  // Ϊ lexstate һtable
+  // 为 lexstate 申请一个table
   lexstate.h = luaH_new(L);  /* create table for scanner */
   sethvalue(L, L->top, lexstate.h);  /* anchor it */
   luaD_inctop(L);
 
-  // ԭ
+  // 创建函数原型
   funcstate.f = cl->p = luaF_newproto(L);
-  // c -> luaַתΪ lua ַ
+  // c -> lua，字符串转换为 lua 字符串
   funcstate.f->source = luaS_new(L, name);  /* create and anchor TString */
   lua_assert(iswhite(funcstate.f));  /* do not need barrier here */
   lexstate.buff = buff;
   lexstate.dyd = dyd;
   dyd->actvar.n = dyd->gt.n = dyd->label.n = 0;
 
-  //  lexstate Ϊ z
+  // 设置 lexstate 的输入流为 z
   luaX_setinput(L, &lexstate, z, funcstate.f->source, firstchar);
   mainfunc(&lexstate, &funcstate);
+  if (optimize)
+    luaK_optimize(L, funcstate.f, optimize > 1);
 
   lua_assert(!funcstate.prev && funcstate.nups == 1 && !lexstate.fs);
   /* all scopes should be correctly finished */
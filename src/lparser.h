@@ -39,7 +39,7 @@ typedef enum {
 #define vkisinreg(k)	((k) == VNONRELOC || (k) == VLOCAL)
 
 typedef struct expdesc {
-  // ʽ
+  // 表达式类型
   expkind k;
   union {
     struct {  /* for indexed variables (VINDEXED) */
@@ -57,7 +57,7 @@ typedef struct expdesc {
 
 
 /* description of active local variable */
-//  stackеλ
+// 变量在 stack中的位置
 typedef struct Vardesc {
   short idx;  /* variable index in stack */
 } Vardesc;
@@ -73,7 +73,7 @@ typedef struct Labeldesc {
 
 
 /* list of labels or gotos */
-// labels  goto ĵ
+// labels 或者是 可以goto 的点
 typedef struct Labellist {
   Labeldesc *arr;  /* array */
   int n;  /* number of entries in use */
@@ -99,7 +99,7 @@ struct BlockCnt;  /* defined in lparser.c */
 
 /* state needed to generate code for a given function */
 typedef struct FuncState {
-  // һ Ϣ
+  // 一个函数的 信息
   Proto *f;  /* current function header */
   struct FuncState *prev;  /* enclosing function */
   struct LexState *ls;  /* lexical state */
@@ -118,7 +118,8 @@ typedef struct FuncState {
 
 
 LUAI_FUNC LClosure *luaY_parser (lua_State *L, ZIO *z, Mbuffer *buff,
-                                 Dyndata *dyd, const char *name, int firstchar);
+                                 Dyndata *dyd, const char *name, int firstchar,
+                                 int optimize);
 
 
 #endif
@@ -7,6 +7,10 @@
 #define lstate_c
 #define LUA_CORE
 
+#if defined(LUA_USE_THREADS) && defined(__linux__)
+#define _GNU_SOURCE	/* for 'syscall' */
+#endif
+
 #include "lprefix.h"
 
 
@@ -36,6 +40,10 @@
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 #endif
 
+#if !defined(LUAI_GCFINMAX)
+#define LUAI_GCFINMAX	100  /* at most 100 finalizers in each GC step */
+#endif
+
 
 /*
 ** a macro to help the creation of a unique random seed when a state is
@@ -48,6 +56,115 @@
 
 
 
+/*
+** {======================================================
+** Lock for a state shared by several OS threads (LUA_USE_THREADS)
+** The lock starts biased to the thread that created the state: while
+** no other thread asks for it, that thread takes and releases it with
+** plain stores ('lua_lock' and 'lua_unlock' in llimits.h). The first
+** other thread that wants the lock revokes the bias: it raises
+** 'lockrevoked' and runs a process-wide memory barrier, so that the
+** owner either sees the flag or is seen holding the lock. From then on
+** the lock is a ticket lock: a thread takes a ticket with one atomic
+** add and owns the state when 'serving' gets to its ticket. Only
+** threads that must wait go to the OS (after spinning a little), and
+** they are served in arrival order, so that 'luaE_threadyield' gives
+** the state to the thread that waited longest. Systems without a
+** process-wide barrier start with the ticket lock. Both ways the lock
+** is reentrant, so that a thread in a batch of API calls may still
+** lock the state through its other coroutines.
+** =======================================================
+*/
+#if defined(LUA_USE_THREADS)
+
+#if !defined(LUAI_LOCKSPIN)
+#define LUAI_LOCKSPIN	100
+#endif
+
+#if defined(_WIN32)
+
+#include <windows.h>
+
+typedef CRITICAL_SECTION l_osmutex;
+typedef CONDITION_VARIABLE l_oscond;
+
+#define l_osinit(m,c)	(InitializeCriticalSection(m), \
+			 InitializeConditionVariable(c))
+#define l_osfree(m,c)	DeleteCriticalSection(m)
+#define l_oslock(m)	EnterCriticalSection(m)
+#define l_osunlock(m)	LeaveCriticalSection(m)
+#define l_oswait(c,m)	SleepConditionVariableCS(c, m, INFINITE)
+#define l_osbroadcast(c)	WakeAllConditionVariable(c)
+#define l_osyield()	SwitchToThread()
+
+#define l_fetchadd(p,v)	InterlockedExchangeAdd((p), (v))
+#define l_load(p)	InterlockedCompareExchange((p), 0, 0)
+#define l_store(p,v)	InterlockedExchange((p), (v))
+#define l_getacq(p)	(*(p))  /* volatile loads acquire in MSVC */
+
+#define l_heavybarrier()	FlushProcessWriteBuffers()
+#define l_hasheavybarrier()	1
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+
+typedef pthread_mutex_t l_osmutex;
+typedef pthread_cond_t l_oscond;
+
+#define l_osinit(m,c)	(pthread_mutex_init(m, NULL), \
+			 pthread_cond_init(c, NULL))
+#define l_osfree(m,c)	(pthread_mutex_destroy(m), pthread_cond_destroy(c))
+#define l_oslock(m)	pthread_mutex_lock(m)
+#define l_osunlock(m)	pthread_mutex_unlock(m)
+#define l_oswait(c,m)	pthread_cond_wait(c, m)
+#define l_osbroadcast(c)	pthread_cond_broadcast(c)
+#define l_osyield()	sched_yield()
+
+#define l_fetchadd(p,v)	__atomic_fetch_add((p), (v), __ATOMIC_SEQ_CST)
+#define l_load(p)	__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define l_store(p,v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define l_getacq(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+
+#if defined(__linux__)
+
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define l_heavybarrier()  \
+	syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0)
+#define l_hasheavybarrier()  \
+	(syscall(__NR_membarrier, \
+	         MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0)
+
+#else
+
+#define l_heavybarrier()	((void)0)
+#define l_hasheavybarrier()	0
+
+#endif
+
+#endif
+
+
+/* ticket lock, used when the lock is not biased */
+typedef struct GLock {
+  volatile long next;  /* next ticket */
+  volatile long serving;  /* ticket of the holder */
+  volatile long nsleeping;  /* threads waiting on 'cond' */
+  void *volatile holder;  /* thread holding the lock (or NULL) */
+  long depth;  /* times the holder holds it */
+  l_osmutex m;
+  l_oscond cond;
+} GLock;
+
+#endif
+
+/* }====================================================== */
+
+
 /*
 ** thread state + extra space
 */
@@ -63,6 +180,9 @@ typedef struct LX {
 typedef struct LG {
   LX l;
   global_State g;
+#if defined(LUA_USE_THREADS)
+  GLock lock;
+#endif
 } LG;
 
 
@@ -70,6 +190,191 @@ typedef struct LG {
 #define fromstate(L)	(cast(LX *, cast(lu_byte *, (L)) - offsetof(LX, l)))
 
 
+
+#if defined(LUA_USE_THREADS)
+
+#define getlock(gs)  \
+	(&cast(LG *, cast(lu_byte *, (gs)) - offsetof(LG, g))->lock)
+
+
+luai_threadlocal char luai_threadid;
+
+
+/*
+** Takes the bias away from its owner, waiting for the owner to release
+** the lock if it holds it
+*/
+static void revokebias (global_State *g) {
+  GLock *gl = getlock(g);
+  l_oslock(&gl->m);  /* one revoker at a time */
+  if (luai_get(&g->lockowner) != NULL) {
+    luai_set(&g->lockrevoked, 1);
+    l_heavybarrier();  /* owner now sees 'lockrevoked' or we see it hold */
+    while (l_getacq(&g->lockheld) || l_getacq(&g->lockbatched))
+      l_osyield();  /* owner gives it up at its next unlock or yield point */
+    luai_set(&g->lockowner, NULL);
+  }
+  l_osunlock(&gl->m);
+}
+
+
+static void waitturn (GLock *gl, long t) {
+  int i;
+  for (i = 0; i < LUAI_LOCKSPIN; i++) {
+    if (l_load(&gl->serving) == t) return;
+  }
+  l_oslock(&gl->m);
+  l_fetchadd(&gl->nsleeping, 1);  /* count itself before the last check */
+  while (l_load(&gl->serving) != t)
+    l_oswait(&gl->cond, &gl->m);
+  l_fetchadd(&gl->nsleeping, -1);
+  l_osunlock(&gl->m);
+}
+
+
+/*
+** slow path of 'lua_lock': the lock is not biased to the running thread
+** (or the bias is being revoked, and then what the thread holds through
+** the bias, counting the hold it was taking, passes to the ticket lock)
+*/
+void luaE_lock (lua_State *L) {
+  global_State *g = G(L);
+  GLock *gl = getlock(g);
+  void *owner = luai_get(&g->lockowner);
+  long n = 1;  /* levels to take */
+  long t;
+  if (owner == luai_self()) {  /* bias being revoked? */
+    n = luai_get(&g->lockheld) + luai_get(&g->lockbatched);
+    luai_setrel(&g->lockbatched, 0);
+    luai_setrel(&g->lockheld, 0);  /* let the revoker go on */
+  }
+  else if (owner != NULL)
+    revokebias(g);
+  if (luai_get(&gl->holder) == luai_self()) {  /* holds it already? */
+    gl->depth += n;
+    return;
+  }
+  t = l_fetchadd(&gl->next, 1);
+  if (l_load(&gl->serving) != t)  /* not its turn? */
+    waitturn(gl, t);
+  luai_set(&gl->holder, luai_self());
+  gl->depth = n;
+}
+
+
+/* slow path of 'lua_unlock' */
+void luaE_unlock (lua_State *L) {
+  GLock *gl = getlock(G(L));
+  if (--gl->depth > 0)  /* still held at an outer level? */
+    return;
+  luai_set(&gl->holder, NULL);
+  l_store(&gl->serving, gl->serving + 1);
+  if (l_load(&gl->nsleeping) > 0) {  /* anyone asleep? */
+    l_oslock(&gl->m);
+    l_osbroadcast(&gl->cond);
+    l_osunlock(&gl->m);
+  }
+}
+
+
+/*
+** called by the VM every LUAI_THREADYIELD yield points; passes the state
+** to the next thread in line, if there is one. The lock is released at
+** all its levels, and taken back as deep as it was.
+*/
+void luaE_threadyield (lua_State *L) {
+  global_State *g = G(L);
+  GLock *gl = getlock(g);
+  if (luai_get(&gl->holder) != luai_self()) {  /* holds it by the bias? */
+    if (luai_get(&g->lockrevoked))  /* someone wants it? */
+      luaE_lock(L);  /* give the bias up and wait for a ticket */
+  }
+  else if (l_load(&gl->next) != gl->serving + 1) {  /* anyone waiting? */
+    long depth = gl->depth;
+    gl->depth = 1;
+    luaE_unlock(L);
+    luaE_lock(L);
+    gl->depth = depth;
+  }
+}
+
+
+/*
+** Batches of API calls: between 'luaE_beginbatch' and 'luaE_endbatch'
+** the OS thread running 'L' keeps the lock, so that the API calls on
+** 'L' in between do not take it. (A coroutine runs in one OS thread at
+** a time.) The standard libraries open batches around loops of API
+** calls; the Lua code they call runs inside the batch, but still
+** passes the state on at yield points. Batches held through the bias
+** count in 'lockbatched'; 'lockheld' needs no count, as the locks taken
+** by API calls nest only inside batches.
+*/
+void luaE_beginbatch (lua_State *L) {
+  global_State *g = G(L);
+  if (L->lockbatch++ > 0)  /* in a batch already? */
+    return;
+  if (luai_get(&g->lockowner) == luai_self()) {
+    luai_set(&g->lockbatched, g->lockbatched + 1);
+    luai_barrier();
+    if (!luai_get(&g->lockrevoked))
+      return;
+  }
+  luaE_lock(L);
+}
+
+
+void luaE_endbatch (lua_State *L) {
+  global_State *g = G(L);
+  lua_assert(L->lockbatch > 0);
+  if (--L->lockbatch > 0)  /* still in a batch? */
+    return;
+  if (luai_get(&g->lockowner) == luai_self() &&
+      luai_get(&g->lockbatched) > 0)
+    luai_setrel(&g->lockbatched, g->lockbatched - 1);
+  else
+    luaE_unlock(L);
+}
+
+
+/*
+** closes the batches of 'L' that an error left open, down to level 'n';
+** the lock held by the outermost one passes to the handler of the
+** error, which releases it as if 'lua_error' had taken it
+*/
+void luaE_dropbatch (lua_State *L, unsigned short n) {
+  global_State *g = G(L);
+  if (L->lockbatch <= n)
+    return;
+  L->lockbatch = n;
+  if (n == 0 && luai_get(&g->lockowner) == luai_self() &&
+      luai_get(&g->lockbatched) > 0) {
+    luai_set(&g->lockheld, 1);
+    luai_setrel(&g->lockbatched, g->lockbatched - 1);
+  }
+}
+
+
+
+static void initlock (global_State *g) {
+  GLock *gl = getlock(g);
+  g->lockowner = l_hasheavybarrier() ? luai_self() : NULL;
+  g->lockheld = g->lockbatched = g->lockrevoked = 0;
+  gl->next = gl->serving = gl->nsleeping = 0;
+  gl->holder = NULL;
+  gl->depth = 0;
+  l_osinit(&gl->m, &gl->cond);
+}
+
+#define freelock(g)	{ GLock *gl_ = getlock(g); l_osfree(&gl_->m, &gl_->cond); }
+
+#else
+
+#define initlock(g)	((void)0)
+#define freelock(g)	((void)0)
+
+#endif
+
+
 /*
 ** Compute an initial seed as random as possible. Rely on Address Space
 ** Layout Randomization (if present) to increase randomness..
@@ -105,10 +410,23 @@ void luaE_setdebt (global_State *g, l_mem debt) {
 }
 
 
+/*
+** Set the C function that behaves like the 'next' of the base library
+** (for the base library only). Generic 'for' loops over it and a table
+** traverse the table in the VM, without calling the function.
+*/
+void luaE_setnextf (lua_State *L, lua_CFunction f) {
+  lua_lock(L);
+  G(L)->nextf = f;
+  lua_unlock(L);
+}
+
+
 CallInfo *luaE_extendCI (lua_State *L) {
-  CallInfo *ci = luaM_new(L, CallInfo);
+  CallInfo *ci = cast(CallInfo *,
+                   luaM_poolalloc(L, &G(L)->cipool, sizeof(CallInfo)));
   lua_assert(L->ci->next == NULL);
-  // һµ ciӽ
+  // 创建一个新的 ci，并添加进链表
   L->ci->next = ci;
   ci->previous = L->ci;
   ci->next = NULL;
@@ -126,7 +444,7 @@ void luaE_freeCI (lua_State *L) {
   ci->next = NULL;
   while ((ci = next) != NULL) {
     next = ci->next;
-    luaM_free(L, ci);
+    luaM_poolfree(L, &G(L)->cipool, ci, sizeof(CallInfo));
     L->nci--;
   }
 }
@@ -140,48 +458,91 @@ void luaE_shrinkCI (lua_State *L) {
   CallInfo *next2;  /* next's next */
   /* while there are two nexts */
   while (ci->next != NULL && (next2 = ci->next->next) != NULL) {
-    luaM_free(L, ci->next);  /* free next */
+    luaM_poolfree(L, &G(L)->cipool, ci->next, sizeof(CallInfo));
     L->nci--;
     ci->next = next2;  /* remove 'next' from the list */
     next2->previous = ci;
     ci = next2;  /* keep next's next */
   }
 }
+
+
+/*
+** size of a pooled thread; as other pooled memory, it does not count
+** as allocated
+*/
+#define pooledsize(L1)	(sizeof(LX) + (L1)->stacksize * sizeof(TValue))
+
+
+static void trimthreads (lua_State *L, int all) {
+  global_State *g = G(L);
+  GCObject **p = &g->thpool;
+  while (*p != NULL) {
+    lua_State *L1 = gco2th(*p);
+    *p = L1->next;  /* remove it from the pool */
+    g->nthpool--;
+    (*g->frealloc)(g->ud, L1->stack, L1->stacksize * sizeof(TValue), 0);
+    (*g->frealloc)(g->ud, fromstate(L1), sizeof(LX), 0);
+    if (!all && *p != NULL)
+      p = &(*p)->next;  /* keep next one */
+  }
+}
+
+
+/*
+** give back to the allocator half of the pooled structures (all of
+** them if 'all'); called by the collector at the end of each cycle
+*/
+void luaE_trimpools (lua_State *L, int all) {
+  global_State *g = G(L);
+  int i;
+  luaM_pooltrim(L, &g->uvpool, sizeof(UpVal), all);
+  luaM_pooltrim(L, &g->cipool, sizeof(CallInfo), all);
+  for (i = 0; i < NCLPOOLS; i++)
+    luaM_pooltrim(L, &g->clpool[i], sizeLclosure(i), all);
+  trimthreads(L, all);
+}
 #include <stdio.h>
-// ʼջ
-static void stack_init (lua_State *L1, lua_State *L) {
+// 重置栈（新建的栈，或者线程池中复用的栈）
+static void stack_reset (lua_State *L1) {
   int i; CallInfo *ci;
-  /* initialize stack array */
-  // һСΪ BASIC_STACK_SIZE ջջλСΪ sizeof(TValue)
-  // BASIC_STACK_SIZE : 2 * ջСֵ 2 * 20 = 40
-  // ܴС sizeof(TValue) * 40 == 640
-  // sizeof(TValue) == 16
-  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);
-  L1->stacksize = BASIC_STACK_SIZE;
-  // ջԪصԪΪֵ
-  for (i = 0; i < BASIC_STACK_SIZE; i++)
-    setnilvalue(L1->stack + i);  /* erase new stack */
-  // ʼջ
+  // 将栈元素的元素设为空值
+  for (i = 0; i < L1->stacksize; i++)
+    setnilvalue(L1->stack + i);  /* erase stack */
+  // 初始化栈顶
   L1->top = L1->stack;
   // 
-  // ָ5stackԪ
+  // 指向倒数第5个stack元素
   L1->stack_last = L1->stack + L1->stacksize - EXTRA_STACK;
   /* initialize first ci */
-  // ʼһ call info
+  // 初始化第一个 call info
   ci = &L1->base_ci;
   ci->next = ci->previous = NULL;
   ci->callstatus = 0;
-  // ci func,ջеindex
+  // ci func,在栈中的index
   ci->func = L1->top;
-  // ָentryʼΪnil
-  // Ҳ˵ջеһԪ ci  func
+  // 将上面指定的entry初始化为nil
+  // 也就是说，栈中第一个元素是 ci 的 func
   setnilvalue(L1->top++);  /* 'function' entry for this 'ci' */
-  //  call_info ջ 1 + 20 ʼ
+  // 这个调用 call_info 的栈，从 1 + 20 开始，
   ci->top = L1->top + LUA_MINSTACK;
   L1->ci = ci;
 }
 
 
+// 初始化栈
+static void stack_init (lua_State *L1, lua_State *L) {
+  /* initialize stack array */
+  // 申请一个大小为 BASIC_STACK_SIZE 的栈，栈单位大小为 sizeof(TValue)
+  // BASIC_STACK_SIZE : 2 * 栈的最小值， 2 * 20 = 40
+  // 总大小 sizeof(TValue) * 40 == 640
+  // sizeof(TValue) == 16
+  L1->stack = luaM_newvector(L, BASIC_STACK_SIZE, TValue);
+  L1->stacksize = BASIC_STACK_SIZE;
+  stack_reset(L1);
+}
+
+
 static void freestack (lua_State *L) {
   if (L->stack == NULL)
     return;  /* stack not completely built yet */
@@ -198,18 +559,18 @@ static void freestack (lua_State *L) {
 static void init_registry (lua_State *L, global_State *g) {
   TValue temp;
   /* create registry */
-  // һ Table?
+  // 创建一个 Table?
   Table *registry = luaH_new(L);
   
-  // luaH_new ص TableͣҪתΪ TValue
-  // Ȼٴ洢 table
+  // luaH_new 返回的是 Table类型，所以要转换为 TValue
+  // 然后再存储到 table中
   
-  // 󶨵 global state 
+  // 绑定到 global state 上
   sethvalue(L, &g->l_registry, registry);
 
-  // tableԪأ array 
+  // 在table中添加两个元素，在 array 中
   // registry[2] == L
-  // registry[1] == һ½table
+  // registry[1] == 另一个新建的table
   luaH_resize(L, registry, LUA_RIDX_LAST, 0);
   /* registry[LUA_RIDX_MAINTHREAD] = L */
   setthvalue(L, &temp, L);  /* temp = L */
@@ -227,19 +588,19 @@ static void init_registry (lua_State *L, global_State *g) {
 static void f_luaopen (lua_State *L, void *ud) {
   global_State *g = G(L);
   UNUSED(ud);
-  // ʼ lua_state ջ
+  // 初始化 lua_state 的栈
   stack_init(L, L);  /* init stack */
-  //  regisryʼ2Ԫ
+  // 创建 regisry，并初始化2个元素
   init_registry(L, g);
-  // ʼ String Table
+  // 初始化 String Table
   luaS_init(L);
-  // ʼһЩ eventname
+  // 初始化一些 eventname
   luaT_init(L);
-  // ʼ token ַ
+  // 初始化 token 字符串
   luaX_init(L);
-  // ָgc
+  // 恢复gc的运行
   g->gcrunning = 1;  /* allow gc */
-  // luaİ汾
+  // 设置lua的版本
   g->version = lua_version(NULL);
   luai_userstateopen(L);
 }
@@ -250,22 +611,22 @@ static void f_luaopen (lua_State *L, void *ud) {
 ** any memory (to avoid errors)
 */
 static void preinit_thread (lua_State *L, global_State *g) {
-  // ÿ lua_state, ͬһ global_state
+  // 让每个 lua_state, 共享同一个 global_state
   G(L) = g;
-  // ջ
+  // 栈顶
   L->stack = NULL;
-  //  Ԫظ
+  // 调用链， 及调用链元素个数
   L->ci = NULL;
   L->nci = 0;
-  // ջĴС
+  // 栈的大小
   L->stacksize = 0;
   // upvalues
   L->twups = L;  /* thread has no upvalues */
   // errors recover point
   L->errorJmp = NULL;
-  // calls 
+  // calls 数量
   L->nCcalls = 0;
-  // 
+  // 钩子
   // Functions to be called by the debugger in specific events
   L->hook = NULL;
   L->hookmask = 0;
@@ -273,12 +634,13 @@ static void preinit_thread (lua_State *L, global_State *g) {
   L->allowhook = 1;
   // L->hookCount = L->basehookcount
   resethookcount(L);
-  // upvalues 
+  // upvalues 的链表
   L->openupval = NULL;
-  // ջв yield ĺ
+  // 栈中不能 yield 的函数数量
   // number of non-yieldable calls in stack
   L->nny = 1;
-  // state ״̬
+  L->lockbatch = 0;
+  // state 的状态
   L->status = LUA_OK;
   // handle error
   L->errfunc = 0;
@@ -288,12 +650,21 @@ static void preinit_thread (lua_State *L, global_State *g) {
 static void close_state (lua_State *L) {
   global_State *g = G(L);
   luaF_close(L, L->stack);  /* close all upvalues for this thread */
-  luaC_freeallobjects(L);  /* collect all objects */
-  if (g->version)  /* closing a fully built state? */
-    luai_userstateclose(L);
-  luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
-  freestack(L);
-  lua_assert(gettotalbytes(g) == sizeof(LG));
+  if (g->gcbulkfree) {  /* main block takes everything with it? */
+    luaC_callallfinalizers(L);
+    if (g->version)
+      luai_userstateclose(L);
+  }
+  else {
+    luaC_freeallobjects(L);  /* collect all objects */
+    if (g->version)  /* closing a fully built state? */
+      luai_userstateclose(L);
+    luaM_freearray(L, G(L)->strt.hash, G(L)->strt.size);
+    freestack(L);
+    luaE_trimpools(L, 1);  /* release all pooled structures */
+    lua_assert(gettotalbytes(g) == sizeof(LG));
+  }
+  freelock(g);
   (*g->frealloc)(g->ud, fromstate(L), sizeof(LG), 0);  /* free main block */
 }
 
@@ -301,10 +672,20 @@ static void close_state (lua_State *L) {
 LUA_API lua_State *lua_newthread (lua_State *L) {
   global_State *g = G(L);
   lua_State *L1;
+  TValue *stack = NULL;  /* stack of a reused thread */
+  int stacksize = 0;
   lua_lock(L);
   luaC_checkGC(L);
-  /* create new thread */
-  L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
+  if (g->thpool != NULL) {  /* reuse a dead thread? */
+    L1 = gco2th(g->thpool);
+    g->thpool = L1->next;
+    g->nthpool--;
+    g->GCdebt += pooledsize(L1);
+    stack = L1->stack;
+    stacksize = L1->stacksize;
+  }
+  else  /* create new thread */
+    L1 = &cast(LX *, luaM_newobject(L, LUA_TTHREAD, sizeof(LX)))->l;
   L1->marked = luaC_white(g);
   L1->tt = LUA_TTHREAD;
   /* link it on list 'allgc' */
@@ -322,19 +703,67 @@ LUA_API lua_State *lua_newthread (lua_State *L) {
   memcpy(lua_getextraspace(L1), lua_getextraspace(g->mainthread),
          LUA_EXTRASPACE);
   luai_userstatethread(L, L1);
-  stack_init(L1, L);  /* init stack */
+  if (stack != NULL) {  /* keep the stack of the reused thread */
+    L1->stack = stack;
+    L1->stacksize = stacksize;
+    stack_reset(L1);
+  }
+  else
+    stack_init(L1, L);  /* init stack */
   lua_unlock(L);
   return L1;
 }
 
 
+/*
+** Resets a thread that is dead or suspended: closes its upvalues and
+** empties and shrinks its stack, so that it holds no values and little
+** memory until it is collected (and pooled for reuse). Returns the
+** status the thread had (LUA_OK for a suspended thread).
+*/
+LUA_API int lua_resetthread (lua_State *L) {
+  CallInfo *ci = &L->base_ci;
+  int status;
+  lua_lock(L);
+  api_check(L, L != G(L)->mainthread, "cannot reset the main thread");
+  api_check(L, L->status != LUA_OK || L->ci == ci,
+               "cannot reset a running or normal thread");
+  status = (L->status == LUA_YIELD) ? LUA_OK : L->status;
+  luaF_close(L, L->stack);  /* close all upvalues for this thread */
+  L->ci = ci;  /* unwind the 'ci' list */
+  luaE_freeCI(L);
+  setnilvalue(L->stack);  /* 'function' entry for basic 'ci' */
+  L->top = L->stack + 1;
+  ci->func = L->stack;
+  ci->callstatus = 0;
+  ci->top = L->top + LUA_MINSTACK;
+  L->status = LUA_OK;
+  L->errfunc = 0;
+  luaD_shrinkstack(L);
+  lua_unlock(L);
+  return status;
+}
+
+
 void luaE_freethread (lua_State *L, lua_State *L1) {
+  global_State *g = G(L);
   LX *l = fromstate(L1);
   luaF_close(L1, L1->stack);  /* close all upvalues for this thread */
   lua_assert(L1->openupval == NULL);
   luai_userstatefree(L, L1);
-  freestack(L1);
-  luaM_free(L, l);
+  if (L1->stack != NULL && L1->stacksize <= LUAI_THPOOLSTACK &&
+      g->nthpool < LUAI_MAXTHPOOL) {  /* keep it for 'lua_newthread'? */
+    L1->ci = &L1->base_ci;  /* CallInfos go back to their own pool */
+    luaE_freeCI(L1);
+    L1->next = g->thpool;
+    g->thpool = obj2gco(L1);
+    g->nthpool++;
+    g->GCdebt -= pooledsize(L1);
+  }
+  else {
+    freestack(L1);
+    luaM_free(L, l);
+  }
 }
 
 
@@ -342,83 +771,94 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   int i;
   lua_State *L;
   global_State *g;
-  // ʹָڴ f ڴ
+  // 使用指定的内存分配器 f 申请内存
   LG *l = cast(LG *, (*f)(ud, NULL, LUA_TTHREAD, sizeof(LG)));
 
-  // ڴʧ
+  // 请求内存失败
   if (l == NULL) return NULL;
 
-  // L = ǰ̵߳ lua_State
+  // L = 当前线程的 lua_State
   L = &l->l.l;
-  // global state е̹߳
-  // ɳʼ̴߳
+  // global state 由所有的线程共享，
+  // 由初始线程创建
   g = &l->g;
-  // ̵߳ 
+  // 线程的 单链表
   L->next = NULL;
-  // ԼΪ̣߳ Ҳ˵һlua_state ܵȼһ߳
+  // 设置自己的类型为线程， 也就是说一个lua_state 可能等价一个线程
   L->tt = LUA_TTHREAD;
-  // gcı־λ
+  // 用于gc的标志位
   g->currentwhite = bitmask(WHITE0BIT);
   L->marked = luaC_white(g);
 
-  // ʼ߳
+  // 初始化线程
   preinit_thread(L, g);
-  // ¼ ڴ亯ڴ䣬ʹ
+  // 记录 内存分配函数，后续的内存分配，都使用这个函数
   g->frealloc = f;
   // auxiliary data to 'frealloc'
   g->ud = ud;
-  // 
+  // 设置主函数
   g->mainthread = L;
-  // 
+  // 设置随机数种子
   g->seed = makeseed(L);
-  // ڴstateڼ䣬رGC
+  // 在创建state期间，关闭GC
   g->gcrunning = 0;  /* no GC while building state */
-  // Ҫյڴ
+  // 不需要回收的内存
   g->GCestimate = 0;
-  // ȫֵ hash table
+  // 全局的 hash table
   g->strt.size = g->strt.nuse = 0;
   g->strt.hash = NULL;
+  g->sstrt = NULL;
   setnilvalue(&g->l_registry);
-  // ڲ״̬£ʱõĺ
+  // 在不被保护的状态下，发生错误时，调用的函数
   g->panic = NULL;
-  // 汾
+  g->nextf = NULL;
+  g->frozen = NULL;
+  // 解释器版本
   g->version = NULL;
-  // GC״̬ ͣ
+  // 设置GC状态， 暂停
   g->gcstate = GCSpause;
-  // GC
-  // ֣һgcһֻڴʧʱgc
+  // 设置GC类型
+  // 两种，一种是正常gc，另一种只在内存分配失败时gc
   g->gckind = KGC_NORMAL;
-  //  gc Ԫص
-  // allgc,   gcԪ
-  // finobj, ܣgcԪ 
-  // tobefnz, userdate 
-  // fixedgc, ܱgcԪ
+  // 各种 gc 元素的链表
+  // allgc, 所有 可以 gc的元素链表
+  // finobj, 可能：有析构函数的gc元素 链表
+  // tobefnz, userdate 链表
+  // fixedgc, 不能被gc的元素链表
   g->allgc = g->finobj = g->tobefnz = g->fixedgc = NULL;
-  // ǰGCλ
+  // 当前GC的位置
   g->sweepgc = NULL;
-  // ɫԪ 
+  // 灰色元素 的链表
   g->gray = g->grayagain = NULL;
-  // 
+  // 弱引用
   g->weak = g->ephemeron = g->allweak = NULL;
   g->twups = NULL;
-  // ǰLUA ڴ棬ֻһ LG ڴ
+  g->uvpool = g->cipool = NULL;
+  for (i = 0; i < NCLPOOLS; i++)
+    g->clpool[i] = NULL;
+  g->thpool = NULL;
+  g->nthpool = 0;
+  initlock(g);
+  // 当前LUA 所申请的所有内存，现在只申请了一个 LG 对象的内存
   g->totalbytes = sizeof(LG);
 
-  // ԱgcδͷŵڴС
+  // 可以被gc，但尚未释放的内存大小
   g->GCdebt = 0;
-  // ÿgc Уfinalizer õĴ
+  // 每个gc 动作中，finalizer 调用的次数
   g->gcfinnum = 0;
-  //  gc ļ
+  g->gcfinmax = LUAI_GCFINMAX;
+  g->gcbulkfree = 0;
+  // 两次 gc 动作的间隔
   g->gcpause = LUAI_GCPAUSE;
-  // GCĿ
+  // GC的颗粒度
   g->gcstepmul = LUAI_GCMUL;
 
-  // ʼ͵ Ԫ metedata
+  // 初始化基础类型的 元数据 metedata
   for (i=0; i < LUA_NUMTAGS; i++) 
 	  g->mt[i] = NULL;
 
-  // ڱģʽ f_luaopen һЩluaĻ
-  // ݽǣf_luaopenҪڴ棬 alloc_error
+  // 在保护模式下运行 f_luaopen 函数，设置一些lua的基本参数
+  // 据介绍是，f_luaopen，中要申请内存，可能引发 alloc_error
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
     close_state(L);
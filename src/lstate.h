@@ -46,6 +46,26 @@ struct lua_longjmp;  /* defined in ldo.c */
 #define KGC_EMERGENCY	1	/* gc was forced by an allocation failure */
 
 
+/*
+** Lua closures with less than this number of upvalues are recycled
+** through per-state pools
+*/
+#define NCLPOOLS	4
+
+/*
+** dead threads are kept for reuse by 'lua_newthread' while there are
+** fewer than LUAI_MAXTHPOOL of them and their stacks are not larger
+** than LUAI_THPOOLSTACK
+*/
+#if !defined(LUAI_MAXTHPOOL)
+#define LUAI_MAXTHPOOL		256
+#endif
+
+#if !defined(LUAI_THPOOLSTACK)
+#define LUAI_THPOOLSTACK	(8*BASIC_STACK_SIZE)
+#endif
+
+
 typedef struct stringtable {
   TString **hash;
   int nuse;  /* number of elements */
@@ -114,12 +134,14 @@ typedef struct global_State {
   lu_mem GCmemtrav;  /* memory traversed by the GC */
   lu_mem GCestimate;  /* an estimate of the non-garbage memory in use */
   stringtable strt;  /* hash table for strings */
+  const stringtable *sstrt;  /* shared string table (or NULL) */
   TValue l_registry;
   unsigned int seed;  /* randomized seed for hashes */
   lu_byte currentwhite;
   lu_byte gcstate;  /* state of garbage collector */
   lu_byte gckind;  /* kind of GC running */
   lu_byte gcrunning;  /* true if GC is running */
+  lu_byte gcbulkfree;  /* allocator frees all objects with the main block */
   GCObject *allgc;  /* list of all collectable objects */
   GCObject **sweepgc;  /* current position of sweep in list */
   GCObject *finobj;  /* list of collectable objects with finalizers */
@@ -132,15 +154,29 @@ typedef struct global_State {
   GCObject *fixedgc;  /* list of objects not to be collected */
   struct lua_State *twups;  /* list of threads with open upvalues */
   unsigned int gcfinnum;  /* number of finalizers to call in each GC step */
+  unsigned int gcfinmax;  /* upper limit for 'gcfinnum' (0: host drains) */
   int gcpause;  /* size of pause between successive GCs */
   int gcstepmul;  /* GC 'granularity' */
   lua_CFunction panic;  /* to be called in unprotected errors */
+  lua_CFunction nextf;  /* 'next' function run inline by generic 'for' */
+  struct Frozen *frozen;  /* tables with frozen globals */
   struct lua_State *mainthread;
   const lua_Number *version;  /* pointer to version number */
   TString *memerrmsg;  /* memory-error message */
   TString *tmname[TM_N];  /* array with tag-method names */
   struct Table *mt[LUA_NUMTAGS];  /* metatables for basic types */
   TString *strcache[STRCACHE_N][STRCACHE_M];  /* cache for strings in API */
+  void *uvpool;  /* pool of free upvalues */
+  void *cipool;  /* pool of free CallInfo structures */
+  void *clpool[NCLPOOLS];  /* pools of free Lua closures */
+  GCObject *thpool;  /* pool of dead threads (with their stacks) */
+  int nthpool;  /* number of threads in 'thpool' */
+#if defined(LUA_USE_THREADS)
+  void *volatile lockowner;  /* thread the lock is biased to (or NULL) */
+  volatile long lockheld;  /* is the lock held through the bias? */
+  volatile long lockbatched;  /* batches holding it through the bias */
+  volatile long lockrevoked;  /* was the bias revoked? */
+#endif
 } global_State;
 
 
@@ -169,6 +205,7 @@ struct lua_State {
   int hookcount;
   unsigned short nny;  /* number of non-yieldable calls in stack */
   unsigned short nCcalls;  /* number of nested C calls */
+  unsigned short lockbatch;  /* number of nested batches of API calls */
   lu_byte hookmask;
   lu_byte allowhook;
 };
@@ -219,6 +256,18 @@ LUAI_FUNC void luaE_freethread (lua_State *L, lua_State *L1);
 LUAI_FUNC CallInfo *luaE_extendCI (lua_State *L);
 LUAI_FUNC void luaE_freeCI (lua_State *L);
 LUAI_FUNC void luaE_shrinkCI (lua_State *L);
+LUAI_FUNC void luaE_trimpools (lua_State *L, int all);
+LUAI_FUNC void luaE_setnextf (lua_State *L, lua_CFunction f);
+#if defined(LUA_USE_THREADS)
+LUAI_FUNC void luaE_lock (lua_State *L);
+LUAI_FUNC void luaE_unlock (lua_State *L);
+LUAI_FUNC void luaE_threadyield (lua_State *L);
+LUAI_FUNC void luaE_beginbatch (lua_State *L);
+LUAI_FUNC void luaE_endbatch (lua_State *L);
+LUAI_FUNC void luaE_dropbatch (lua_State *L, unsigned short n);
+#else
+#define luaE_dropbatch(L,n)	UNUSED(n)
+#endif
 
 
 #endif
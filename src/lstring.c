@@ -10,6 +10,7 @@
 #include "lprefix.h"
 
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "lua.h"
@@ -110,17 +111,47 @@ void luaS_clearcache (global_State *g) {
 }
 
 
+/*
+** Process-wide table of shared short strings. It is built once by
+** 'luaS_share', in memory owned by the process (not by any state), and
+** then published through 'shared'; it is read-only afterwards, so the
+** states created after that can consult it without synchronization.
+*/
+typedef struct SharedStrings {
+  stringtable strt;
+  unsigned int seed;  /* seed of the hashes of the strings */
+} SharedStrings;
+
+static SharedStrings *shared = NULL;
+static int sharing = 0;  /* set by the first call to 'luaS_share' */
+
+#if defined(__GNUC__)
+#define l_getshared()	__atomic_load_n(&shared, __ATOMIC_ACQUIRE)
+#define l_setshared(s)	__atomic_store_n(&shared, (s), __ATOMIC_RELEASE)
+#define l_trysharing()	(__atomic_exchange_n(&sharing, 1, __ATOMIC_ACQ_REL) == 0)
+#else  /* no atomics: 'luaS_share' must run before other threads start */
+#define l_getshared()	(shared)
+#define l_setshared(s)	(shared = (s))
+#define l_trysharing()	(sharing == 0 && (sharing = 1))
+#endif
+
+
 /*
 ** Initialize the string table and the string cache
 */
 void luaS_init (lua_State *L) {
   global_State *g = G(L);
   int i, j;
+  const SharedStrings *ss = l_getshared();
+  if (ss != NULL) {  /* is there a shared table? */
+    g->sstrt = &ss->strt;
+    g->seed = ss->seed;  /* hashes must match the shared ones */
+  }
   luaS_resize(L, MINSTRTABSIZE);  /* initial size of string table */
   /* pre-create memory-error message */
-  //  ڴ ʾַ
+  // 创建 内存分配错误 的提示字符串
   g->memerrmsg = luaS_newliteral(L, MEMERRMSG);
-  //  gc
+  // 不可 gc
   luaC_fix(L, obj2gco(g->memerrmsg));  /* it should never be collected */
   for (i = 0; i < STRCACHE_N; i++)  /* fill cache with valid strings */
     for (j = 0; j < STRCACHE_M; j++)
@@ -170,8 +201,17 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   TString *ts;
   global_State *g = G(L);
   unsigned int h = luaS_hash(str, l, g->seed);
-  TString **list = &g->strt.hash[lmod(h, g->strt.size)];
+  TString **list;
   lua_assert(str != NULL);  /* otherwise 'memcmp'/'memcpy' are undefined */
+  if (g->sstrt != NULL) {  /* look first in the shared table */
+    for (ts = g->sstrt->hash[lmod(h, g->sstrt->size)];
+         ts != NULL;
+         ts = ts->u.hnext) {
+      if (l == ts->shrlen && (memcmp(str, getstr(ts), l * sizeof(char)) == 0))
+        return ts;
+    }
+  }
+  list = &g->strt.hash[lmod(h, g->strt.size)];
   for (ts = *list; ts != NULL; ts = ts->u.hnext) {
     if (l == ts->shrlen &&
         (memcmp(str, getstr(ts), l * sizeof(char)) == 0)) {
@@ -185,21 +225,63 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
     luaS_resize(L, g->strt.size * 2);
     list = &g->strt.hash[lmod(h, g->strt.size)];  /* recompute with new size */
   }
-  // һ TString 
+  // 创建一个 TString 对象
   ts = createstrobj(L, l, LUA_TSHRSTR, h);
-  // ַƽȥ
+  // 把字符串复制进去
   memcpy(getstr(ts), str, l * sizeof(char));
-  // ó
+  // 设置长度
   ts->shrlen = cast_byte(l);
-  // 
+  // 加入链表
   ts->u.hnext = *list;
   *list = ts;
-  // ȫ stringtable Ԫص
+  // 全局 stringtable 元素的数量
   g->strt.nuse++;
   return ts;
 }
 
 
+/*
+** Copies all short strings of 'L' to the process-wide shared table.
+** The copies live in memory from 'malloc' that is never freed, so they
+** do not depend on 'L' (nor on its allocator); all states created
+** afterwards use them instead of creating their own copies ('L' itself
+** keeps its strings, as its objects refer to them). Only the first call
+** builds the table. Returns the number of shared strings (or -1 if the
+** table was already built or being built).
+*/
+int luaS_share (lua_State *L) {
+  global_State *g = G(L);
+  stringtable *tb = &g->strt;
+  SharedStrings *ss;
+  int i;
+  if (!l_trysharing())  /* already done? */
+    return -1;
+  luaC_fullgc(L, 0);  /* remove dead strings */
+  ss = (SharedStrings *)malloc(sizeof(SharedStrings));
+  if (ss == NULL ||
+      (ss->strt.hash = (TString **)calloc(tb->size, sizeof(TString *))) == NULL)
+    luaD_throw(L, LUA_ERRMEM);  /* ('sharing' stays set) */
+  ss->strt.size = tb->size;
+  ss->strt.nuse = tb->nuse;
+  ss->seed = g->seed;  /* keep hashes, and so positions in the table */
+  for (i = 0; i < tb->size; i++) {
+    TString *ts;
+    for (ts = tb->hash[i]; ts != NULL; ts = ts->u.hnext) {
+      TString *cp = (TString *)malloc(sizelstring(ts->shrlen));
+      if (cp == NULL)
+        luaD_throw(L, LUA_ERRMEM);
+      memcpy(cp, ts, sizelstring(ts->shrlen));
+      cp->next = NULL;
+      cp->marked = bitmask(SHAREDBIT);  /* neither white nor black */
+      cp->u.hnext = ss->strt.hash[i];
+      ss->strt.hash[i] = cp;
+    }
+  }
+  l_setshared(ss);
+  return ss->strt.nuse;
+}
+
+
 /*
 ** new string (with explicit length)
 */
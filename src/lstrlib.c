@@ -794,6 +794,7 @@ static int str_gsub (lua_State *L) {
     p++; lp--;  /* skip anchor character */
   }
   prepstate(&ms, L, src, srcl, p, lp);
+  luaE_beginbatch(L);  /* one lock for all matches and replacements */
   while (n < max_s) {
     const char *e;
     reprepstate(&ms);
@@ -810,6 +811,7 @@ static int str_gsub (lua_State *L) {
   }
   luaL_addlstring(&b, src, ms.src_end-src);
   luaL_pushresult(&b);
+  luaE_endbatch(L);
   lua_pushinteger(L, n);  /* number of substitutions */
   return 2;
 }
@@ -30,6 +30,7 @@
 
 #include "ldebug.h"
 #include "ldo.h"
+#include "lfunc.h"
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
@@ -117,8 +118,8 @@ static int l_hashfloat (lua_Number n) {
 ** of its hash value)
 */
 static Node *mainposition (const Table *t, const TValue *key) {
-  // žǸkeyͣöӦ hashֵ
-  // Ȼ tableҳhashֵλ
+  // 大概就是根据key的类型，获得对应的 hash值
+  // 然后从 table中找出该hash值的位置
   switch (ttype(key)) {
     case LUA_TNUMINT:
       return hashint(t, ivalue(key));
@@ -258,7 +259,7 @@ static int countint (const TValue *key, unsigned int *nums) {
 ** number of keys that will go into corresponding slice and return
 ** total number of non-nil keys.
 */
-// ͳ array  keyΪ tablearrayǿԳּģ
+// 统计 array 中 key的数量，因为 table中array是可以出现间隔的，
 static unsigned int numusearray (const Table *t, unsigned int *nums) {
   int lg;
   unsigned int ttlg;  /* 2^lg */
@@ -289,7 +290,7 @@ static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
   int totaluse = 0;  /* total number of elements */
   int ause = 0;  /* elements added to 'nums' (can go to array part) */
   int i = sizenode(t);
-  // tableе node ۣnilͼ¼
+  // 遍历table中所有的 node 槽，如果不是nil，就记录
   while (i--) {
     Node *n = &t->node[i];
     if (!ttisnil(gval(n))) {
@@ -304,14 +305,14 @@ static int numusehash (const Table *t, unsigned int *nums, unsigned int *pna) {
 
 static void setarrayvector (lua_State *L, Table *t, unsigned int size) {
   unsigned int i;
-  // ·ڴ
+  // 重新分配内存
   luaM_reallocvector(L, t->array, t->sizearray, size, TValue);
 	
-  // ڶĲ֣ȫΪ nil
+  // 对于多出来的部分，全都设置为 nil
   for (i=t->sizearray; i<size; i++)
      setnilvalue(&t->array[i]);
 
-  // ´С
+  // 设置新大小
   t->sizearray = size;
 }
 
@@ -319,7 +320,7 @@ static void setarrayvector (lua_State *L, Table *t, unsigned int size) {
 static void setnodevector (lua_State *L, Table *t, unsigned int size) {
   int lsize;
   if (size == 0) {  /* no elements to hash part? */
-	// û node
+	// 没有 node
     t->node = cast(Node *, dummynode);  /* use common 'dummynode' */
     lsize = 0;
   }
@@ -329,7 +330,7 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
     if (lsize > MAXHBITS) // MAXHBITS == 30
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
-	// ڴ
+	// 分配内存
     t->node = luaM_newvector(L, size, Node);
     for (i = 0; i < (int)size; i++) {
       Node *n = gnode(t, i);
@@ -339,34 +340,106 @@ static void setnodevector (lua_State *L, Table *t, unsigned int size) {
       setnilvalue(gval(n));
     }
   }
-  // size
+  // 设置size
   t->lsizenode = cast_byte(lsize);
-  //  lastfree  ....
+  // 设置 lastfree  ....
   t->lastfree = gnode(t, size);  /* all positions are free */
 }
 
 
-// nasizeӦ arrayС
-// nhsize node list ĴС
+/*
+** {======================================================
+** Frozen globals
+** The cells of the frozen globals of a table point to the entries of
+** their keys, so assignments to those entries need no extra work; only
+** changes in the positions of the entries (when a key is inserted or
+** the table is resized) move the cells.
+** =======================================================
+*/
+
+static Frozen *getfrozen (global_State *g, Table *t) {
+  Frozen *fz;
+  for (fz = g->frozen; fz != NULL; fz = fz->next) {
+    if (fz->t == t)
+      return fz;
+  }
+  return NULL;
+}
+
+
+/* make 'cell' point to the entry of 'key' in 't' (or hold nil) */
+static void bindcell (Table *t, TString *key, UpVal *cell) {
+  const TValue *slot = luaH_getshortstr(t, key);
+  if (slot != luaO_nilobject)
+    cell->v = cast(TValue *, slot);
+  else {  /* absent key; cell looks closed */
+    cell->v = &cell->u.value;
+    setnilvalue(cell->v);
+  }
+}
+
+
+static void movecells (lua_State *L, Table *t) {
+  Frozen *fz = getfrozen(G(L), t);
+  if (fz != NULL) {
+    int i;
+    for (i = 0; i < fz->nkeys; i++) {
+      if (fz->keys[i].cell != NULL)
+        bindcell(t, fz->keys[i].key, fz->keys[i].cell);
+    }
+  }
+}
+
+
+/*
+** Release the frozen globals of a table being freed. Its cells keep
+** nil, as the old values may be dead too.
+*/
+static void unfreeze (lua_State *L, Table *t) {
+  Frozen **p = &G(L)->frozen;
+  Frozen *fz;
+  int i;
+  while ((fz = *p) != NULL && fz->t != t)
+    p = &fz->next;
+  if (fz == NULL)
+    return;
+  *p = fz->next;
+  for (i = 0; i < fz->nkeys; i++) {
+    UpVal *cell = fz->keys[i].cell;
+    if (cell != NULL) {
+      cell->v = &cell->u.value;
+      setnilvalue(cell->v);
+      luaC_upvdeccount(L, cell);
+    }
+  }
+  luaM_freearray(L, fz->keys, fz->size);
+  luaM_free(L, fz);
+}
+
+/* }====================================================== */
+
+
+// nasize应该是 array大小，
+// nhsize 是node list 的大小
 void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
                                           unsigned int nhsize) {
   unsigned int i;
   int j;
-  // ԭϢ
+  // 保存原来的信息
   unsigned int oldasize = t->sizearray;
   int oldhsize = t->lsizenode;
   Node *nold = t->node;  /* save old hash ... */
 
-  // ı array С
+  // 改变 array 大小
   if (nasize > oldasize)  /* array part must grow? */
     setarrayvector(L, t, nasize);
-  // ı nodeбС
+  // 改变 node列表大小
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);
 
   
   if (nasize < oldasize) {  /* array part must shrink? */
-	// С array 
+	// 减小 array 容量
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
     for (i=nasize; i<oldasize; i++) {
@@ -387,6 +460,8 @@ void luaH_resize (lua_State *L, Table *t, unsigned int nasize,
   }
   if (!isdummy(nold))
     luaM_freearray(L, nold, cast(size_t, twoto(oldhsize))); /* free old hash */
+  if (G(L)->frozen != NULL)
+    movecells(L, t);
 }
 
 
@@ -404,13 +479,13 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   unsigned int nums[MAXABITS + 1];
   int i;
   int totaluse;
-  // ʼ
+  // 初始化
   for (i = 0; i <= MAXABITS; i++) nums[i] = 0;  /* reset counts */
-  // englishʾ
+  // 如english所示
   na = numusearray(t, nums);  /* count keys in array part */
-  // array key
+  // array key的数量
   totaluse = na;  /* all those keys are integer keys */
-  // hash key
+  // hash key的数量
   totaluse += numusehash(t, nums, &na);  /* count keys in hash part */
   /* count extra key */
   na += countint(ek, nums);
@@ -427,27 +502,29 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
 ** }=============================================================
 */
 
-// stack дһtable
+// 在stack 中创建一个table，
 Table *luaH_new (lua_State *L) {
-  // ڴ,ָ
+  // 分配内存,并指定类型
   GCObject *o = luaC_newobj(L, LUA_TTABLE, sizeof(Table));
-  // GCObject ʵʵ Table
+  // 获得GCObject中 实际的 Table
   Table *t = gco2t(o);
 
-  // ʼ Table
-  // Ԫ
+  // 初始化 Table
+  // 元表
   t->metatable = NULL;
   t->flags = cast_byte(~0);
-  // 鲿
+  // 数组部分
   t->array = NULL;
   t->sizearray = 0;
-  // node , key-value 
+  // node 部分, key-value 对
   setnodevector(L, t, 0);
   return t;
 }
 
 
 void luaH_free (lua_State *L, Table *t) {
+  if (G(L)->frozen != NULL)
+    unfreeze(L, t);
   if (!isdummy(t->node))
     luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
   luaM_freearray(L, t->array, t->sizearray);
@@ -475,33 +552,33 @@ static Node *getfreepos (Table *t) {
 */
 TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
   Node *mp;
-  TValue aux; // Ҫkey
+  TValue aux; // 要插入的key
 
-  if (ttisnil(key)) luaG_runerror(L, "table index is nil"); // index nil
+  if (ttisnil(key)) luaG_runerror(L, "table index is nil"); // index 不能是nil
   else if (ttisfloat(key)) {
-	// key float
+	// key是 float
     lua_Integer k;
     if (luaV_tointeger(key, &k, 0)) {  /* index is int? */
       setivalue(&aux, k);
       key = &aux;  /* insert it as an integer */
     }
-    else if (luai_numisnan(fltvalue(key))) // index NaN 
+    else if (luai_numisnan(fltvalue(key))) // index不能是 NaN 浮点数
       luaG_runerror(L, "table index is NaN");
   }
-  //  key tableе mainposition
+  // 获得 key 在table中的 mainposition
   mp = mainposition(t, key);
   if (!ttisnil(gval(mp)) || isdummy(mp)) {  /* main position is taken? */
-	//  position  nilҲ dummy˵Ѿռ
+	// 这个 position 不是 nil，也不是 dummy，说明已经被占用了
     Node *othern;
     Node *f = getfreepos(t);  /* get a free place */
     if (f == NULL) {  /* cannot find a free place? */
-	  // hash Ҳ free pos ˣҪ
+	  // hash 表找不到 free pos 了，需要扩容
       rehash(L, t, key);  /* grow table */
       /* whatever called 'newkey' takes care of TM cache */
-	  // ݺʹset ֵ
+	  // 扩容后，使用set 插入值
       return luaH_set(L, t, key);  /* insert key into grown table */
     }
-	// õ free pos
+	// 得到 free pos
     lua_assert(!isdummy(f));
     othern = mainposition(t, gkey(mp));
     if (othern != mp) {  /* is colliding node out of its main position? */
@@ -525,10 +602,12 @@ TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
       mp = f;
     }
   }
-  // ûռõĻֱ
+  // 如果没被占用的话，就直接拿来用
   setnodekey(L, &mp->i_key, key);
   luaC_barrierback(L, t, key);
   lua_assert(ttisnil(gval(mp)));
+  if (G(L)->frozen != NULL)
+    movecells(L, t);
   return gval(mp);
 }
 
@@ -541,7 +620,7 @@ const TValue *luaH_getint (Table *t, lua_Integer key) {
   if (l_castS2U(key) - 1 < t->sizearray)
     return &t->array[key - 1];
   else {
-	//  key node
+	// 获得 key 的node
     Node *n = hashint(t, key);
     for (;;) {  /* check whether 'key' is somewhere in the chain */
       if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
@@ -645,13 +724,13 @@ void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
   if (p != luaO_nilobject)
     cell = cast(TValue *, p);
   else {
-	// ½key
+	// 新建key
     TValue k;
     setivalue(&k, key);
-	// key
+	// 插入key
     cell = luaH_newkey(L, t, &k);
   }
-  //  ӳ
+  // 设置 映射
   setobj2t(L, cell, value);
 }
 
@@ -704,6 +783,57 @@ int luaH_getn (Table *t) {
 
 
 
+/*
+** Mark global 'key' of table 't' as frozen, so that chunks loaded with
+** mode 'F' may read it through a cell
+*/
+void luaH_freeze (lua_State *L, Table *t, TString *key) {
+  global_State *g = G(L);
+  Frozen *fz = getfrozen(g, t);
+  int i;
+  if (fz == NULL) {
+    fz = luaM_new(L, Frozen);
+    fz->t = t;
+    fz->keys = NULL;
+    fz->nkeys = fz->size = 0;
+    fz->next = g->frozen;
+    g->frozen = fz;
+  }
+  for (i = 0; i < fz->nkeys; i++) {
+    if (fz->keys[i].key == key)
+      return;  /* already frozen */
+  }
+  luaM_growvector(L, fz->keys, fz->nkeys, fz->size, FrozenKey, MAX_INT,
+                  "frozen globals");
+  fz->keys[fz->nkeys].key = key;
+  fz->keys[fz->nkeys++].cell = NULL;
+}
+
+
+/*
+** The cell of global 'key' of table 't', or NULL if it is not frozen
+*/
+UpVal *luaH_cell (lua_State *L, Table *t, TString *key) {
+  Frozen *fz = getfrozen(G(L), t);
+  int i;
+  if (fz == NULL)
+    return NULL;
+  for (i = 0; i < fz->nkeys; i++) {
+    FrozenKey *fk = &fz->keys[i];
+    if (fk->key == key) {
+      if (fk->cell == NULL) {
+        fk->cell = luaF_newupval(L);
+        fk->cell->refcount = 1;  /* the reference from 'fz' */
+        bindcell(t, key, fk->cell);
+      }
+      return fk->cell;
+    }
+  }
+  return NULL;
+}
+
+
+
 #if defined(LUA_DEBUG)
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
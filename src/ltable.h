@@ -9,14 +9,14 @@
 
 #include "lobject.h"
 
-//  table t  ±Ϊ iĽڵ
+// 获得 table t 中 下表为 i的节点
 #define gnode(t,i)	(&(t)->node[i])
-//  node n еֵ
+// 获得 node n 中的值
 #define gval(n)		(&(n)->i_val)
-//  node n еһ ....
+// 获得 node n 中的下一个 ....
 #define gnext(n)	((n)->i_key.nk.next)
 
-//  node n keyֵ
+// 获得 node n 的key值
 /* 'const' to avoid wrong writings that can mess up field 'next' */ 
 #define gkey(n)		cast(const TValue*, (&(n)->i_key.tvk))
 
@@ -34,6 +34,27 @@
   (gkey(cast(Node *, cast(char *, (v)) - offsetof(Node, i_val))))
 
 
+/*
+** A frozen global of a table used as environment. Chunks loaded with
+** mode 'F' read it through 'cell', an upvalue whose value is the entry
+** of the key in the table (or its own nil while the key is absent).
+*/
+typedef struct FrozenKey {
+  TString *key;  /* a short string */
+  struct UpVal *cell;  /* NULL until some chunk reads the global */
+} FrozenKey;
+
+
+/* the frozen globals of a table */
+typedef struct Frozen {
+  Table *t;
+  FrozenKey *keys;
+  int nkeys;
+  int size;  /* size of 'keys' */
+  struct Frozen *next;
+} Frozen;
+
+
 LUAI_FUNC const TValue *luaH_getint (Table *t, lua_Integer key);
 LUAI_FUNC void luaH_setint (lua_State *L, Table *t, lua_Integer key,
                                                     TValue *value);
@@ -49,6 +70,8 @@ LUAI_FUNC void luaH_resizearray (lua_State *L, Table *t, unsigned int nasize);
 LUAI_FUNC void luaH_free (lua_State *L, Table *t);
 LUAI_FUNC int luaH_next (lua_State *L, Table *t, StkId key);
 LUAI_FUNC int luaH_getn (Table *t);
+LUAI_FUNC void luaH_freeze (lua_State *L, Table *t, TString *key);
+LUAI_FUNC struct UpVal *luaH_cell (lua_State *L, Table *t, TString *key);
 
 
 #if defined(LUA_DEBUG)
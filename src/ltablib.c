@@ -88,10 +88,12 @@ static int tinsert (lua_State *L) {
       lua_Integer i;
       pos = luaL_checkinteger(L, 2);  /* 2nd argument is the position */
       luaL_argcheck(L, 1 <= pos && pos <= e, 2, "position out of bounds");
+      luaE_beginbatch(L);
       for (i = e; i > pos; i--) {  /* move up elements */
         lua_geti(L, 1, i - 1);
         lua_seti(L, 1, i);  /* t[i] = t[i - 1] */
       }
+      luaE_endbatch(L);
       break;
     }
     default: {
@@ -108,6 +110,7 @@ static int tremove (lua_State *L) {
   lua_Integer pos = luaL_optinteger(L, 2, size);
   if (pos != size)  /* validate 'pos' if given */
     luaL_argcheck(L, 1 <= pos && pos <= size + 1, 1, "position out of bounds");
+  luaE_beginbatch(L);
   lua_geti(L, 1, pos);  /* result = t[pos] */
   for ( ; pos < size; pos++) {
     lua_geti(L, 1, pos + 1);
@@ -115,6 +118,7 @@ static int tremove (lua_State *L) {
   }
   lua_pushnil(L);
   lua_seti(L, 1, pos);  /* t[pos] = nil */
+  luaE_endbatch(L);
   return 1;
 }
 
@@ -139,6 +143,7 @@ static int tmove (lua_State *L) {
     n = e - f + 1;  /* number of elements to move */
     luaL_argcheck(L, t <= LUA_MAXINTEGER - n + 1, 4,
                   "destination wrap around");
+    luaE_beginbatch(L);
     if (t > e || t <= f || tt != 1) {
       for (i = 0; i < n; i++) {
         lua_geti(L, 1, f + i);
@@ -151,6 +156,7 @@ static int tmove (lua_State *L) {
         lua_seti(L, tt, t + i);
       }
     }
+    luaE_endbatch(L);
   }
   lua_pushvalue(L, tt);  /* return "to table" */
   return 1;
@@ -174,6 +180,7 @@ static int tconcat (lua_State *L) {
   lua_Integer i = luaL_optinteger(L, 3, 1);
   last = luaL_opt(L, luaL_checkinteger, 4, last);
   luaL_buffinit(L, &b);
+  luaE_beginbatch(L);
   for (; i < last; i++) {
     addfield(L, &b, i);
     luaL_addlstring(&b, sep, lsep);
@@ -181,6 +188,7 @@ static int tconcat (lua_State *L) {
   if (i == last)  /* add last value (if interval was not empty) */
     addfield(L, &b, i);
   luaL_pushresult(&b);
+  luaE_endbatch(L);
   return 1;
 }
 
@@ -212,10 +220,12 @@ static int unpack (lua_State *L) {
   n = (lua_Unsigned)e - i;  /* number of elements minus 1 (avoid overflows) */
   if (n >= (unsigned int)INT_MAX  || !lua_checkstack(L, (int)(++n)))
     return luaL_error(L, "too many results to unpack");
+  luaE_beginbatch(L);
   for (; i < e; i++) {  /* push arg[i..e - 1] (to avoid overflows) */
     lua_geti(L, 1, i);
   }
   lua_geti(L, 1, e);  /* push last element */
+  luaE_endbatch(L);
   return (int)n;
 }
 
@@ -414,7 +424,9 @@ static int sort (lua_State *L) {
     if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
       luaL_checktype(L, 2, LUA_TFUNCTION);  /* must be a function */
     lua_settop(L, 2);  /* make sure there are two arguments */
+    luaE_beginbatch(L);  /* one lock for all comparisons and swaps */
     auxsort(L, 1, (unsigned int)n, 0u);
+    luaE_endbatch(L);
   }
   return 0;
 }
@@ -0,0 +1,1937 @@
+/*
+** $Id: ltasklib.c $
+** Tasks, channels and parallel loops: independent states run by a
+** pool of OS threads
+** See Copyright Notice in lua.h
+*/
+
+#define ltasklib_c
+#define LUA_LIB
+
+#include "lprefix.h"
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lua.h"
+
+#include "lauxlib.h"
+#include "lualib.h"
+
+
+#if defined(LUA_USE_TASKLIB)	/* { */
+
+
+/*
+** A task is a function running in a state of its own. A pool of OS
+** threads (the workers) runs the tasks: each worker has a queue of its
+** own, takes work from a global queue when its queue is empty, and
+** steals from the other workers when both are empty. Tasks talk
+** through channels, which copy values from one state to another. A
+** task that blocks on a channel yields back to its worker, which goes
+** on running other tasks; a caller outside the workers blocks its OS
+** thread, and a caller in a worker that cannot yield gets an error.
+** Buffers are immutable strings outside any state, which messages
+** carry by reference instead of copying. The parallel library splits
+** arrays into slices and runs a function over them in states that
+** belong to the workers.
+*/
+
+
+/* maximum number of workers */
+#if !defined(LUAI_MAXWORKERS)
+#define LUAI_MAXWORKERS		256
+#endif
+
+/* default capacity of a channel */
+#if !defined(LUAI_CHANNELSIZE)
+#define LUAI_CHANNELSIZE	64
+#endif
+
+/* maximum nesting of tables in a message */
+#define MAXMSGDEPTH	100
+
+
+/* maximum capacity of a channel */
+#define MAXCHANNEL	(1 << 24)
+
+
+#define CHANNEL		"task.channel"
+#define BUFFER		"task.buffer"
+#define MESSAGE		"task.message"
+
+
+/*
+** {==================================================================
+** Threads, locks and atomic counters
+** ===================================================================
+*/
+
+struct Worker;
+
+static void workerloop (struct Worker *w);
+
+#if defined(_WIN32)	/* { */
+
+#include <windows.h>
+
+typedef CRITICAL_SECTION l_mutex;
+typedef CONDITION_VARIABLE l_cond;
+typedef HANDLE l_thread;
+
+#define l_mutexinit(m)		InitializeCriticalSection(m)
+#define l_mutexfree(m)		DeleteCriticalSection(m)
+#define l_lock(m)		EnterCriticalSection(m)
+#define l_unlock(m)		LeaveCriticalSection(m)
+#define l_condinit(c)		InitializeConditionVariable(c)
+#define l_condfree(c)		((void)(c))
+#define l_condwait(c,m)		SleepConditionVariableCS(c, m, INFINITE)
+#define l_condsignal(c)		WakeConditionVariable(c)
+#define l_condbroadcast(c)	WakeAllConditionVariable(c)
+
+#define l_atomicadd(p,v)	(InterlockedExchangeAdd((p), (v)) + (v))
+#define l_atomicget(p)		InterlockedCompareExchange((p), 0, 0)
+#define l_atomicset(p,v)	InterlockedExchange((p), (v))
+#define l_atomiccas(p,o,n)	(InterlockedCompareExchange((p), (n), (o)) == (o))
+
+#define l_threadlocal		__declspec(thread)
+
+static DWORD WINAPI threadmain (LPVOID ud) {
+  workerloop((struct Worker *)ud);
+  return 0;
+}
+
+static int l_startthread (l_thread *t, void *ud) {
+  *t = CreateThread(NULL, 0, threadmain, ud, 0, NULL);
+  return (*t != NULL);
+}
+
+static void l_jointhread (l_thread t) {
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+static int l_ncpus (void) {
+  SYSTEM_INFO si;
+  GetSystemInfo(&si);
+  return (int)si.dwNumberOfProcessors;
+}
+
+static void initscheduler (void);
+static INIT_ONCE schedonce = INIT_ONCE_STATIC_INIT;
+
+static BOOL CALLBACK onceaux (PINIT_ONCE o, PVOID p, PVOID *c) {
+  (void)o; (void)p; (void)c;
+  initscheduler();
+  return TRUE;
+}
+
+#define l_initonce()	InitOnceExecuteOnce(&schedonce, onceaux, NULL, NULL)
+
+#else			/* }{ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t l_mutex;
+typedef pthread_cond_t l_cond;
+typedef pthread_t l_thread;
+
+#define l_mutexinit(m)		pthread_mutex_init(m, NULL)
+#define l_mutexfree(m)		pthread_mutex_destroy(m)
+#define l_lock(m)		pthread_mutex_lock(m)
+#define l_unlock(m)		pthread_mutex_unlock(m)
+#define l_condinit(c)		pthread_cond_init(c, NULL)
+#define l_condfree(c)		pthread_cond_destroy(c)
+#define l_condwait(c,m)		pthread_cond_wait(c, m)
+#define l_condsignal(c)		pthread_cond_signal(c)
+#define l_condbroadcast(c)	pthread_cond_broadcast(c)
+
+#define l_atomicadd(p,v)	__atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define l_atomicget(p)		__atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define l_atomicset(p,v)	__atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+
+/* if '*p' is 'o', sets it to 'n'; returns whether it did */
+static int l_atomiccas (volatile long *p, long o, long n) {
+  return __atomic_compare_exchange_n(p, &o, n, 0, __ATOMIC_SEQ_CST,
+                                                  __ATOMIC_SEQ_CST);
+}
+
+#define l_threadlocal		__thread
+
+static void *threadmain (void *ud) {
+  workerloop((struct Worker *)ud);
+  return NULL;
+}
+
+static int l_startthread (l_thread *t, void *ud) {
+  return (pthread_create(t, NULL, threadmain, ud) == 0);
+}
+
+#define l_jointhread(t)		pthread_join(t, NULL)
+
+static int l_ncpus (void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int)n : 1;
+#else
+  return 1;
+#endif
+}
+
+static void initscheduler (void);
+static pthread_once_t schedonce = PTHREAD_ONCE_INIT;
+
+#define l_initonce()	pthread_once(&schedonce, initscheduler)
+
+#endif			/* } */
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Scheduler
+** ===================================================================
+*/
+
+typedef struct Work Work;
+
+/* something a worker can run: a task, or a job for a library */
+struct Work {
+  Work *next;
+  Work *previous;
+  void (*run) (Work *w);
+};
+
+
+/* double-ended queue of work with a lock */
+typedef struct WorkQueue {
+  l_mutex lock;
+  Work *first;
+  Work *last;
+} WorkQueue;
+
+
+typedef struct Worker {
+  WorkQueue q;  /* work created by this worker */
+  lua_State *L;  /* state for parallel loops (created when first used) */
+  lua_State *running;  /* state running Lua code (or NULL) */
+  l_mutex runlock;  /* protects 'running' */
+  l_thread thread;
+  int id;
+} Worker;
+
+
+static struct Scheduler {
+  l_mutex lock;  /* protects starting the workers and sleeping */
+  l_cond wake;  /* signaled when there is new work */
+  WorkQueue global;  /* work created outside the workers */
+  Worker *workers;
+  int nworkers;  /* number of running workers (0 before they start) */
+  int wanted;  /* number of workers to start */
+  volatile long pending;  /* number of queued work items */
+  volatile long sleeping;  /* number of idle workers */
+  volatile long stopping;  /* are the workers stopping? */
+  int users;  /* number of states holding an anchor */
+  struct Task *tasks;  /* list of live tasks */
+} sched;
+
+
+/* worker running in the current OS thread (NULL if none) */
+static l_threadlocal Worker *currentworker = NULL;
+
+
+static void wq_init (WorkQueue *q) {
+  l_mutexinit(&q->lock);
+  q->first = q->last = NULL;
+}
+
+
+static void wq_pushfront (WorkQueue *q, Work *w) {
+  l_lock(&q->lock);
+  w->previous = NULL;
+  w->next = q->first;
+  if (q->first) q->first->previous = w;
+  else q->last = w;
+  q->first = w;
+  l_unlock(&q->lock);
+}
+
+
+static void wq_pushback (WorkQueue *q, Work *w) {
+  l_lock(&q->lock);
+  w->next = NULL;
+  w->previous = q->last;
+  if (q->last) q->last->next = w;
+  else q->first = w;
+  q->last = w;
+  l_unlock(&q->lock);
+}
+
+
+static Work *wq_popfront (WorkQueue *q) {
+  Work *w;
+  l_lock(&q->lock);
+  w = q->first;
+  if (w != NULL) {
+    q->first = w->next;
+    if (q->first) q->first->previous = NULL;
+    else q->last = NULL;
+  }
+  l_unlock(&q->lock);
+  return w;
+}
+
+
+static Work *wq_popback (WorkQueue *q) {
+  Work *w;
+  l_lock(&q->lock);
+  w = q->last;
+  if (w != NULL) {
+    q->last = w->previous;
+    if (q->last) q->last->next = NULL;
+    else q->first = NULL;
+  }
+  l_unlock(&q->lock);
+  return w;
+}
+
+
+static void initscheduler (void) {
+  int n = l_ncpus();
+  l_mutexinit(&sched.lock);
+  l_condinit(&sched.wake);
+  wq_init(&sched.global);
+  sched.workers = NULL;
+  sched.nworkers = 0;
+  sched.wanted = (n < LUAI_MAXWORKERS) ? n : LUAI_MAXWORKERS;
+  sched.pending = sched.sleeping = sched.stopping = 0;
+  sched.users = 0;
+  sched.tasks = NULL;
+}
+
+
+/*
+** Queues a work item. Work created by a worker goes to the front of its
+** own queue ('local'), where that worker finds it first and where other
+** workers steal from the back.
+*/
+static void submit (Work *w, int local) {
+  Worker *self = currentworker;
+  if (local && self != NULL) wq_pushfront(&self->q, w);
+  else wq_pushback(&sched.global, w);
+  l_atomicadd(&sched.pending, 1);
+  if (l_atomicget(&sched.sleeping) > 0) {  /* someone to wake? */
+    l_lock(&sched.lock);
+    l_condsignal(&sched.wake);
+    l_unlock(&sched.lock);
+  }
+}
+
+
+static Work *findwork (Worker *self) {
+  Work *w = wq_popfront(&self->q);
+  int i;
+  if (w == NULL)
+    w = wq_popfront(&sched.global);
+  for (i = 1; w == NULL && i < sched.nworkers; i++)  /* try to steal */
+    w = wq_popback(&sched.workers[(self->id + i) % sched.nworkers].q);
+  if (w != NULL)
+    l_atomicadd(&sched.pending, -1);
+  return w;
+}
+
+
+static void workerloop (Worker *self) {
+  currentworker = self;
+  while (!l_atomicget(&sched.stopping)) {
+    Work *w = findwork(self);
+    if (w != NULL)
+      w->run(w);
+    else {  /* nothing to do; sleep until something is queued */
+      l_lock(&sched.lock);
+      l_atomicadd(&sched.sleeping, 1);
+      while (l_atomicget(&sched.pending) == 0 && !sched.stopping)
+        l_condwait(&sched.wake, &sched.lock);
+      l_atomicadd(&sched.sleeping, -1);
+      l_unlock(&sched.lock);
+    }
+  }
+}
+
+
+/*
+** Starts the workers if they are not running yet; returns 0 if it
+** could not start any worker or if the workers are stopping.
+*/
+static int startworkers (void) {
+  int ok = 1;
+  l_initonce();
+  l_lock(&sched.lock);
+  if (sched.stopping)
+    ok = 0;
+  else if (sched.nworkers == 0) {
+    int i, n = sched.wanted;
+    Worker *ws = (Worker *)malloc(n * sizeof(Worker));
+    if (ws == NULL) n = 0;
+    for (i = 0; i < n; i++) {
+      wq_init(&ws[i].q);
+      l_mutexinit(&ws[i].runlock);
+      ws[i].L = ws[i].running = NULL;
+      ws[i].id = i;
+    }
+    sched.workers = ws;
+    sched.nworkers = n;  /* set before the workers read it */
+    for (i = 0; i < n; i++) {
+      if (!l_startthread(&ws[i].thread, &ws[i]))
+        break;
+    }
+    if (i == 0) ok = 0;
+    else if (i < n) {  /* some threads did not start? */
+      while (n > i) {
+        n--;
+        l_mutexfree(&ws[n].runlock);
+        l_mutexfree(&ws[n].q.lock);
+      }
+      sched.nworkers = n;
+    }
+  }
+  l_unlock(&sched.lock);
+  return ok;
+}
+
+
+/* count hook that stops the Lua code of a worker */
+static void stophook (lua_State *L, lua_Debug *ar) {
+  (void)ar;
+  luaL_error(L, "task library stopped");
+}
+
+
+/*
+** Sets the state in which worker 'w' runs Lua code. Code that starts
+** running while the workers stop is stopped at once.
+*/
+static void setrunning (Worker *w, lua_State *L) {
+  l_lock(&w->runlock);
+  w->running = L;
+  if (L != NULL && l_atomicget(&sched.stopping))
+    lua_sethook(L, stophook, LUA_MASKCOUNT, 1);
+  l_unlock(&w->runlock);
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Messages
+** A message holds a list of values copied out of a state: scalars and
+** strings by value, tables as a flat sequence of entries, Lua functions
+** as binary chunks plus their upvalues, and channels and buffers by
+** reference (each reference counts as an owner of the object).
+** ===================================================================
+*/
+
+/*
+** Header of the objects that states share (channels and buffers); the
+** last owner to let go of an object frees it.
+*/
+typedef struct Shared {
+  volatile long refs;  /* handles and messages that refer to the object */
+  void (*free) (struct Shared *o);
+} Shared;
+
+
+static void release (Shared *o) {
+  if (l_atomicadd(&o->refs, -1) == 0)
+    o->free(o);
+}
+
+
+typedef struct Msg {
+  char *data;
+  size_t size;  /* bytes used in 'data' */
+  size_t capacity;  /* size of 'data' */
+  Shared **refs;  /* shared objects referred by this message */
+  int nrefs;
+  int szrefs;
+} Msg;
+
+
+/* tags in messages */
+#define M_NIL		1
+#define M_FALSE		2
+#define M_TRUE		3
+#define M_INT		4
+#define M_FLT		5
+#define M_STR		6
+#define M_TABLE		7
+#define M_GLOBALS	8	/* the global table of the receiving state */
+#define M_LFUNC		9
+#define M_CFUNC		10
+#define M_CHANNEL	11
+#define M_LIGHTUD	12
+#define M_BUFFER	13
+
+
+static void freemsg (Msg *m) {
+  int i;
+  for (i = 0; i < m->nrefs; i++) {
+    if (m->refs[i] != NULL)  /* not taken by a receiver? */
+      release(m->refs[i]);
+  }
+  free(m->refs);
+  free(m->data);
+  free(m);
+}
+
+
+/*
+** Messages under construction (or being decoded) live in a box, a full
+** userdata that frees them if an error interrupts the work.
+*/
+static int boxgc (lua_State *L) {
+  Msg **box = (Msg **)luaL_checkudata(L, 1, MESSAGE);
+  if (*box != NULL) freemsg(*box);
+  *box = NULL;
+  return 0;
+}
+
+
+static Msg **newbox (lua_State *L, Msg *m) {
+  Msg **box = (Msg **)lua_newuserdata(L, sizeof(Msg *));
+  *box = m;
+  luaL_setmetatable(L, MESSAGE);
+  return box;
+}
+
+
+/* takes the message out of its box */
+static Msg *unbox (Msg **box) {
+  Msg *m = *box;
+  *box = NULL;
+  return m;
+}
+
+
+static void addbytes (lua_State *L, Msg *m, const void *b, size_t n) {
+  if (n > m->capacity - m->size) {  /* no space? */
+    size_t newsize = m->capacity * 2;
+    char *newdata;
+    if (newsize - m->size < n) newsize = m->size + n;
+    if (newsize < 64) newsize = 64;
+    newdata = (char *)realloc(m->data, newsize);
+    if (newdata == NULL)
+      luaL_error(L, "not enough memory");
+    m->data = newdata;
+    m->capacity = newsize;
+  }
+  memcpy(m->data + m->size, b, n);
+  m->size += n;
+}
+
+#define addvar(L,m,x)	addbytes(L, m, &(x), sizeof(x))
+
+
+static void addtag (lua_State *L, Msg *m, int tag) {
+  unsigned char t = (unsigned char)tag;
+  addbytes(L, m, &t, 1);
+}
+
+
+static void addstring (lua_State *L, Msg *m, int idx) {
+  size_t l;
+  const char *s = lua_tolstring(L, idx, &l);
+  addvar(L, m, l);
+  addbytes(L, m, s, l);
+}
+
+
+static void addshared (lua_State *L, Msg *m, Shared *o, int tag) {
+  int i = m->nrefs;
+  if (i == m->szrefs) {  /* no space? */
+    int newsize = (i == 0) ? 4 : i * 2;
+    Shared **newrefs = (Shared **)realloc(m->refs,
+                                          newsize * sizeof(Shared *));
+    if (newrefs == NULL)
+      luaL_error(L, "not enough memory");
+    m->refs = newrefs;
+    m->szrefs = newsize;
+  }
+  m->refs[m->nrefs++] = o;
+  l_atomicadd(&o->refs, 1);
+  addtag(L, m, tag);
+  addvar(L, m, i);
+}
+
+
+static void encodevalue (lua_State *L, Msg *m, int idx, int depth);
+
+
+/*
+** A table travels as the length of its sequence, the number of other
+** entries, the items of the sequence and then the other entries, so
+** that the receiver creates it with the right sizes and fills its array
+** part without rehashing.
+*/
+static void encodetable (lua_State *L, Msg *m, int idx, int depth) {
+  int i, na = (int)lua_rawlen(L, idx);
+  int nh = 0;
+  size_t pos;
+  addtag(L, m, M_TABLE);
+  addvar(L, m, na);
+  pos = m->size;
+  addvar(L, m, nh);  /* reserve space for the number of other entries */
+  for (i = 1; i <= na; i++) {
+    lua_rawgeti(L, idx, i);
+    encodevalue(L, m, lua_gettop(L), depth + 1);
+    lua_pop(L, 1);
+  }
+  lua_pushnil(L);
+  while (lua_next(L, idx)) {
+    int k = lua_gettop(L) - 1;
+    lua_Integer n;
+    if (!(lua_isinteger(L, k) &&
+          (n = lua_tointeger(L, k)) >= 1 && n <= na)) {  /* not sent yet? */
+      encodevalue(L, m, k, depth + 1);
+      encodevalue(L, m, k + 1, depth + 1);
+      nh++;
+    }
+    lua_pop(L, 1);  /* pop value */
+  }
+  memcpy(m->data + pos, &nh, sizeof(nh));  /* fix number of entries */
+}
+
+
+static int dumpwriter (lua_State *L, const void *b, size_t size, void *m) {
+  addbytes(L, (Msg *)m, b, size);
+  return 0;
+}
+
+
+/*
+** A Lua function travels as a binary chunk followed by its upvalues,
+** which must be values a message can carry.
+*/
+static void encodefunction (lua_State *L, Msg *m, int idx, int depth) {
+  size_t pos, size;
+  unsigned char n;
+  if (lua_iscfunction(L, idx)) {
+    lua_CFunction f = lua_tocfunction(L, idx);
+    if (lua_getupvalue(L, idx, 1) != NULL)
+      luaL_error(L, "cannot send a C function with upvalues");
+    addtag(L, m, M_CFUNC);
+    addvar(L, m, f);
+    return;
+  }
+  addtag(L, m, M_LFUNC);
+  pos = m->size;
+  size = 0;
+  addvar(L, m, size);  /* reserve space for the size of the chunk */
+  lua_pushvalue(L, idx);
+  lua_dump(L, dumpwriter, m, 0);
+  lua_pop(L, 1);
+  size = m->size - pos - sizeof(size);
+  memcpy(m->data + pos, &size, sizeof(size));  /* fix size of the chunk */
+  for (n = 0; lua_getupvalue(L, idx, n + 1) != NULL; n++)
+    lua_pop(L, 1);
+  addvar(L, m, n);
+  for (n = 0; lua_getupvalue(L, idx, n + 1) != NULL; n++) {
+    encodevalue(L, m, lua_gettop(L), depth + 1);
+    lua_pop(L, 1);
+  }
+}
+
+
+static void encodevalue (lua_State *L, Msg *m, int idx, int depth) {
+  if (depth > MAXMSGDEPTH)
+    luaL_error(L, "message too deep (or with cycles)");
+  luaL_checkstack(L, 4, "message too deep");
+  switch (lua_type(L, idx)) {
+    case LUA_TNIL:
+      addtag(L, m, M_NIL);
+      break;
+    case LUA_TBOOLEAN:
+      addtag(L, m, lua_toboolean(L, idx) ? M_TRUE : M_FALSE);
+      break;
+    case LUA_TNUMBER:
+      if (lua_isinteger(L, idx)) {
+        lua_Integer i = lua_tointeger(L, idx);
+        addtag(L, m, M_INT);
+        addvar(L, m, i);
+      }
+      else {
+        lua_Number n = lua_tonumber(L, idx);
+        addtag(L, m, M_FLT);
+        addvar(L, m, n);
+      }
+      break;
+    case LUA_TSTRING:
+      addtag(L, m, M_STR);
+      addstring(L, m, idx);
+      break;
+    case LUA_TTABLE: {
+      int isglobals;
+      lua_pushglobaltable(L);
+      isglobals = lua_rawequal(L, idx, -1);
+      lua_pop(L, 1);
+      if (isglobals) addtag(L, m, M_GLOBALS);
+      else encodetable(L, m, idx, depth);
+      break;
+    }
+    case LUA_TFUNCTION:
+      encodefunction(L, m, idx, depth);
+      break;
+    case LUA_TLIGHTUSERDATA: {
+      void *p = lua_touserdata(L, idx);
+      addtag(L, m, M_LIGHTUD);
+      addvar(L, m, p);
+      break;
+    }
+    case LUA_TUSERDATA: {
+      Shared **p;
+      if ((p = (Shared **)luaL_testudata(L, idx, CHANNEL)) != NULL)
+        addshared(L, m, *p, M_CHANNEL);
+      else if ((p = (Shared **)luaL_testudata(L, idx, BUFFER)) != NULL)
+        addshared(L, m, *p, M_BUFFER);
+      else
+        luaL_error(L, "cannot send a userdata");
+      break;
+    }
+    default:
+      luaL_error(L, "cannot send a %s", luaL_typename(L, idx));
+  }
+}
+
+
+/*
+** Builds a message with the values from 'first' to the top and leaves
+** it in a box on the top of the stack.
+*/
+static Msg **encode (lua_State *L, int first) {
+  int i, top = lua_gettop(L);
+  Msg *m = (Msg *)malloc(sizeof(Msg));
+  Msg **box;
+  if (m == NULL)
+    luaL_error(L, "not enough memory");
+  memset(m, 0, sizeof(Msg));
+  box = newbox(L, m);
+  for (i = first; i <= top; i++)
+    encodevalue(L, m, i, 0);
+  return box;
+}
+
+
+typedef struct Decoder {
+  Msg *m;
+  const char *p;  /* next byte to read */
+} Decoder;
+
+
+#define getvar(D,x)	(memcpy(&(x), (D)->p, sizeof(x)), (D)->p += sizeof(x))
+
+
+static void pushshared (lua_State *L, Shared *o, const char *tname);
+
+static void decodevalue (lua_State *L, Decoder *D, int tag);
+
+
+static void decodefunction (lua_State *L, Decoder *D) {
+  size_t size;
+  unsigned char n, i;
+  getvar(D, size);
+  if (luaL_loadbufferx(L, D->p, size, "=(message)", "b") != LUA_OK)
+    lua_error(L);
+  D->p += size;
+  getvar(D, n);
+  for (i = 1; i <= n; i++) {
+    decodevalue(L, D, (unsigned char)*D->p++);
+    lua_setupvalue(L, -2, i);
+  }
+}
+
+
+static void decodevalue (lua_State *L, Decoder *D, int tag) {
+  luaL_checkstack(L, 4, "message too deep");
+  switch (tag) {
+    case M_NIL: lua_pushnil(L); break;
+    case M_FALSE: lua_pushboolean(L, 0); break;
+    case M_TRUE: lua_pushboolean(L, 1); break;
+    case M_INT: {
+      lua_Integer i;
+      getvar(D, i);
+      lua_pushinteger(L, i);
+      break;
+    }
+    case M_FLT: {
+      lua_Number n;
+      getvar(D, n);
+      lua_pushnumber(L, n);
+      break;
+    }
+    case M_STR: {
+      size_t l;
+      getvar(D, l);
+      lua_pushlstring(L, D->p, l);
+      D->p += l;
+      break;
+    }
+    case M_TABLE: {
+      int i, na, nh;
+      getvar(D, na);
+      getvar(D, nh);
+      lua_createtable(L, na, nh);
+      for (i = 1; i <= na; i++) {
+        decodevalue(L, D, (unsigned char)*D->p++);
+        lua_rawseti(L, -2, i);
+      }
+      for (i = 0; i < nh; i++) {
+        decodevalue(L, D, (unsigned char)*D->p++);
+        decodevalue(L, D, (unsigned char)*D->p++);
+        lua_rawset(L, -3);
+      }
+      break;
+    }
+    case M_GLOBALS: lua_pushglobaltable(L); break;
+    case M_LFUNC: decodefunction(L, D); break;
+    case M_CFUNC: {
+      lua_CFunction f;
+      getvar(D, f);
+      lua_pushcfunction(L, f);
+      break;
+    }
+    case M_CHANNEL: case M_BUFFER: {
+      int i;
+      getvar(D, i);
+      pushshared(L, D->m->refs[i], (tag == M_CHANNEL) ? CHANNEL : BUFFER);
+      D->m->refs[i] = NULL;  /* the new handle owns this reference */
+      break;
+    }
+    case M_LIGHTUD: {
+      void *p;
+      getvar(D, p);
+      lua_pushlightuserdata(L, p);
+      break;
+    }
+    default: lua_assert(0);
+  }
+}
+
+
+/*
+** Pushes the values in the message in the box on the top of the stack,
+** replacing the box; returns the number of values.
+*/
+static int decode (lua_State *L) {
+  int box = lua_gettop(L);
+  Decoder D;
+  D.m = *(Msg **)lua_touserdata(L, box);
+  D.p = D.m->data;
+  while (D.p < D.m->data + D.m->size)
+    decodevalue(L, &D, (unsigned char)*D.p++);
+  freemsg(unbox((Msg **)lua_touserdata(L, box)));
+  lua_remove(L, box);
+  return lua_gettop(L) - box + 1;
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Tasks
+** ===================================================================
+*/
+
+/* key, in the registry of a task state, for its 'Task' */
+static const int TASKKEY = 0;
+
+
+typedef struct TaskList {
+  struct Task *first;
+  struct Task *last;
+} TaskList;
+
+
+typedef struct Task {
+  Work work;  /* must be the first field */
+  lua_State *L;
+  int nargs;  /* number of values for the next resume */
+  struct Channel *blockedon;  /* channel the task is waiting for */
+  int sending;  /* is it waiting to send (or to receive)? */
+  struct Task *nextwaiting;  /* link in the list of a channel */
+  struct Task *previous, *next;  /* links in the list of live tasks */
+} Task;
+
+
+static void tl_append (TaskList *l, Task *t) {
+  t->nextwaiting = NULL;
+  if (l->last) l->last->nextwaiting = t;
+  else l->first = t;
+  l->last = t;
+}
+
+
+static Task *tl_remove (TaskList *l) {
+  Task *t = l->first;
+  if (t != NULL) {
+    l->first = t->nextwaiting;
+    if (l->first == NULL) l->last = NULL;
+  }
+  return t;
+}
+
+
+/*
+** Returns the task of 'L' if 'L' is the main thread of a task and can
+** yield, so that it may wait for a channel without blocking its worker.
+*/
+static Task *yieldabletask (lua_State *L) {
+  Task *t;
+  lua_rawgetp(L, LUA_REGISTRYINDEX, &TASKKEY);
+  t = (Task *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  return (t != NULL && t->L == L && lua_isyieldable(L)) ? t : NULL;
+}
+
+
+/*
+** Returns the task that waits for a channel by yielding, or NULL when
+** the caller is not in a worker and may block its OS thread. A caller
+** in a worker that cannot yield (in a coroutine, a metamethod, etc.)
+** gets an error instead, as blocking would stall the worker.
+*/
+static Task *waitingtask (lua_State *L) {
+  Task *t = yieldabletask(L);
+  if (t == NULL && currentworker != NULL)
+    luaL_error(L, "cannot wait for a channel here (task cannot yield)");
+  else if (l_atomicget(&sched.stopping))
+    luaL_error(L, "task library stopped");
+  return t;
+}
+
+
+/* adds 't' to the list of live tasks; returns 0 if workers stop */
+static int linktask (Task *t) {
+  int ok;
+  l_lock(&sched.lock);
+  ok = !sched.stopping;
+  if (ok) {
+    t->previous = NULL;
+    t->next = sched.tasks;
+    if (sched.tasks) sched.tasks->previous = t;
+    sched.tasks = t;
+  }
+  l_unlock(&sched.lock);
+  return ok;
+}
+
+
+static void unlinktask (Task *t) {
+  l_lock(&sched.lock);
+  if (t->previous) t->previous->next = t->next;
+  else sched.tasks = t->next;
+  if (t->next) t->next->previous = t->previous;
+  l_unlock(&sched.lock);
+}
+
+
+static void park (Task *t);
+
+
+static void runtask (Work *w) {
+  Task *t = (Task *)w;
+  lua_State *L = t->L;
+  int status;
+  setrunning(currentworker, L);
+  status = lua_resume(L, NULL, t->nargs);
+  setrunning(currentworker, NULL);
+  t->nargs = 0;
+  if (status == LUA_YIELD) {
+    lua_pop(L, lua_gettop(L));  /* yielded values go nowhere */
+    if (t->blockedon != NULL) park(t);
+    else submit(&t->work, 0);  /* let other tasks run */
+  }
+  else {  /* task finished */
+    if (status != LUA_OK && !l_atomicget(&sched.stopping)) {
+      const char *msg = lua_tostring(L, -1);
+      lua_writestringerror("task error: %s\n",
+                           (msg != NULL) ? msg : "(error object is not a string)");
+    }
+    unlinktask(t);
+    lua_close(L);
+    free(t);
+  }
+}
+
+
+static int opentask (lua_State *L);
+static int openparallel (lua_State *L);
+
+
+/*
+** Opens the standard libraries and these ones, which 'luaL_openlibs'
+** leaves out (without anchors: states of the workers do not keep them
+** running)
+*/
+static void openlibs (lua_State *L) {
+  luaL_openlibs(L);
+  luaL_requiref(L, LUA_TASKLIBNAME, opentask, 1);
+  luaL_requiref(L, LUA_PARALLELLIBNAME, openparallel, 1);
+  lua_pop(L, 2);
+}
+
+
+/*
+** Opens the libraries of a new task state and unpacks its function
+** and arguments.
+*/
+static int starttask (lua_State *L) {
+  Msg **src = (Msg **)lua_touserdata(L, 1);
+  Task *t = (Task *)lua_touserdata(L, 2);
+  lua_settop(L, 0);
+  openlibs(L);
+  lua_pushlightuserdata(L, t);
+  lua_rawsetp(L, LUA_REGISTRYINDEX, &TASKKEY);
+  newbox(L, unbox(src));
+  return decode(L);
+}
+
+
+static int task_spawn (lua_State *L) {
+  Msg **box;
+  Task *t;
+  lua_State *T;
+  int status;
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  box = encode(L, 1);
+  t = (Task *)malloc(sizeof(Task));
+  T = (t != NULL) ? luaL_newstate() : NULL;
+  if (T == NULL) {
+    free(t);
+    return luaL_error(L, "cannot create task");
+  }
+  t->work.run = runtask;
+  t->L = T;
+  t->blockedon = NULL;
+  lua_pushcfunction(T, starttask);
+  lua_pushlightuserdata(T, box);
+  lua_pushlightuserdata(T, t);
+  status = lua_pcall(T, 2, LUA_MULTRET, 0);
+  if (status != LUA_OK || !startworkers() || !linktask(t)) {
+    lua_pushstring(L, (status != LUA_OK) ? lua_tostring(T, -1)
+                                         : "cannot start workers");
+    lua_close(T);
+    free(t);
+    return lua_error(L);
+  }
+  t->nargs = lua_gettop(T) - 1;
+  submit(&t->work, 1);
+  return 0;
+}
+
+
+/*
+** Gives the worker to other tasks; does nothing outside a task.
+*/
+static int task_yield (lua_State *L) {
+  if (yieldabletask(L) == NULL) return 0;
+  return lua_yield(L, 0);
+}
+
+
+/*
+** Returns the number of workers; before they start, sets how many to
+** start.
+*/
+static int task_workers (lua_State *L) {
+  int n = (int)luaL_optinteger(L, 1, 0);
+  l_initonce();
+  l_lock(&sched.lock);
+  if (n > 0 && sched.nworkers == 0)
+    sched.wanted = (n < LUAI_MAXWORKERS) ? n : LUAI_MAXWORKERS;
+  n = (sched.nworkers > 0) ? sched.nworkers : sched.wanted;
+  l_unlock(&sched.lock);
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Shared objects and buffers
+** ===================================================================
+*/
+
+/* pushes a new handle for 'o', which takes over one reference */
+static void pushshared (lua_State *L, Shared *o, const char *tname) {
+  Shared **p = (Shared **)lua_newuserdata(L, sizeof(Shared *));
+  *p = o;
+  luaL_setmetatable(L, tname);
+}
+
+
+static int shared_gc (lua_State *L) {
+  Shared **p = (Shared **)lua_touserdata(L, 1);
+  if (*p != NULL) release(*p);
+  *p = NULL;
+  return 0;
+}
+
+
+typedef struct Buffer {
+  Shared h;  /* must be the first field */
+  size_t size;
+  char data[1];
+} Buffer;
+
+
+static void freebuffer (Shared *o) {
+  free(o);
+}
+
+
+static Buffer *checkbuffer (lua_State *L) {
+  return *(Buffer **)luaL_checkudata(L, 1, BUFFER);
+}
+
+
+static int task_buffer (lua_State *L) {
+  size_t l;
+  const char *s = luaL_checklstring(L, 1, &l);
+  Shared **p = (Shared **)lua_newuserdata(L, sizeof(Shared *));
+  Buffer *b;
+  *p = NULL;
+  luaL_setmetatable(L, BUFFER);
+  b = (Buffer *)malloc(sizeof(Buffer) + l);
+  if (b == NULL)
+    return luaL_error(L, "not enough memory");
+  b->h.refs = 1;
+  b->h.free = freebuffer;
+  b->size = l;
+  memcpy(b->data, s, l);
+  *p = &b->h;
+  return 1;
+}
+
+
+/* buffer:sub([i [, j]]), with the same conventions as 'string.sub' */
+static int buf_sub (lua_State *L) {
+  Buffer *b = checkbuffer(L);
+  lua_Integer l = (lua_Integer)b->size;
+  lua_Integer i = luaL_optinteger(L, 2, 1);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+  if (i < 0) i = (-i > l) ? 0 : l + i + 1;
+  if (j < 0) j = (-j > l) ? 0 : l + j + 1;
+  if (i < 1) i = 1;
+  if (j > l) j = l;
+  if (i <= j) lua_pushlstring(L, b->data + i - 1, (size_t)(j - i + 1));
+  else lua_pushliteral(L, "");
+  return 1;
+}
+
+
+static int buf_len (lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)checkbuffer(L)->size);
+  return 1;
+}
+
+
+static int buf_tostring (lua_State *L) {
+  lua_pushfstring(L, "buffer (%p)", (void *)checkbuffer(L));
+  return 1;
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Channels
+** A channel is a ring of cells (D. Vyukov's bounded queue): each cell
+** has a sequence number saying which position it is ready for, so that
+** senders and receivers claim positions with a compare-and-swap and
+** never take the lock while the channel is neither full nor empty. The
+** lock only guards the lists of callers that must wait.
+** ===================================================================
+*/
+
+typedef struct Cell {
+  volatile long seq;
+  Msg *m;
+} Cell;
+
+
+typedef struct Channel {
+  Shared h;  /* must be the first field */
+  Cell *ring;  /* 'mask + 1' cells */
+  unsigned long mask;
+  volatile long sendpos;  /* next position to fill */
+  volatile long recvpos;  /* next position to empty */
+  volatile long nwaiting[2];  /* receivers and senders off the fast path */
+  l_mutex lock;  /* protects the fields below */
+  l_cond cond;  /* for waiting OS threads that do not run tasks */
+  TaskList waiting[2];  /* tasks waiting to receive and to send */
+  int nblocked;  /* OS threads waiting on 'cond' */
+} Channel;
+
+
+/* positions wrap around */
+#define posdiff(a,b)	((long)((unsigned long)(a) - (unsigned long)(b)))
+#define posadd(a,n)	((long)((unsigned long)(a) + (n)))
+
+#define getcell(ch,pos)	(&(ch)->ring[(unsigned long)(pos) & (ch)->mask])
+
+/* number of queued messages (exact only when no operation is running) */
+#define ringcount(ch)  \
+	posdiff(l_atomicget(&(ch)->sendpos), l_atomicget(&(ch)->recvpos))
+
+
+static int ringpush (Channel *ch, Msg *m) {
+  long pos = l_atomicget(&ch->sendpos);
+  for (;;) {
+    Cell *c = getcell(ch, pos);
+    long dif = posdiff(l_atomicget(&c->seq), pos);
+    if (dif == 0) {  /* cell is free? */
+      if (l_atomiccas(&ch->sendpos, pos, posadd(pos, 1))) {
+        c->m = m;
+        l_atomicset(&c->seq, posadd(pos, 1));  /* ready to be emptied */
+        return 1;
+      }
+    }
+    else if (dif < 0)  /* cell still holds a message from a lap ago? */
+      return 0;  /* channel is full */
+    pos = l_atomicget(&ch->sendpos);  /* someone else took 'pos' */
+  }
+}
+
+
+static Msg *ringpop (Channel *ch) {
+  long pos = l_atomicget(&ch->recvpos);
+  for (;;) {
+    Cell *c = getcell(ch, pos);
+    long dif = posdiff(l_atomicget(&c->seq), posadd(pos, 1));
+    if (dif == 0) {  /* cell is filled? */
+      if (l_atomiccas(&ch->recvpos, pos, posadd(pos, 1))) {
+        Msg *m = c->m;
+        l_atomicset(&c->seq, posadd(pos, ch->mask + 1));  /* next lap */
+        return m;
+      }
+    }
+    else if (dif < 0)  /* cell not filled yet? */
+      return NULL;  /* channel is empty */
+    pos = l_atomicget(&ch->recvpos);  /* someone else took 'pos' */
+  }
+}
+
+
+static int tryop (Channel *ch, int sending, Msg **m) {
+  if (sending) return ringpush(ch, *m);
+  else return (*m = ringpop(ch)) != NULL;
+}
+
+
+/*
+** Slow path of an operation. The caller counts itself in 'nwaiting'
+** (with the channel locked) before it tries the ring a last time; an
+** operation that succeeds on the ring reads 'nwaiting' after it, so
+** either the waiter sees the change or the operation sees the waiter.
+** Returns whether the operation was done. When it was not, a task
+** stays counted and yields ('park' finishes the job); an OS thread
+** waits for a change and tries again.
+*/
+static int waitop (Channel *ch, int sending, Msg **m, Task *self) {
+  int done;
+  l_lock(&ch->lock);
+  l_atomicadd(&ch->nwaiting[sending], 1);
+  done = tryop(ch, sending, m);
+  if (!done && self == NULL) {
+    ch->nblocked++;
+    l_condwait(&ch->cond, &ch->lock);
+    ch->nblocked--;
+  }
+  if (done || self == NULL)
+    l_atomicadd(&ch->nwaiting[sending], -1);
+  l_unlock(&ch->lock);
+  return done;
+}
+
+
+/* after an operation, wakes those waiting on the other side */
+static void wakeup (Channel *ch, int sending) {
+  int side = !sending;
+  if (l_atomicget(&ch->nwaiting[side]) > 0) {
+    Task *t;
+    l_lock(&ch->lock);
+    if (ch->nblocked > 0)
+      l_condbroadcast(&ch->cond);
+    t = tl_remove(&ch->waiting[side]);
+    if (t != NULL)
+      l_atomicadd(&ch->nwaiting[side], -1);
+    l_unlock(&ch->lock);
+    if (t != NULL) submit(&t->work, 1);
+  }
+}
+
+
+/*
+** Called by the worker after a task yielded to wait for a channel:
+** the task only goes to the waiting list if its operation still
+** cannot proceed.
+*/
+static void park (Task *t) {
+  Channel *ch = t->blockedon;
+  long n;
+  int ready;
+  t->blockedon = NULL;
+  l_lock(&ch->lock);
+  n = ringcount(ch);
+  ready = t->sending ? (n <= (long)ch->mask) : (n > 0);
+  if (ready)
+    l_atomicadd(&ch->nwaiting[t->sending], -1);
+  else
+    tl_append(&ch->waiting[t->sending], t);
+  l_unlock(&ch->lock);
+  if (ready) submit(&t->work, 1);
+}
+
+
+static void freechannel (Shared *o) {
+  Channel *ch = (Channel *)o;
+  Msg *m;
+  while ((m = ringpop(ch)) != NULL)
+    freemsg(m);
+  free(ch->ring);
+  l_condfree(&ch->cond);
+  l_mutexfree(&ch->lock);
+  free(ch);
+}
+
+
+static Channel *checkchannel (lua_State *L) {
+  return *(Channel **)luaL_checkudata(L, 1, CHANNEL);
+}
+
+
+static int sendk (lua_State *L, int status, lua_KContext ctx) {
+  Channel *ch = checkchannel(L);
+  Msg **box = (Msg **)lua_touserdata(L, (int)ctx);
+  (void)status;
+  while (!tryop(ch, 1, box)) {  /* channel full? */
+    Task *self = waitingtask(L);
+    if (waitop(ch, 1, box, self))
+      break;
+    if (self != NULL) {
+      self->blockedon = ch;
+      self->sending = 1;
+      return lua_yieldk(L, 0, ctx, sendk);
+    }
+  }
+  unbox(box);  /* message now belongs to the channel */
+  wakeup(ch, 1);
+  return 0;
+}
+
+
+static int ch_send (lua_State *L) {
+  checkchannel(L);
+  encode(L, 2);  /* message goes in a box on the top */
+  return sendk(L, LUA_OK, lua_gettop(L));
+}
+
+
+static int receivek (lua_State *L, int status, lua_KContext ctx) {
+  Channel *ch = checkchannel(L);
+  Msg **box;
+  (void)status; (void)ctx;
+  lua_settop(L, 1);
+  box = newbox(L, NULL);  /* box for the message, made before taking it */
+  while (!tryop(ch, 0, box)) {  /* channel empty? */
+    Task *self = waitingtask(L);
+    if (waitop(ch, 0, box, self))
+      break;
+    if (self != NULL) {
+      self->blockedon = ch;
+      self->sending = 0;
+      return lua_yieldk(L, 0, 0, receivek);
+    }
+  }
+  wakeup(ch, 0);
+  return decode(L);
+}
+
+
+static int ch_receive (lua_State *L) {
+  return receivek(L, LUA_OK, 0);
+}
+
+
+static int ch_tostring (lua_State *L) {
+  lua_pushfstring(L, "channel (%p)", (void *)checkchannel(L));
+  return 1;
+}
+
+
+/*
+** task.channel([capacity]): the capacity is rounded up to a power of 2
+*/
+static int task_channel (lua_State *L) {
+  lua_Integer capacity = luaL_optinteger(L, 1, LUAI_CHANNELSIZE);
+  Shared **p;
+  Channel *ch;
+  unsigned long size, i;
+  luaL_argcheck(L, 0 < capacity && capacity <= MAXCHANNEL, 1,
+                "capacity out of range");
+  for (size = 1; size < (unsigned long)capacity; size *= 2) ;
+  p = (Shared **)lua_newuserdata(L, sizeof(Shared *));
+  *p = NULL;
+  luaL_setmetatable(L, CHANNEL);
+  ch = (Channel *)malloc(sizeof(Channel));
+  if (ch != NULL && (ch->ring = (Cell *)malloc(size * sizeof(Cell))) == NULL) {
+    free(ch);
+    ch = NULL;
+  }
+  if (ch == NULL)
+    return luaL_error(L, "not enough memory");
+  for (i = 0; i < size; i++)
+    ch->ring[i].seq = (long)i;
+  ch->h.refs = 1;
+  ch->h.free = freechannel;
+  ch->mask = size - 1;
+  ch->sendpos = ch->recvpos = 0;
+  ch->nwaiting[0] = ch->nwaiting[1] = 0;
+  l_mutexinit(&ch->lock);
+  l_condinit(&ch->cond);
+  ch->waiting[0].first = ch->waiting[0].last = NULL;
+  ch->waiting[1].first = ch->waiting[1].last = NULL;
+  ch->nblocked = 0;
+  *p = &ch->h;
+  return 1;
+}
+
+/* }================================================================== */
+
+
+/*
+** {==================================================================
+** Parallel loops
+** A call to 'map' or 'reduce' cuts its array into slices, each one a
+** message with the function and the items of the slice. Runners (work
+** items, at most one per worker used) claim slices until none is left
+** and run them in the state of their worker, which lives as long as
+** the worker, so each worker loads the libraries only once. A caller
+** that is itself a worker runs slices too while it waits.
+** ===================================================================
+*/
+
+#define CALL		"parallel.call"
+
+/* number of slices for each worker used, to balance the load */
+#define SLICESPERWORKER	4
+
+
+typedef struct Runner {
+  Work work;  /* must be the first field */
+  struct Call *call;
+} Runner;
+
+
+typedef struct Call {
+  Shared h;  /* owned by the caller and by each runner */
+  int reduce;  /* reduce each slice to one value? */
+  int nslices;
+  Msg **slices;  /* input of each slice, replaced by its output */
+  volatile long next;  /* next slice to be claimed */
+  volatile long pending;  /* number of slices not finished */
+  l_mutex lock;
+  l_cond done;  /* signaled when 'pending' gets to 0 */
+  char *error;  /* message of the first error (or NULL) */
+  Runner *runners;
+} Call;
+
+
+static void freecall (Shared *o) {
+  Call *c = (Call *)o;
+  int i;
+  for (i = 0; i < c->nslices; i++) {
+    if (c->slices[i] != NULL) freemsg(c->slices[i]);
+  }
+  free(c->slices);
+  free(c->runners);
+  free(c->error);
+  l_condfree(&c->done);
+  l_mutexfree(&c->lock);
+  free(c);
+}
+
+
+/*
+** Runs a slice in a worker state: 'fn' followed by items go in, and the
+** result of each call (or a single value, when reducing) goes out.
+*/
+static int doslice (lua_State *L) {
+  Call *c = (Call *)lua_touserdata(L, 1);
+  int i = (int)lua_tointeger(L, 2);
+  Msg *in = c->slices[i];
+  Msg **out;
+  Decoder D;
+  lua_settop(L, 2);
+  out = encode(L, 3);  /* empty message (in a box) */
+  D.m = in;
+  D.p = in->data;
+  decodevalue(L, &D, (unsigned char)*D.p++);  /* function */
+  if (c->reduce)
+    decodevalue(L, &D, (unsigned char)*D.p++);  /* accumulator */
+  while (D.p < in->data + in->size) {
+    lua_pushvalue(L, 4);
+    if (c->reduce) lua_rotate(L, 5, 1);  /* fn, fn, acc */
+    decodevalue(L, &D, (unsigned char)*D.p++);
+    if (c->reduce) lua_call(L, 2, 1);  /* leaves new accumulator */
+    else {
+      lua_call(L, 1, 1);
+      encodevalue(L, *out, 5, 0);
+      lua_pop(L, 1);
+    }
+  }
+  if (c->reduce)
+    encodevalue(L, *out, 5, 0);
+  c->slices[i] = unbox(out);
+  freemsg(in);
+  return 0;
+}
+
+
+static int openworker (lua_State *L) {
+  openlibs(L);
+  return 0;
+}
+
+
+static void setcallerror (Call *c, const char *msg) {
+  l_lock(&c->lock);
+  if (c->error == NULL) {
+    size_t l = strlen(msg) + 1;
+    if ((c->error = (char *)malloc(l)) != NULL)
+      memcpy(c->error, msg, l);
+  }
+  l_unlock(&c->lock);
+}
+
+
+static void runslice (Call *c, int i) {
+  Worker *self = currentworker;
+  lua_State *L = self->L;
+  if (L == NULL) {  /* worker has no state yet? */
+    L = luaL_newstate();
+    if (L != NULL) {
+      lua_pushcfunction(L, openworker);
+      if (lua_pcall(L, 0, 0, 0) != LUA_OK) {
+        lua_close(L);
+        L = NULL;
+      }
+    }
+    self->L = L;
+  }
+  if (L == NULL)
+    setcallerror(c, "cannot create worker state");
+  else {
+    int top = lua_gettop(L);  /* may be running a slice already */
+    lua_State *running = self->running;  /* may be running a task */
+    setrunning(self, L);
+    lua_pushcfunction(L, doslice);
+    lua_pushlightuserdata(L, c);
+    lua_pushinteger(L, i);
+    if (lua_pcall(L, 2, 0, 0) != LUA_OK) {
+      const char *msg = lua_tostring(L, -1);
+      setcallerror(c, (msg != NULL) ? msg : "(error object is not a string)");
+    }
+    lua_settop(L, top);
+    setrunning(self, running);
+  }
+  if (l_atomicadd(&c->pending, -1) == 0) {  /* last slice? */
+    l_lock(&c->lock);
+    l_condbroadcast(&c->done);
+    l_unlock(&c->lock);
+  }
+}
+
+
+/* claims and runs slices until there are none left */
+static void runslices (Call *c) {
+  long i;
+  while ((i = l_atomicadd(&c->next, 1) - 1) < c->nslices)
+    runslice(c, (int)i);
+}
+
+
+static void runmap (Work *w) {
+  Call *c = ((Runner *)w)->call;
+  runslices(c);
+  release(&c->h);
+}
+
+
+/*
+** Cuts the array at index 2 into slices, runs them and leaves the call,
+** in a box, on the top of the stack.
+*/
+static Call *startcall (lua_State *L, int reduce, int nw) {
+  lua_Integer n = luaL_len(L, 2);
+  lua_Integer first, i;
+  Shared **box;
+  Call *c;
+  int s;
+  box = (Shared **)lua_newuserdata(L, sizeof(Shared *));
+  *box = NULL;
+  luaL_setmetatable(L, CALL);
+  c = (Call *)malloc(sizeof(Call));
+  if (c == NULL)
+    luaL_error(L, "not enough memory");
+  memset(c, 0, sizeof(Call));
+  l_mutexinit(&c->lock);
+  l_condinit(&c->done);
+  c->h.refs = 1;
+  c->h.free = freecall;
+  c->reduce = reduce;
+  *box = &c->h;
+  if (nw > n) nw = (int)n;
+  c->nslices = (nw * SLICESPERWORKER < n) ? nw * SLICESPERWORKER : (int)n;
+  c->slices = (Msg **)calloc(c->nslices, sizeof(Msg *));
+  c->runners = (Runner *)malloc(nw * sizeof(Runner));
+  if (c->slices == NULL || c->runners == NULL)
+    luaL_error(L, "not enough memory");
+  for (s = 0, first = 1; s < c->nslices; s++) {
+    lua_Integer last = n * (s + 1) / c->nslices;
+    encode(L, lua_gettop(L) + 1);  /* new empty message */
+    c->slices[s] = unbox((Msg **)lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    encodevalue(L, c->slices[s], 1, 0);
+    for (i = first; i <= last; i++) {
+      lua_geti(L, 2, i);
+      encodevalue(L, c->slices[s], lua_gettop(L), 0);
+      lua_pop(L, 1);
+    }
+    first = last + 1;
+  }
+  c->pending = c->nslices;
+  for (s = 0; s < nw; s++) {
+    c->runners[s].work.run = runmap;
+    c->runners[s].call = c;
+    l_atomicadd(&c->h.refs, 1);
+    submit(&c->runners[s].work, 0);
+  }
+  return c;
+}
+
+
+static void waitcall (lua_State *L, Call *c) {
+  if (currentworker != NULL)  /* caller is a worker? */
+    runslices(c);  /* help, so that calls from tasks cannot starve */
+  l_lock(&c->lock);
+  while (l_atomicget(&c->pending) > 0)
+    l_condwait(&c->done, &c->lock);
+  l_unlock(&c->lock);
+  if (c->error != NULL)
+    luaL_error(L, "%s", c->error);
+}
+
+
+/* number of workers to use, from the optional argument 'arg' */
+static int getnworkers (lua_State *L, int arg) {
+  lua_Integer nw = luaL_optinteger(L, arg, 0);
+  if (!startworkers())
+    luaL_error(L, "cannot start workers");
+  if (nw <= 0 || nw > sched.nworkers) nw = sched.nworkers;
+  return (int)nw;
+}
+
+
+/*
+** Stores the values in the output of slice 's' in the table on the
+** top, after index '*k'
+*/
+static void getslice (lua_State *L, Call *c, int s, lua_Integer *k) {
+  Decoder D;
+  D.m = c->slices[s];
+  D.p = D.m->data;
+  while (D.p < D.m->data + D.m->size) {
+    decodevalue(L, &D, (unsigned char)*D.p++);
+    lua_seti(L, -2, ++(*k));
+  }
+}
+
+
+/* parallel.map(fn, array [, nworkers]) */
+static int par_map (lua_State *L) {
+  int nw, s;
+  lua_Integer k = 0;
+  Call *c;
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  nw = getnworkers(L, 3);
+  lua_settop(L, 2);
+  if (luaL_len(L, 2) == 0) {
+    lua_newtable(L);
+    return 1;
+  }
+  c = startcall(L, 0, nw);
+  waitcall(L, c);
+  lua_createtable(L, (int)luaL_len(L, 2), 0);
+  for (s = 0; s < c->nslices; s++)
+    getslice(L, c, s, &k);
+  return 1;
+}
+
+
+/*
+** parallel.reduce(fn, array [, nworkers]): each slice is reduced on its
+** own, and then the caller reduces their results in order ('fn' must be
+** associative)
+*/
+static int par_reduce (lua_State *L) {
+  int nw, s;
+  lua_Integer k = 0;
+  Call *c;
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  nw = getnworkers(L, 3);
+  lua_settop(L, 2);
+  if (luaL_len(L, 2) == 0)
+    return 0;
+  c = startcall(L, 1, nw);
+  waitcall(L, c);
+  lua_newtable(L);  /* results of the slices */
+  for (s = 0; s < c->nslices; s++)
+    getslice(L, c, s, &k);
+  lua_geti(L, -1, 1);
+  for (s = 2; s <= k; s++) {
+    lua_pushvalue(L, 1);
+    lua_rotate(L, -2, 1);  /* fn, acc */
+    lua_geti(L, -3, s);
+    lua_call(L, 2, 1);
+  }
+  return 1;
+}
+
+/* }================================================================== */
+
+
+
+/*
+** {==================================================================
+** Shutdown
+** The workers run while some state outside them has opened one of the
+** libraries. Each such state holds an anchor; the finalizer of the
+** last one stops the workers and closes the tasks they left.
+** ===================================================================
+*/
+
+/* key, in the registry of a state, for its anchor */
+static const int ANCHORKEY = 0;
+
+#define ANCHOR		"task.anchor"
+
+
+/*
+** Stops the workers (Lua code running in them gets an error) and
+** frees what they leave: tasks not finished, runners not run and the
+** states of the workers.
+*/
+static void stopworkers (void) {
+  Worker *ws;
+  int i, n;
+  Task *t;
+  l_lock(&sched.lock);
+  ws = sched.workers;
+  n = sched.nworkers;
+  if (sched.users == 0 && n > 0) {  /* still nobody else using them? */
+    l_atomicset(&sched.stopping, 1);
+    l_condbroadcast(&sched.wake);
+  }
+  else n = 0;
+  l_unlock(&sched.lock);
+  if (n == 0) return;
+  for (i = 0; i < n; i++) {  /* stop code already running */
+    l_lock(&ws[i].runlock);
+    if (ws[i].running != NULL)
+      lua_sethook(ws[i].running, stophook, LUA_MASKCOUNT, 1);
+    l_unlock(&ws[i].runlock);
+  }
+  for (i = 0; i < n; i++)
+    l_jointhread(ws[i].thread);
+  for (i = 0; i <= n; i++) {
+    WorkQueue *q = (i < n) ? &ws[i].q : &sched.global;
+    Work *w;
+    while ((w = wq_popfront(q)) != NULL) {
+      if (w->run == runmap)  /* tasks are in the list of live tasks */
+        release(&((Runner *)w)->call->h);
+    }
+  }
+  while ((t = sched.tasks) != NULL) {
+    sched.tasks = t->next;
+    lua_close(t->L);
+    free(t);
+  }
+  for (i = 0; i < n; i++) {
+    if (ws[i].L != NULL) lua_close(ws[i].L);
+    l_mutexfree(&ws[i].runlock);
+    l_mutexfree(&ws[i].q.lock);
+  }
+  free(ws);
+  l_lock(&sched.lock);
+  sched.workers = NULL;
+  sched.nworkers = 0;
+  l_atomicset(&sched.pending, 0);
+  l_atomicset(&sched.stopping, 0);
+  l_unlock(&sched.lock);
+}
+
+
+static int anchor_gc (lua_State *L) {
+  int last;
+  (void)L;
+  l_lock(&sched.lock);
+  last = (--sched.users == 0);
+  l_unlock(&sched.lock);
+  if (last && currentworker == NULL)  /* a worker cannot join itself */
+    stopworkers();
+  return 0;
+}
+
+
+static void anchor (lua_State *L) {
+  if (lua_rawgetp(L, LUA_REGISTRYINDEX, &ANCHORKEY) == LUA_TNIL) {
+    lua_newuserdata(L, 0);
+    if (luaL_newmetatable(L, ANCHOR)) {
+      lua_pushcfunction(L, anchor_gc);
+      lua_setfield(L, -2, "__gc");
+    }
+    l_initonce();
+    l_lock(&sched.lock);
+    sched.users++;
+    l_unlock(&sched.lock);
+    lua_setmetatable(L, -2);  /* from now on, '__gc' counts it out */
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &ANCHORKEY);
+  }
+  lua_pop(L, 1);
+}
+
+/* }================================================================== */
+
+
+static const luaL_Reg task_funcs[] = {
+  {"spawn", task_spawn},
+  {"channel", task_channel},
+  {"buffer", task_buffer},
+  {"yield", task_yield},
+  {"workers", task_workers},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg ch_methods[] = {
+  {"send", ch_send},
+  {"receive", ch_receive},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg ch_meta[] = {
+  {"__gc", shared_gc},
+  {"__tostring", ch_tostring},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg buf_methods[] = {
+  {"sub", buf_sub},
+  {NULL, NULL}
+};
+
+
+static const luaL_Reg buf_meta[] = {
+  {"__gc", shared_gc},
+  {"__len", buf_len},
+  {"__tostring", buf_tostring},
+  {NULL, NULL}
+};
+
+
+static void createmeta (lua_State *L, const char *tname,
+                        const luaL_Reg *meta, const luaL_Reg *methods) {
+  luaL_newmetatable(L, tname);
+  luaL_setfuncs(L, meta, 0);
+  lua_newtable(L);
+  luaL_setfuncs(L, methods, 0);
+  lua_setfield(L, -2, "__index");
+  lua_pop(L, 1);  /* pop metatable */
+}
+
+
+static int opentask (lua_State *L) {
+  luaL_newmetatable(L, MESSAGE);
+  lua_pushcfunction(L, boxgc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 1);  /* pop metatable */
+  createmeta(L, CHANNEL, ch_meta, ch_methods);
+  createmeta(L, BUFFER, buf_meta, buf_methods);
+  luaL_newlib(L, task_funcs);
+  return 1;
+}
+
+
+static const luaL_Reg par_funcs[] = {
+  {"map", par_map},
+  {"reduce", par_reduce},
+  {NULL, NULL}
+};
+
+
+static int openparallel (lua_State *L) {
+  luaL_newmetatable(L, MESSAGE);
+  lua_pushcfunction(L, boxgc);
+  lua_setfield(L, -2, "__gc");
+  luaL_newmetatable(L, CALL);
+  lua_pushcfunction(L, shared_gc);
+  lua_setfield(L, -2, "__gc");
+  lua_pop(L, 2);  /* pop metatables */
+  luaL_newlib(L, par_funcs);
+  return 1;
+}
+
+
+LUAMOD_API int luaopen_task (lua_State *L) {
+  anchor(L);
+  return opentask(L);
+}
+
+
+LUAMOD_API int luaopen_parallel (lua_State *L) {
+  anchor(L);
+  return openparallel(L);
+}
+
+
+#else				/* }{ */
+
+
+LUAMOD_API int luaopen_task (lua_State *L) {
+  return luaL_error(L, "library 'task' not built (see LUA_USE_TASKLIB)");
+}
+
+
+LUAMOD_API int luaopen_parallel (lua_State *L) {
+  return luaL_error(L, "library 'parallel' not built (see LUA_USE_TASKLIB)");
+}
+
+#endif				/* } */
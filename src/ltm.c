@@ -44,7 +44,7 @@ void luaT_init (lua_State *L) {
     "__unm", "__bnot", "__lt", "__le",
     "__concat", "__call"
   };
-  // ַӽ string tableΪgc
+  // 把上述字符串，添加进 string table，并设置为不可gc
   int i;
   for (i=0; i<TM_N; i++) {
     G(L)->tmname[i] = luaS_new(L, luaT_eventname[i]);
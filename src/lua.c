@@ -102,6 +102,8 @@ static lua_State *globalL = NULL;
 
 static const char *progname = LUA_PROGNAME;
 
+static const char *scriptmode = NULL;  /* mode to load the main script */
+
 
 /*
 ** Hook set by signal function to stop the interpreter.
@@ -139,6 +141,7 @@ static void print_usage (const char *badoption) {
   "  -l name  require library 'name'\n"
   "  -v       show version information\n"
   "  -E       ignore environment variables\n"
+  "  -F       freeze library globals for 'script'\n"
   "  --       stop handling options\n"
   "  -        stop handling options and execute stdin\n"
   ,
@@ -328,7 +331,7 @@ static int pushline (lua_State *L, int firstline) {
 ** has either compiled chunk or original line (if compilation failed).
 */
 static int addreturn (lua_State *L) {
-  // ջǰ׺ return
+  // 入栈，加上前缀 return
   const char *line = lua_tostring(L, -1);  /* original line */
   const char *retline = lua_pushfstring(L, "return %s;", line);
 
@@ -371,12 +374,12 @@ static int multiline (lua_State *L) {
 */
 static int loadline (lua_State *L) {
   int status;
-  // ջ
+  // 清除栈
   lua_settop(L, 0);
-  // ȡһݣѹջ
+  // 读取一行内容，并压入栈
   if (!pushline(L, 1))
     return -1;  /* no input */
-  // ǰ return,
+  // 在语句前，加入 return,并编译
   if ((status = addreturn(L)) != LUA_OK)  /* 'return ...' did not work? */
     status = multiline(L);  /* try as command, maybe with continuation lines */
   lua_remove(L, 1);  /* remove line from the stack */
@@ -409,7 +412,7 @@ static void doREPL (lua_State *L) {
   int status;
   const char *oldprogname = progname;
   progname = NULL;  /* no 'progname' on errors in interactive mode */
-  //  stdinȡһ, Ա
+  // 从 stdin，读取一行输入, 并尝试编译
   while ((status = loadline(L)) != -1) {
 	// 
     if (status == LUA_OK)
@@ -444,7 +447,7 @@ static int handle_script (lua_State *L, char **argv) {
   const char *fname = argv[0];
   if (strcmp(fname, "-") == 0 && strcmp(argv[-1], "--") != 0)
     fname = NULL;  /* stdin */
-  status = luaL_loadfile(L, fname);
+  status = luaL_loadfilex(L, fname, scriptmode);
   if (status == LUA_OK) {
     int n = pushargs(L);  /* push arguments to script */
     status = docall(L, n, LUA_MULTRET);
@@ -460,6 +463,7 @@ static int handle_script (lua_State *L, char **argv) {
 #define has_v		4	/* -v */
 #define has_e		8	/* -e */
 #define has_E		16	/* -E */
+#define has_F		32	/* -F */
 
 /*
 ** Traverses all arguments from 'argv', returning a mask with those
@@ -487,6 +491,11 @@ static int collectargs (char **argv, int *first) {
           return has_error;  /* invalid option */
         args |= has_E;
         break;
+      case 'F':
+        if (argv[i][2] != '\0')  /* extra characters after 1st? */
+          return has_error;  /* invalid option */
+        args |= has_F;
+        break;
       case 'i':
         args |= has_i;  /* (-i implies -v) *//* FALLTHROUGH */ 
       case 'v':
@@ -556,14 +565,14 @@ static int handle_luainit (lua_State *L) {
 ** Reads the options and handles them all.
 */
 static int pmain (lua_State *L) {
-  // ջ 
+  // 从栈中 弹出参数
   int argc = (int)lua_tointeger(L, 1);
   char **argv = (char **)lua_touserdata(L, 2);
   int script;
 
   int a = sizeof(union GCUnion);  // 120 bytes
   int b = sizeof(struct GCObject); //  8 bytes
-  // 
+  // 参数检测
   int args = collectargs(argv, &script);
   luaL_checkversion(L);  /* check that interpreter has correct version */
   if (argv[0] && argv[0][0]) progname = argv[0];
@@ -578,7 +587,7 @@ static int pmain (lua_State *L) {
     lua_setfield(L, LUA_REGISTRYINDEX, "LUA_NOENV");
   }
 
-  // ׼ȫ State
+  // 将标准库引入全局 State
   luaL_openlibs(L);  /* open standard libraries */
   createargtable(L, argv, argc, script);  /* create table 'arg' */
   if (!(args & has_E)) {  /* no option '-E'? */
@@ -587,11 +596,15 @@ static int pmain (lua_State *L) {
   }
   if (!runargs(L, argv, script))  /* execute arguments -e and -l */
     return 0;  /* something failed */
+  if (args & has_F) {  /* option '-F'? */
+    luaL_freezeglobals(L);
+    scriptmode = "btF";
+  }
   if (script < argc &&  /* execute main script (if there is one) */
       handle_script(L, argv + script) != LUA_OK)
     return 0;
 
-  // ģʽ
+  // 交互模式
   if (args & has_i)  /* -i option? */
     doREPL(L);  /* do read-eval-print loop */
   else if (script == argc && !(args & (has_e | has_v))) {  /* no arguments? */
@@ -613,18 +626,18 @@ int main (int argc, char **argv) {
     l_message(argv[0], "cannot create state: not enough memory");
     return EXIT_FAILURE;
   }
-  // ׼ pmain ѹ ַ
+  // 准备调用 pmain 函数，依次压入 函数地址，各参数
   lua_pushcfunction(L, &pmain);  /* to call 'pmain' in protected mode */
   lua_pushinteger(L, argc);  /* 1st argument */
   lua_pushlightuserdata(L, argv); /* 2nd argument */
-  // ú     state, ,ֵ쳣ص
+  // 调用函数     state, 参数个数,返回值个数，异常回调函数
   status = lua_pcall(L, 2, 1, 0);  /* do the call */
-  // õý
+  // 获得调用结果，并报告
   result = lua_toboolean(L, -1);  /* get result */
   report(L, status);
-  // رlua
+  // 关闭lua
   lua_close(L);
-  // ˳
+  // 退出
   return (result && status == LUA_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -31,6 +31,9 @@ static void PrintFunction(const Proto* f, int full);
 static int listing=0;			/* list bytecodes? */
 static int dumping=1;			/* dump bytecodes? */
 static int stripping=0;			/* strip debug information? */
+static int archiving=0;			/* write a module archive? */
+static int optimizing=0;		/* run the peephole optimizer? */
+static int inlining=0;			/* also inline small local functions? */
 static char Output[]={ OUTPUT };	/* default output file name */
 static const char* output=Output;	/* actual output file name */
 static const char* progname=PROGNAME;	/* actual program name */
@@ -56,8 +59,11 @@ static void usage(const char* message)
  fprintf(stderr,
   "usage: %s [options] [filenames]\n"
   "Available options are:\n"
+  "  -a       write a module archive with one module per input file\n"
   "  -l       list (use -l -l for full listing)\n"
   "  -o name  output to file 'name' (default is \"%s\")\n"
+  "  -I       optimize bytecodes, inlining small local functions\n"
+  "  -O       optimize bytecodes\n"
   "  -p       parse only\n"
   "  -s       strip debug information\n"
   "  -v       show version information\n"
@@ -86,6 +92,8 @@ static int doargs(int argc, char* argv[])
   }
   else if (IS("-"))			/* end of options; use stdin */
    break;
+  else if (IS("-a"))			/* module archive */
+   archiving=1;
   else if (IS("-l"))			/* list */
    ++listing;
   else if (IS("-o"))			/* output file */
@@ -95,6 +103,10 @@ static int doargs(int argc, char* argv[])
     usage("'-o' needs argument");
    if (IS("-")) output=NULL;
   }
+  else if (IS("-I"))			/* optimize and inline */
+   inlining=1;
+  else if (IS("-O"))			/* optimize */
+   optimizing=1;
   else if (IS("-p"))			/* parse only */
    dumping=0;
   else if (IS("-s"))			/* strip debug information */
@@ -117,6 +129,8 @@ static int doargs(int argc, char* argv[])
  return i;
 }
 
+#define MODE	(inlining ? "btI" : optimizing ? "btO" : NULL)	/* load mode */
+
 #define FUNCTION "(function()end)();"
 
 static const char* reader(lua_State *L, void *ud, size_t *size)
@@ -162,17 +176,143 @@ static int writer(lua_State* L, const void* p, size_t size, void* u)
  return (fwrite(p,size,1,(FILE*)u)!=1) && (size!=0);
 }
 
+/*
+** module archives: each input file is dumped into memory and becomes a
+** module named after its path ("a/b.lua" is "a.b"; "a/init.lua" is "a")
+*/
+
+typedef struct Module
+{
+ char* name;
+ char* data;
+ size_t size;
+} Module;
+
+static int bwriter(lua_State* L, const void* p, size_t size, void* u)
+{
+ Module* m=(Module*)u;
+ char* data=(char*)realloc(m->data,m->size+size);
+ UNUSED(L);
+ if (data==NULL && m->size+size>0) return 1;
+ if (size>0) memcpy(data+m->size,p,size);
+ m->data=data;
+ m->size+=size;
+ return 0;
+}
+
+static char* modname(const char* filename)
+{
+ char* name=(char*)malloc(strlen(filename)+1);
+ char* p;
+ size_t n;
+ if (name==NULL) fatal("not enough memory");
+ while (filename[0]=='.' && (filename[1]=='/' || filename[1]=='\\'))
+  filename+=2;				/* skip "./" */
+ strcpy(name,filename);
+ p=strrchr(name,'.');			/* remove extension */
+ if (p!=NULL && strpbrk(p,"/\\")==NULL) *p=0;
+ for (p=name; *p; p++)
+  if (*p=='/' || *p=='\\') *p='.';
+ n=strlen(name);
+ if (n>5 && strcmp(name+n-5,".init")==0) name[n-5]=0;
+ return name;
+}
+
+static int cmpmodule(const void* a, const void* b)
+{
+ return strcmp(((const Module*)a)->name,((const Module*)b)->name);
+}
+
+static void putword(FILE* D, size_t w)
+{
+ unsigned char b[4];
+ b[0]=(unsigned char)w;
+ b[1]=(unsigned char)(w>>8);
+ b[2]=(unsigned char)(w>>16);
+ b[3]=(unsigned char)(w>>24);
+ fwrite(b,sizeof(b),1,D);
+}
+
+#define MAXARCHIVE	0xFFFFFFFFu
+
+static void archive(lua_State* L, int n, char** argv)
+{
+ Module* m=(Module*)calloc(n,sizeof(Module));
+ FILE* D;
+ size_t offset;
+ int i;
+ if (m==NULL) fatal("not enough memory");
+ for (i=0; i<n; i++)
+ {
+  const Proto* f;
+  int status;
+  if (IS("-")) fatal("cannot archive stdin");
+  if (luaL_loadfilex(L,argv[i],MODE)!=LUA_OK) fatal(lua_tostring(L,-1));
+  f=toproto(L,-1);
+  if (listing) luaU_print(f,listing>1);
+  m[i].name=modname(argv[i]);
+  lua_lock(L);
+  status=luaU_dump(L,f,bwriter,&m[i],stripping);
+  lua_unlock(L);
+  if (status!=0) fatal("not enough memory");
+  lua_pop(L,1);
+ }
+ qsort(m,n,sizeof(Module),cmpmodule);
+ offset=LUA_ARHEADERSIZE+(size_t)n*LUA_ARENTRYSIZE;
+ for (i=0; i<n; i++)
+ {
+  if (i>0 && strcmp(m[i-1].name,m[i].name)==0)
+  {
+   fprintf(stderr,"%s: module '%s' given twice\n",progname,m[i].name);
+   exit(EXIT_FAILURE);
+  }
+  offset+=strlen(m[i].name)+m[i].size;
+  if (offset>MAXARCHIVE) fatal("archive too large");
+ }
+ D= (output==NULL) ? stdout : fopen(output,"wb");
+ if (D==NULL) cannot("open");
+ fwrite(LUA_ARSIGNATURE,sizeof(LUA_ARSIGNATURE)-1,1,D);
+ putword(D,LUA_ARVERSION);
+ putword(D,n);
+ offset=LUA_ARHEADERSIZE+(size_t)n*LUA_ARENTRYSIZE;
+ for (i=0; i<n; i++)			/* index */
+ {
+  size_t l=strlen(m[i].name);
+  putword(D,offset);
+  putword(D,l);
+  putword(D,offset+l);
+  putword(D,m[i].size);
+  putword(D,LUA_ARSTORED);
+  offset+=l+m[i].size;
+ }
+ for (i=0; i<n; i++)			/* names and contents */
+ {
+  fwrite(m[i].name,strlen(m[i].name),1,D);
+  if (m[i].size>0) fwrite(m[i].data,m[i].size,1,D);
+  free(m[i].name);
+  free(m[i].data);
+ }
+ free(m);
+ if (ferror(D)) cannot("write");
+ if (fclose(D)) cannot("close");
+}
+
 static int pmain(lua_State* L)
 {
  int argc=(int)lua_tointeger(L,1);
  char** argv=(char**)lua_touserdata(L,2);
  const Proto* f;
  int i;
+ if (archiving && dumping)
+ {
+  archive(L,argc,argv);
+  return 0;
+ }
  if (!lua_checkstack(L,argc)) fatal("too many input files");
  for (i=0; i<argc; i++)
  {
     const char* filename=IS("-") ? NULL : argv[i];
-    if (luaL_loadfile(L,filename)!=LUA_OK) fatal(lua_tostring(L,-1));
+    if (luaL_loadfilex(L,filename,MODE)!=LUA_OK) fatal(lua_tostring(L,-1));
  }
  f=combine(L,argc);
  if (listing) luaU_print(f,listing>1);
@@ -370,10 +510,13 @@ static void PrintCode(const Proto* f)
    case OP_JMP:
    case OP_FORLOOP:
    case OP_FORPREP:
+   case OP_FORLOOPI:
+   case OP_FORPREPI:
    case OP_TFORLOOP:
     printf("\t; to %d",sbx+pc+2);
     break;
    case OP_CLOSURE:
+   case OP_LCLOSURE:
     printf("\t; %p",VOID(f->p[bx]));
     break;
    case OP_SETLIST:
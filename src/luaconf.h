@@ -685,6 +685,22 @@
 #define luai_apicheck(l,e)	assert(e)
 #endif
 
+
+/*
+@@ LUA_USE_THREADS turns 'lua_lock' into a real lock, so that several
+** OS threads may run coroutines of the same state (one at a time).
+*/
+/* #define LUA_USE_THREADS */
+
+
+/*
+@@ LUA_USE_TASKLIB builds the libraries 'task' and 'parallel', which
+** run tasks in a pool of OS threads. They need pthreads (or Windows
+** threads) and are not opened by 'luaL_openlibs'; programs get them
+** with 'require'.
+*/
+/* #define LUA_USE_TASKLIB */
+
 /* }================================================================== */
 
 
@@ -44,10 +44,42 @@ LUAMOD_API int (luaopen_debug) (lua_State *L);
 #define LUA_LOADLIBNAME	"package"
 LUAMOD_API int (luaopen_package) (lua_State *L);
 
+#define LUA_TASKLIBNAME	"task"
+LUAMOD_API int (luaopen_task) (lua_State *L);
+
+#define LUA_PARALLELLIBNAME	"parallel"
+LUAMOD_API int (luaopen_parallel) (lua_State *L);
+
 
 /* open all previous libraries */
 LUALIB_API void (luaL_openlibs) (lua_State *L);
 
+/* the same, but opening each library on its first use */
+LUALIB_API void (luaL_openlazylibs) (lua_State *L);
+
+/* open function of a C module linked into the program (or NULL) */
+LUALIB_API lua_CFunction (luaL_getstaticlib) (const char *name);
+
+
+
+/*
+** Batches of API calls (see 'luaE_beginbatch'): a library function that
+** makes many API calls on a state shared by several OS threads takes
+** the lock once for all of them.
+*/
+#if defined(LUA_LIB)
+#if defined(LUA_USE_THREADS)
+LUAI_FUNC void (luaE_beginbatch) (lua_State *L);
+LUAI_FUNC void (luaE_endbatch) (lua_State *L);
+#else
+#define luaE_beginbatch(L)	((void)0)
+#define luaE_endbatch(L)	((void)0)
+#endif
+
+/* the 'next' run inline by generic 'for' loops (see 'luaE_setnextf') */
+LUAI_FUNC void (luaE_setnextf) (lua_State *L, lua_CFunction f);
+#endif
+
 
 
 #if !defined(lua_assert)
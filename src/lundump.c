@@ -237,8 +237,10 @@ static void checkHeader (LoadState *S) {
   checkliteral(S, LUA_SIGNATURE + 1, "not a");  /* 1st char already checked */
   if (LoadByte(S) != LUAC_VERSION)
     error(S, "version mismatch in");
-  if (LoadByte(S) != LUAC_FORMAT)
-    error(S, "format mismatch in");
+  switch (LoadByte(S)) {
+    case LUAC_FORMAT: case LUAC_FORMATX: break;
+    default: error(S, "format mismatch in");
+  }
   checkliteral(S, LUAC_DATA, "corrupted");
   checksize(S, int);
   checksize(S, size_t);
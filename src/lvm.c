@@ -31,6 +31,20 @@
 #include "lvm.h"
 
 
+/*
+** By default, use jump tables in the main interpreter loop on gcc
+** and compatible compilers (define LUA_USE_JUMPTABLE as 0 to use a
+** 'switch' instead)
+*/
+#if !defined(LUA_USE_JUMPTABLE)
+#if defined(__GNUC__)
+#define LUA_USE_JUMPTABLE	1
+#else
+#define LUA_USE_JUMPTABLE	0
+#endif
+#endif
+
+
 /* limit for table tag-method chains (to avoid loops) */
 #define MAXTAGLOOP	2000
 
@@ -613,10 +627,10 @@ static LClosure *getcached (Proto *p, UpVal **encup, StkId base) {
 ** create a new Lua closure, push it in the stack, and initialize
 ** its upvalues. Note that the closure is not cached if prototype is
 ** already black (which means that 'cache' was already cleared by the
-** GC).
+** GC) or if the closure may be reused by OP_LCLOSURE.
 */
 static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
-                         StkId ra) {
+                         StkId ra, int cache) {
   int nup = p->sizeupvalues;
   Upvaldesc *uv = p->upvalues;
   int i;
@@ -631,11 +645,34 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
     ncl->upvals[i]->refcount++;
     /* new closure is white, so we do not need a barrier here */
   }
-  if (!isblack(p))  /* cache will not break GC invariant? */
+  if (cache && !isblack(p))  /* cache will not break GC invariant? */
     p->cache = ncl;  /* save it on cache for reuse */
 }
 
 
+/*
+** give closure 'c', created by an earlier run of an OP_LCLOSURE (and
+** not used anywhere else, as it was never handed out by the debug API),
+** the upvalues for the current run
+*/
+static void reuseclosure (lua_State *L, LClosure *c, UpVal **encup,
+                          StkId base) {
+  int nup = c->p->sizeupvalues;
+  Upvaldesc *uv = c->p->upvalues;
+  int i;
+  for (i = 0; i < nup; i++) {
+    UpVal *up = uv[i].instack ? luaF_findupval(L, base + uv[i].idx)
+                              : encup[uv[i].idx];
+    if (c->upvals[i] != up) {
+      luaC_upvdeccount(L, c->upvals[i]);
+      up->refcount++;
+      c->upvals[i] = up;
+      luaC_upvalbarrier(L, up);  /* closure may be black */
+    }
+  }
+}
+
+
 /*
 ** finish execution of an opcode interrupted by an yield
 */
@@ -732,12 +769,40 @@ void luaV_finishOp (lua_State *L) {
 
 #define Protect(x)	{ {x;}; base = ci->u.l.base; }
 
+/*
+** in threaded builds, a thread running Lua code lets other OS threads
+** take the state (which may move the stack) at every LUAI_THREADYIELD
+** yield points: jumps, tests and allocations
+*/
+#if !defined(LUAI_THREADYIELD)
+#define LUAI_THREADYIELD	1000
+#endif
+
+#if defined(LUA_USE_THREADS)
+#define threadyield(L)  \
+	{ if (--yieldcount == 0) { \
+	    yieldcount = LUAI_THREADYIELD; \
+	    Protect(luai_threadyield(L)); } }
+#else
+#define threadyield(L)	luai_threadyield(L)
+#endif
+
 #define checkGC(L,c)  \
 	{ luaC_condGC(L, L->top = (c),  /* limit of live values */ \
                          Protect(L->top = ci->top));  /* restore top */ \
-           luai_threadyield(L); }
+           threadyield(L); }
 
 
+/* fetch an instruction and prepare its execution */
+#define vmfetch()	{ \
+  i = *(ci->u.l.savedpc++); \
+  if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) \
+    Protect(luaG_traceexec(L)); \
+  ra = RA(i); /* WARNING: any stack reallocation invalidates 'ra' */ \
+  lua_assert(base == ci->u.l.base); \
+  lua_assert(base <= L->top && L->top < L->stack + L->stacksize); \
+}
+
 #define vmdispatch(o)	switch(o)
 #define vmcase(l)	case l:
 #define vmbreak		break
@@ -764,6 +829,12 @@ void luaV_execute (lua_State *L) {
   LClosure *cl;
   TValue *k;
   StkId base;
+#if defined(LUA_USE_THREADS)
+  int yieldcount = LUAI_THREADYIELD;
+#endif
+#if LUA_USE_JUMPTABLE
+#include "ljumptab.h"
+#endif
   ci->callstatus |= CIST_FRESH;  /* fresh invocation of 'luaV_execute" */
  newframe:  /* reentry point when frame changes (call/return) */
   lua_assert(ci == L->ci);
@@ -772,19 +843,19 @@ void luaV_execute (lua_State *L) {
   base = ci->u.l.base;  /* local copy of function's base */
   /* main loop of interpreter */
   for (;;) {
-    Instruction i = *(ci->u.l.savedpc++);
+    Instruction i;
     StkId ra;
-    if (L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT))
-      Protect(luaG_traceexec(L));
-    /* WARNING: several calls may realloc the stack and invalidate 'ra' */
-    ra = RA(i);
-    lua_assert(base == ci->u.l.base);
-    lua_assert(base <= L->top && L->top < L->stack + L->stacksize);
+    vmfetch();
     vmdispatch (GET_OPCODE(i)) {
       vmcase(OP_MOVE) {
         setobjs2s(L, ra, RB(i));
         vmbreak;
       }
+      vmcase(OP_MOVE2) {
+        setobjs2s(L, ra, RB(i));
+        setobjs2s(L, ra + 1, RC(i));
+        vmbreak;
+      }
       vmcase(OP_LOADK) {
         TValue *rb = k + GETARG_Bx(i);
         setobj2s(L, ra, rb);
@@ -1060,35 +1131,58 @@ void luaV_execute (lua_State *L) {
       }
       vmcase(OP_JMP) {
         dojump(ci, i, 0);
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_EQ) {
         TValue *rb = RKB(i);
         TValue *rc = RKC(i);
-        Protect(
-          if (luaV_equalobj(L, rb, rc) != GETARG_A(i))
-            ci->u.l.savedpc++;
-          else
-            donextjump(ci);
-        )
+        int res;
+        if (ttisinteger(rb) && ttisinteger(rc))
+          res = (ivalue(rb) == ivalue(rc));
+        else if (ttisshrstring(rb) && ttisshrstring(rc))
+          res = eqshrstr(tsvalue(rb), tsvalue(rc));
+        else
+          Protect(res = luaV_equalobj(L, rb, rc));
+        if (res != GETARG_A(i))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_LT) {
-        Protect(
-          if (luaV_lessthan(L, RKB(i), RKC(i)) != GETARG_A(i))
-            ci->u.l.savedpc++;
-          else
-            donextjump(ci);
-        )
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        int res;
+        if (ttisinteger(rb) && ttisinteger(rc))
+          res = (ivalue(rb) < ivalue(rc));
+        else if (ttisfloat(rb) && ttisfloat(rc))
+          res = luai_numlt(fltvalue(rb), fltvalue(rc));
+        else
+          Protect(res = luaV_lessthan(L, rb, rc));
+        if (res != GETARG_A(i))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_LE) {
-        Protect(
-          if (luaV_lessequal(L, RKB(i), RKC(i)) != GETARG_A(i))
-            ci->u.l.savedpc++;
-          else
-            donextjump(ci);
-        )
+        TValue *rb = RKB(i);
+        TValue *rc = RKC(i);
+        int res;
+        if (ttisinteger(rb) && ttisinteger(rc))
+          res = (ivalue(rb) <= ivalue(rc));
+        else if (ttisfloat(rb) && ttisfloat(rc))
+          res = luai_numle(fltvalue(rb), fltvalue(rc));
+        else
+          Protect(res = luaV_lessequal(L, rb, rc));
+        if (res != GETARG_A(i))
+          ci->u.l.savedpc++;
+        else
+          donextjump(ci);
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_TEST) {
@@ -1096,6 +1190,7 @@ void luaV_execute (lua_State *L) {
             ci->u.l.savedpc++;
           else
           donextjump(ci);
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_TESTSET) {
@@ -1106,6 +1201,7 @@ void luaV_execute (lua_State *L) {
           setobjs2s(L, ra, rb);
           donextjump(ci);
         }
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_CALL) {
@@ -1190,6 +1286,7 @@ void luaV_execute (lua_State *L) {
             setfltvalue(ra + 3, idx);  /* ...and external index */
           }
         }
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_FORPREP) {
@@ -1220,8 +1317,43 @@ void luaV_execute (lua_State *L) {
         ci->u.l.savedpc += GETARG_sBx(i);
         vmbreak;
       }
+      vmcase(OP_FORLOOPI) {
+        lua_Integer step = ivalue(ra + 2);
+        lua_Integer idx = intop(+, ivalue(ra), step); /* increment index */
+        lua_Integer limit = ivalue(ra + 1);
+        if ((0 < step) ? (idx <= limit) : (limit <= idx)) {
+          ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+          chgivalue(ra, idx);  /* update internal index... */
+          setivalue(ra + 3, idx);  /* ...and external index */
+        }
+        threadyield(L);
+        vmbreak;
+      }
+      vmcase(OP_FORPREPI) {
+        lua_Integer ilimit;
+        int stopnow;
+        lua_assert(ttisinteger(ra) && ttisinteger(ra + 2));
+        if (!forlimit(ra + 1, &ilimit, ivalue(ra + 2), &stopnow))
+          luaG_runerror(L, "'for' limit must be a number");
+        setivalue(ra + 1, ilimit);
+        setivalue(ra, intop(-, (stopnow ? 0 : ivalue(ra)), ivalue(ra + 2)));
+        ci->u.l.savedpc += GETARG_sBx(i);
+        vmbreak;
+      }
       vmcase(OP_TFORCALL) {
         StkId cb = ra + 3;  /* call base */
+        if (ttislcf(ra) && fvalue(ra) == G(L)->nextf && ttistable(ra + 1) &&
+            !(L->hookmask & LUA_MASKCALL)) {  /* traversal with 'next'? */
+          int n;
+          setobjs2s(L, cb, ra + 2);  /* previous key */
+          n = luaH_next(L, hvalue(ra + 1), cb) ? 2 : 0;  /* key and value */
+          for (; n < GETARG_C(i); n++)
+            setnilvalue(cb + n);  /* complete missing results */
+          i = *(ci->u.l.savedpc++);  /* go to next instruction */
+          ra = RA(i);
+          lua_assert(GET_OPCODE(i) == OP_TFORLOOP);
+          goto l_tforloop;
+        }
         setobjs2s(L, cb+2, ra+2);
         setobjs2s(L, cb+1, ra+1);
         setobjs2s(L, cb, ra);
@@ -1239,6 +1371,7 @@ void luaV_execute (lua_State *L) {
           setobjs2s(L, ra, ra + 1);  /* save control variable */
            ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
         }
+        threadyield(L);
         vmbreak;
       }
       vmcase(OP_SETLIST) {
@@ -1267,12 +1400,22 @@ void luaV_execute (lua_State *L) {
         Proto *p = cl->p->p[GETARG_Bx(i)];
         LClosure *ncl = getcached(p, cl->upvals, base);  /* cached closure */
         if (ncl == NULL)  /* no match? */
-          pushclosure(L, p, cl->upvals, base, ra);  /* create a new one */
+          pushclosure(L, p, cl->upvals, base, ra, 1);  /* create a new one */
         else
           setclLvalue(L, ra, ncl);  /* push cashed closure */
         checkGC(L, ra + 1);
         vmbreak;
       }
+      vmcase(OP_LCLOSURE) {
+        Proto *p = cl->p->p[GETARG_Bx(i)];
+        if (ttisLclosure(ra) && clLvalue(ra)->p == p &&  /* left by last run */
+            !isescaped(clLvalue(ra)))  /* and not seen outside its frame? */
+          reuseclosure(L, clLvalue(ra), cl->upvals, base);
+        else
+          pushclosure(L, p, cl->upvals, base, ra, 0);
+        checkGC(L, ra + 1);
+        vmbreak;
+      }
       vmcase(OP_VARARG) {
         int b = GETARG_B(i) - 1;  /* required results */
         int j;
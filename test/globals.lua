@@ -0,0 +1,62 @@
+-- Frozen globals bound by load mode "F": results must match mode "t",
+-- also after the environment of a chunk is replaced.
+--   lua -F test/globals.lua
+
+local function check (src, change)
+  local res = {}
+  for _, mode in ipairs{"t", "tF"} do
+    local f = assert(load(src, "=globals", mode))
+    local r = table.pack(pcall(change, f))
+    for i = 1, r.n do r[i] = tostring(r[i]) end
+    res[#res + 1] = table.concat(r, " ", 1, r.n)
+  end
+  if res[1] ~= res[2] then
+    error(string.format("%s\n  t:  %s\n  tF: %s", src, res[1], res[2]), 0)
+  end
+end
+
+local newenv = {print = "NEW", type = "NEWTYPE"}
+
+-- untouched environment
+check("return print, type(1), string.rep('a', 2)",
+      function (f) return f() end)
+
+-- environment replaced before the chunk runs
+check("return print, type",
+      function (f) debug.setupvalue(f, 1, newenv) return f() end)
+
+-- environment of the chunk replaced through a nested closure: its
+-- siblings share that environment
+check("local function inner () return print end " ..
+      "return function () return print end, inner",
+      function (f)
+        local outer, inner = f()
+        debug.setupvalue(inner, 1, newenv)
+        return outer(), inner()
+      end)
+
+-- a nested closure that reads no frozen global
+check("local function inner () return nonfrozen end " ..
+      "return function () return type end, inner",
+      function (f)
+        local outer, inner = f()
+        debug.setupvalue(inner, 1, newenv)
+        return outer(), inner()
+      end)
+
+-- environment joined with another function's
+check("local function inner () return print end " ..
+      "return function () return print end, inner",
+      function (f)
+        local outer, inner = f()
+        local e = load("return _ENV", "=e", "t")
+        debug.setupvalue(e, 1, newenv)
+        debug.upvaluejoin(outer, 1, e, 1)
+        return outer(), inner()
+      end)
+
+-- 'load' with its own environment
+check("return print", function (f) return f() end)
+assert(load("return print", "=env", "tF", newenv)() == "NEW")
+
+print("globals: OK")
@@ -0,0 +1,130 @@
+-- Differential test of the bytecode optimizer: generates random chunks
+-- and checks that loading them with mode "tO" or "tI" gives the same
+-- output and errors as mode "t".
+--   lua test/optimize.lua [seed [count]]
+-- Exits with status 1, printing the failing chunks, on mismatches.
+
+local seed = tonumber(arg[1]) or 1
+local N = tonumber(arg[2]) or 200
+math.randomseed(seed)
+local R = math.random
+local function pick(t) return t[R(#t)] end
+
+local gen_stat, gen_block
+local depth = 0
+local nvars
+
+local function var() return "v" .. R(nvars) end
+
+local function atom()
+  local k = R(9)
+  if k == 1 then return tostring(R(-3, 5))
+  elseif k == 2 then return pick{"nil", "true", "false"}
+  elseif k == 3 then return '"s' .. R(3) .. '"'
+  elseif k == 4 then return pick{"up1", "up2", "K1", "K2", "K3", "K4"}
+  elseif k == 5 then return "(" .. var() .. " or 0)"
+  else return var() end
+end
+
+local function exp(d)
+  d = d or 0
+  if d > 3 or R(3) == 1 then return atom() end
+  local k = R(10)
+  if k == 1 then return "not " .. exp(d+1)
+  elseif k == 2 then return "(" .. exp(d+1) .. " and " .. exp(d+1) .. ")"
+  elseif k == 3 then return "(" .. exp(d+1) .. " or " .. exp(d+1) .. ")"
+  elseif k == 4 then return "(" .. exp(d+1) .. " == " .. exp(d+1) .. ")"
+  elseif k == 5 then return "(" .. exp(d+1) .. " ~= " .. exp(d+1) .. ")"
+  elseif k == 6 then return "lt(" .. exp(d+1) .. ", " .. exp(d+1) .. ")"
+  elseif k == 7 then return "num(" .. exp(d+1) .. ") + " .. R(3)
+  elseif k == 8 then return "f(" .. exp(d+1) .. ")"
+  elseif k == 9 then return "not not " .. exp(d+1)
+  else return "tostr(" .. exp(d+1) .. ") .. 'x'" end
+end
+
+function gen_stat()
+  local k = R(20)
+  depth = depth + 1
+  local s
+  if depth > 4 then k = R(3) end
+  if k == 1 then s = var() .. " = " .. exp()
+  elseif k == 2 then s = "out(" .. exp() .. ")"
+  elseif k == 3 then s = "local " .. var() .. " = " .. exp() .. "; out(" .. var() .. ")"
+  elseif k == 4 then s = "if " .. exp() .. " then " .. gen_block() .. " elseif " .. exp() .. " then " .. gen_block() .. " else " .. gen_block() .. " end"
+  elseif k == 5 then s = "if " .. exp() .. " then " .. gen_block() .. " end"
+  elseif k == 6 then s = "for i = 1, " .. R(0, 3) .. " do out(i) " .. gen_block() .. " end"
+  elseif k == 7 then s = "do local n = 0 while " .. exp() .. " do n = n + 1 if n > 3 then break end " .. gen_block() .. " end end"
+  elseif k == 8 then s = "do local n = 0 repeat n = n + 1 " .. gen_block() .. " until n > 2 or " .. exp() .. " end"
+  elseif k == 9 then s = "for k, v in ipairs{" .. exp() .. ", " .. exp() .. "} do out(k) " .. gen_block() .. " end"
+  elseif k == 10 then s = "do local c = " .. exp() .. "; local function g() c = f(c) return c end out(g()) " .. var() .. " = g() end"
+  elseif k == 11 then s = "out((function(...) local a, b = ... " .. gen_block() .. " return a, select('#', ...) end)(" .. exp() .. ", " .. exp() .. "))"
+  elseif k == 12 then s = "if " .. exp() .. " then out(1) return end"
+  elseif k == 13 then s = "do local t = {} for i = 1, 3 do t[i] = function() return i end end out(t[1]() + t[3]()) end"
+  elseif k == 14 then s = "while true do " .. gen_block() .. " break end"
+  elseif k == 15 then s = "local x = " .. exp() .. " if not x then out('n') else out('y') end"
+  elseif k == 16 then s = "do local C = " .. atom() .. " local function h(x) " .. gen_block() .. " return tostr(C) .. tostr(x), C == K1, C and 1 or 2, not C, num(C) * 2 + K1, lt(C, K3) end out(h(" .. exp() .. ")) end"
+  elseif k == 17 then s = "out(K1 + K3, K1 < K3, K3 <= K1, K1 == 3, K2 .. 'z', 'a' .. 'b' .. K2, 1 < 2, 2 >= 3, K4 and K1, K4 or K2)"
+  elseif k == 18 then s = "do local A, B = " .. R(-2, 2) .. ", " .. R(-2, 2) .. " out(A + B, A < B, A == B, A // (B ~= 0 and B or 1), -A) end"
+  elseif k == 19 then s = "for i = 1, " .. R(0, 3) .. " do local function h(x) v1 = num(v1) + 1 return x + i end out(h(i)) " .. gen_block() .. " end"
+  else s = "for i = " .. pick{"3", "num(" .. exp() .. ")"} .. ", 1, -1 do if " .. exp() .. " then break end out(i) end" end
+  depth = depth - 1
+  return s
+end
+
+function gen_block()
+  local t = {}
+  for i = 1, R(0, 3) do t[#t+1] = gen_stat() end
+  return table.concat(t, " ")
+end
+
+local prelude = [[
+local out, f, lt, num, tostr = ...
+local up1, up2 = 1, "u"
+local K1, K2, K3, K4 = 3, "k", 2.5, false
+]]
+
+local function run(src, mode)
+  local fn, err = load(src, "=fz", mode)
+  if not fn then return "COMPILE " .. err end
+  local log = {}
+  local function out(...) local t = table.pack(...) for i = 1, t.n do log[#log+1] = tostring(t[i]) end end
+  local function f(x) if type(x) == "number" then return x + 1 end return x end
+  local function lt(a, b) if type(a) == type(b) and (type(a) == "number" or type(a) == "string") then return a < b end return false end
+  local function num(x) return type(x) == "number" and x or 0 end
+  local function tostr(x) return tostring(x) end
+  local ok, e = pcall(fn, out, f, lt, num, tostr)
+  -- variable names in messages may differ: the optimizer can give a
+  -- name to a literal that has the value of a constant local
+  return table.concat(log, ",") .. "|" .. tostring(ok) .. tostring(e):gsub("%s*%b()", "")
+end
+
+-- the optimizer must keep the names that mode "t" gives in messages
+for src, name in pairs{
+  ['local s = "abc"; return ("abc")()'] = "(constant 'abc')",
+  ['local x = 10; local y = x; return y()'] = "(local 'y')",
+} do
+  for _, mode in ipairs{"t", "tO"} do
+    local _, e = pcall(load(src, "=fz", mode))
+    assert(e:find(name, 1, true), mode .. ": " .. e)
+  end
+end
+
+local fails = 0
+for n = 1, N do
+  nvars = R(1, 5)
+  local decl = {}
+  for i = 1, nvars do decl[i] = "local v" .. i .. " = " .. R(0, 3) end
+  local src = prelude .. table.concat(decl, "\n") .. "\n" .. gen_block() .. " " .. gen_block() .. "\nreturn v1"
+  local a = run(src, "t")
+  for _, mode in ipairs{"tO", "tI"} do
+    local b = run(src, mode)
+    if a ~= b then
+      fails = fails + 1
+      print("MISMATCH", mode, "seed", seed, "chunk", n)
+      print(src) print(a) print(b)
+      if fails > 2 then os.exit(1) end
+    end
+  end
+end
+if fails > 0 then os.exit(1) end
+print(string.format("optimizer: %d chunks OK (seed %d)", N, seed))